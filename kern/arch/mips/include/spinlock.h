@@ -43,6 +43,8 @@ typedef unsigned spinlock_data_t;
 void spinlock_data_set(volatile spinlock_data_t *sd, unsigned val);
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
 spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+spinlock_data_t spinlock_data_fetchadd(volatile spinlock_data_t *sd,
+				       unsigned val);
 
 ////////////////////////////////////////////////////////////
 
@@ -93,5 +95,33 @@ spinlock_data_testandset(volatile spinlock_data_t *sd)
 	return x;
 }
 
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_fetchadd(volatile spinlock_data_t *sd, unsigned val)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	/*
+	 * Fetch-and-add using LL/SC.
+	 *
+	 * Load the existing value into X, store X+VAL, and retry
+	 * until the SC succeeds (Y nonzero). Returns the old value.
+	 */
+
+	do {
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%3);"		/*   x = *sd */
+			"addu %1, %0, %2;"	/*   y = x + val */
+			"sc %1, 0(%3);"		/*   *sd = y; y = success? */
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "=&r" (y) : "r" (val), "r" (sd));
+	} while (y == 0);
+	return x;
+}
+
 
 #endif /* _MIPS_SPINLOCK_H_ */
@@ -35,6 +35,9 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <copyinout.h>
+#include <clock.h>
+#include <syscallstat.h>
 #include <opt-A2.h>
 
 /*
@@ -80,7 +83,12 @@ syscall(struct trapframe *tf)
 {
 	int callno;
 	int32_t retval;
+	off_t retval64;
+	bool is64;
 	int err;
+#if OPT_SYSCALLSTAT
+	uint64_t start = gettime_ns();
+#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -98,6 +106,7 @@ syscall(struct trapframe *tf)
 	 */
 
 	retval = 0;
+	is64 = false;
 
 	switch (callno) {
 	    case SYS_reboot:
@@ -108,7 +117,119 @@ syscall(struct trapframe *tf)
 		err = sys___time((userptr_t)tf->tf_a0,
 				 (userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
 #ifdef UW
+	case SYS_open:
+	  err = sys_open((userptr_t)tf->tf_a0,
+			 (int)tf->tf_a1,
+			 (mode_t)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
+	case SYS_close:
+	  err = sys_close((int)tf->tf_a0);
+	  break;
+	case SYS_read:
+	  err = sys_read((int)tf->tf_a0,
+			 (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
+	case SYS_pread:
+	case SYS_pwrite:
+	  {
+	    /* the 64-bit offset is on the stack; a3 is padding */
+	    off_t pos;
+
+	    err = copyin((const_userptr_t)(tf->tf_sp + 16),
+			 &pos, sizeof(pos));
+	    if (err) {
+	      break;
+	    }
+	    if (callno == SYS_pread) {
+	      err = sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			      (int)tf->tf_a2, pos, (int *)(&retval));
+	    }
+	    else {
+	      err = sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			       (int)tf->tf_a2, pos, (int *)(&retval));
+	    }
+	  }
+	  break;
+	case SYS_readv:
+	  err = sys_readv((int)tf->tf_a0,
+			  (const_userptr_t)tf->tf_a1,
+			  (int)tf->tf_a2,
+			  (int *)(&retval));
+	  break;
+	case SYS_writev:
+	  err = sys_writev((int)tf->tf_a0,
+			   (const_userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2,
+			   (int *)(&retval));
+	  break;
+	case SYS_submit:
+	  err = sys_submit((userptr_t)tf->tf_a0,
+			   (unsigned)tf->tf_a1,
+			   (int *)(&retval));
+	  break;
+	case SYS_lseek:
+	  {
+	    /* the 64-bit offset is in a2/a3; whence is on the stack */
+	    off_t pos = ((off_t)tf->tf_a2 << 32) | tf->tf_a3;
+	    int whence;
+
+	    err = copyin((const_userptr_t)(tf->tf_sp + 16),
+			 &whence, sizeof(whence));
+	    if (err) {
+	      break;
+	    }
+	    err = sys_lseek((int)tf->tf_a0, pos, whence, &retval64);
+	    is64 = true;
+	  }
+	  break;
+	case SYS_dup2:
+	  err = sys_dup2((int)tf->tf_a0,
+			 (int)tf->tf_a1,
+			 (int *)(&retval));
+	  break;
+	case SYS_pipe:
+	  err = sys_pipe((userptr_t)tf->tf_a0,
+			 (int *)(&retval));
+	  break;
+	case SYS_copy_file_range:
+	  err = sys_copy_file_range((int)tf->tf_a0,
+				    (int)tf->tf_a1,
+				    (size_t)tf->tf_a2,
+				    (int *)(&retval));
+	  break;
+	case SYS_poll:
+	  err = sys_poll((userptr_t)tf->tf_a0,
+			 (unsigned)tf->tf_a1,
+			 (int)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
+	case SYS_select:
+	  {
+	    /* the timeout, the fifth argument, is on the stack */
+	    userptr_t utimeout;
+
+	    err = copyin((const_userptr_t)(tf->tf_sp + 16),
+			 &utimeout, sizeof(utimeout));
+	    if (err) {
+	      break;
+	    }
+	    err = sys_select((int)tf->tf_a0,
+			     (userptr_t)tf->tf_a1,
+			     (userptr_t)tf->tf_a2,
+			     (userptr_t)tf->tf_a3,
+			     utimeout,
+			     (int *)(&retval));
+	  }
+	  break;
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
 			  (userptr_t)tf->tf_a1,
@@ -133,9 +254,27 @@ syscall(struct trapframe *tf)
     case SYS_fork:
       err = sys_fork(tf, (pid_t *)&retval);
       break;
+    case SYS_vfork:
+      err = sys_vfork(tf, (pid_t *)&retval);
+      break;
+    case SYS_spawn:
+      err = sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+                      (pid_t *)&retval);
+      break;
     case SYS_execv:
       err = sys_execv((char *)tf->tf_a0, (char **)tf->tf_a1);
       break;
+    case SYS_getrusage:
+      err = sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+      break;
+    case SYS_sysstat:
+#if OPT_SYSCALLSTAT
+      err = sys_sysstat((userptr_t)tf->tf_a0, (unsigned)tf->tf_a1,
+                        (int)tf->tf_a2, (int *)&retval);
+#else
+      err = ENOSYS;
+#endif
+      break;
 #endif /* OPT_A2 */
 #endif // UW
 	    /* Add stuff here */
@@ -147,6 +286,10 @@ syscall(struct trapframe *tf)
 	}
 
 
+#if OPT_SYSCALLSTAT
+	syscallstat_record(callno, err != 0, gettime_ns() - start);
+#endif
+
 	if (err) {
 		/*
 		 * Return the error code. This gets converted at
@@ -158,7 +301,14 @@ syscall(struct trapframe *tf)
 	}
 	else {
 		/* Success. */
-		tf->tf_v0 = retval;
+		if (is64) {
+			/* 64-bit values go back in v0 (high) and v1 (low) */
+			tf->tf_v0 = (uint64_t)retval64 >> 32;
+			tf->tf_v1 = (uint32_t)retval64;
+		}
+		else {
+			tf->tf_v0 = retval;
+		}
 		tf->tf_a3 = 0;      /* signal no error */
 	}
 	
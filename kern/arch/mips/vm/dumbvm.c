@@ -38,6 +38,9 @@
 #include <addrspace.h>
 #include <vm.h>
 #include <syscall.h>
+#include <execcache.h>
+#include <kshared.h>
+#include "opt-A2.h"
 #include "opt-A3.h"
 
 /*
@@ -190,6 +193,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	int i;
 	uint32_t ehi, elo;
 	struct addrspace *as;
+	struct kshared_proc *kp;
+	bool readonly;
 	int spl;
 
 	faultaddress &= PAGE_FRAME;
@@ -247,9 +252,13 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
 	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
 	stacktop = USERSTACK;
+	readonly = false;
 
 	if (faultaddress >= vbase1 && faultaddress < vtop1) {
         paddr = (faultaddress - vbase1) + as->as_pbase1;
+#if OPT_A3
+        readonly = as->as_isloaded;
+#endif /* OPT_A3 */
 	}
 	else if (faultaddress >= vbase2 && faultaddress < vtop2) {
 		paddr = (faultaddress - vbase2) + as->as_pbase2;
@@ -257,6 +266,27 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress == KSHARED_TIMEVADDR && kshared_timepaddr != 0) {
+		/* the one time page everybody shares (see kshared.h) */
+		paddr = kshared_timepaddr;
+		readonly = true;
+	}
+	else if (faultaddress == KSHARED_PROCVADDR) {
+		/* this process's page, made the first time it's touched */
+		if (as->as_procpbase == 0) {
+			as->as_procpbase = getppages(1);
+			if (as->as_procpbase == 0) {
+				return ENOMEM;
+			}
+			kp = (struct kshared_proc *)PADDR_TO_KVADDR(as->as_procpbase);
+			bzero(kp, PAGE_SIZE);
+#if OPT_A2
+			kp->kp_pid = curproc->pid;
+#endif /* OPT_A2 */
+		}
+		paddr = as->as_procpbase;
+		readonly = true;
+	}
 	else {
 		return EFAULT;
 	}
@@ -274,11 +304,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		}
 		ehi = faultaddress;
 		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
-        #if OPT_A3
-            if (as->as_isloaded && faultaddress >= vbase1 && faultaddress < vtop1){
-                elo &= ~TLBLO_DIRTY;
-            }
-        #endif /* OPT_A3 */  
+		if (readonly) {
+			elo &= ~TLBLO_DIRTY;
+		}
         DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
@@ -288,7 +316,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     #if OPT_A3
         ehi = faultaddress;
         elo = paddr | TLBLO_VALID | TLBLO_DIRTY;
-        if (as->as_isloaded && faultaddress >= vbase1 && faultaddress < vtop1){
+        if (readonly) {
             elo &= ~TLBLO_DIRTY;
         }
         tlb_random(ehi, elo);
@@ -312,9 +340,11 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	as->as_procpbase = 0;
 #if OPT_A3
     as->as_isloaded = false;
 #endif /* OPT_A3 */
+	as->as_image = NULL;
 
 	return as;
 }
@@ -323,10 +353,18 @@ void
 as_destroy(struct addrspace *as)
 {
     #if OPT_A3
+        if (as->as_image != NULL) {
+            /* region 1 is shared text; the image frees it */
+            execcache_release(as->as_image);
+        } else {
 	    free_kpages(PADDR_TO_KVADDR(as->as_pbase1));
+        }
 	    free_kpages(PADDR_TO_KVADDR(as->as_pbase2));
     	free_kpages(PADDR_TO_KVADDR(as->as_stackpbase));
 	#endif
+	if (as->as_procpbase != 0) {
+		free_kpages(PADDR_TO_KVADDR(as->as_procpbase));
+	}
 
 	kfree(as);
 }
@@ -411,13 +449,16 @@ as_zero_region(paddr_t paddr, unsigned npages)
 int
 as_prepare_load(struct addrspace *as)
 {
-	KASSERT(as->as_pbase1 == 0);
 	KASSERT(as->as_pbase2 == 0);
 	KASSERT(as->as_stackpbase == 0);
 
-	as->as_pbase1 = getppages(as->as_npages1);
-	if (as->as_pbase1 == 0) {
-		return ENOMEM;
+	if (as->as_image == NULL) {
+		KASSERT(as->as_pbase1 == 0);
+		as->as_pbase1 = getppages(as->as_npages1);
+		if (as->as_pbase1 == 0) {
+			return ENOMEM;
+		}
+		as_zero_region(as->as_pbase1, as->as_npages1);
 	}
 
 	as->as_pbase2 = getppages(as->as_npages2);
@@ -430,7 +471,6 @@ as_prepare_load(struct addrspace *as)
 		return ENOMEM;
 	}
 	
-	as_zero_region(as->as_pbase1, as->as_npages1);
 	as_zero_region(as->as_pbase2, as->as_npages2);
 	as_zero_region(as->as_stackpbase, DUMBVM_STACKPAGES);
 
@@ -456,6 +496,92 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+bool
+as_share_text(struct addrspace *as, struct exec_image *img)
+{
+#if OPT_A3
+	KASSERT(as->as_isloaded);
+	KASSERT(as->as_image == NULL);
+	KASSERT(img->ei_textnpages == 0);
+
+	/* region 1 is write-protected once loaded, so it can be shared */
+	img->ei_textpbase = as->as_pbase1;
+	img->ei_textnpages = as->as_npages1;
+	execcache_hold(img);
+	as->as_image = img;
+	return true;
+#else
+	(void)as;
+	(void)img;
+	return false;
+#endif /* OPT_A3 */
+}
+
+bool
+as_map_text(struct addrspace *as, struct exec_image *img)
+{
+#if OPT_A3
+	KASSERT(as->as_pbase1 == 0);
+	KASSERT(as->as_image == NULL);
+
+	if (img->ei_textnpages == 0 || img->ei_textnpages != as->as_npages1) {
+		return false;
+	}
+	as->as_pbase1 = img->ei_textpbase;
+	execcache_hold(img);
+	as->as_image = img;
+	return true;
+#else
+	(void)as;
+	(void)img;
+	return false;
+#endif /* OPT_A3 */
+}
+
+void *
+as_kvaddr(struct addrspace *as, vaddr_t va, size_t *len)
+{
+	vaddr_t base, top;
+	paddr_t pbase;
+
+	/* the text isn't writeable; the data and stack are contiguous */
+	if (va >= as->as_vbase2 &&
+	    va < as->as_vbase2 + as->as_npages2 * PAGE_SIZE) {
+		base = as->as_vbase2;
+		top = base + as->as_npages2 * PAGE_SIZE;
+		pbase = as->as_pbase2;
+	}
+	else if (va >= USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE &&
+		 va < USERSTACK) {
+		base = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+		top = USERSTACK;
+		pbase = as->as_stackpbase;
+	}
+	else {
+		return NULL;
+	}
+	if (pbase == 0) {
+		return NULL;
+	}
+
+	if (*len > top - va) {
+		*len = top - va;
+	}
+	return (void *)PADDR_TO_KVADDR(pbase + (va - base));
+}
+
+void
+as_setpid(struct addrspace *as, pid_t pid)
+{
+	struct kshared_proc *kp;
+
+	/* if there's no page yet, vm_fault fills it in when it makes it */
+	if (as->as_procpbase != 0) {
+		kp = (struct kshared_proc *)PADDR_TO_KVADDR(as->as_procpbase);
+		kp->kp_pid = pid;
+	}
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -468,6 +594,15 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 
 	new->as_vbase1 = old->as_vbase1;
 	new->as_npages1 = old->as_npages1;
+#if OPT_A3
+	new->as_isloaded = old->as_isloaded;
+	if (old->as_image != NULL) {
+		/* shared text stays shared */
+		new->as_pbase1 = old->as_pbase1;
+		execcache_hold(old->as_image);
+		new->as_image = old->as_image;
+	}
+#endif /* OPT_A3 */
 	new->as_vbase2 = old->as_vbase2;
 	new->as_npages2 = old->as_npages2;
 
@@ -481,9 +616,11 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	KASSERT(new->as_pbase2 != 0);
 	KASSERT(new->as_stackpbase != 0);
 
-	memmove((void *)PADDR_TO_KVADDR(new->as_pbase1),
-		(const void *)PADDR_TO_KVADDR(old->as_pbase1),
-		old->as_npages1*PAGE_SIZE);
+	if (new->as_image == NULL) {
+		memmove((void *)PADDR_TO_KVADDR(new->as_pbase1),
+			(const void *)PADDR_TO_KVADDR(old->as_pbase1),
+			old->as_npages1*PAGE_SIZE);
+	}
 
 	memmove((void *)PADDR_TO_KVADDR(new->as_pbase2),
 		(const void *)PADDR_TO_KVADDR(old->as_pbase2),
@@ -48,18 +48,31 @@
  *
  * Note that we have no input buffering; characters typed too rapidly
  * will be lost.
+ *
+ * Output from threads is buffered, in the softc's output ring, and
+ * sent by the write-done interrupt. Polled output (from interrupt
+ * handlers, or with interrupts off) sends whatever's in the ring
+ * first, so nothing comes out of order, and a panic message always
+ * comes after everything printed before it.
+ *
+ * A read returns once it has a newline, or once it has something and
+ * no more input is waiting, so poll() reporting the console readable
+ * means a read won't block.
  */
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
+#include <poll.h>
 #include "autoconf.h"
 
 /*
@@ -74,6 +87,11 @@ static struct con_softc *the_console = NULL;
 static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
+/*
+ * Pollers waiting for input.
+ */
+static struct pollq con_pollq;
+
 //////////////////////////////////////////////////
 
 /*
@@ -113,13 +131,31 @@ flush_delay_buf(void)
 
 /*
  * Print a character, using polling instead of interrupts to wait for
- * I/O completion.
+ * I/O completion. Empty the output ring first.
+ *
+ * If we already hold cs_outlock, we're panicking inside the console
+ * code; don't make it worse.
  */
 static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	unsigned char c;
+
+	if (spinlock_do_i_hold(&cs->cs_outlock)) {
+		cs->cs_sendpolled(cs->cs_devdata, ch);
+		return;
+	}
+
+	spinlock_acquire(&cs->cs_outlock);
+	while (cs->cs_outcount > 0) {
+		c = cs->cs_outbuf[cs->cs_outhead];
+		cs->cs_outhead = (cs->cs_outhead + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+		cs->cs_outcount--;
+		cs->cs_sendpolled(cs->cs_devdata, c);
+	}
 	cs->cs_sendpolled(cs->cs_devdata, ch);
+	spinlock_release(&cs->cs_outlock);
 }
 
 static
@@ -143,14 +179,68 @@ putch_complete_polled(struct con_softc *cs)
 //////////////////////////////////////////////////
 
 /*
- * Print a character, using interrupts to wait for I/O completion.
+ * If the device isn't busy, start it on the next character in the
+ * output ring. Its write-done interrupt (con_start) then sends the
+ * next, and so on until the ring is empty.
  */
+static
+void
+con_kick(struct con_softc *cs)
+{
+	unsigned char c;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (cs->cs_outbusy || cs->cs_outcount == 0) {
+		return;
+	}
+	c = cs->cs_outbuf[cs->cs_outhead];
+	cs->cs_outhead = (cs->cs_outhead + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	cs->cs_outcount--;
+	cs->cs_outbusy = true;
+	cs->cs_send(cs->cs_devdata, c);
+}
+
+/*
+ * Print LEN characters using interrupts: put them in the output ring,
+ * waiting for room if it's full.
+ */
+static
+void
+con_write(struct con_softc *cs, const char *buf, size_t len)
+{
+	unsigned tail;
+
+	spinlock_acquire(&cs->cs_outlock);
+	while (len > 0) {
+		while (cs->cs_outcount == CONSOLE_OUTPUT_BUFFER_SIZE) {
+			/* as in P: hold the wchan before letting go */
+			cs->cs_outwanted = true;
+			wchan_lock(cs->cs_outwchan);
+			spinlock_release(&cs->cs_outlock);
+			wchan_sleep(cs->cs_outwchan);
+			spinlock_acquire(&cs->cs_outlock);
+		}
+		tail = (cs->cs_outhead + cs->cs_outcount) %
+			CONSOLE_OUTPUT_BUFFER_SIZE;
+		while (len > 0 && cs->cs_outcount < CONSOLE_OUTPUT_BUFFER_SIZE) {
+			cs->cs_outbuf[tail] = *buf++;
+			tail = (tail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+			cs->cs_outcount++;
+			len--;
+		}
+		con_kick(cs);
+	}
+	spinlock_release(&cs->cs_outlock);
+}
+
 static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	char c = ch;
+
+	con_write(cs, &c, 1);
 }
 
 /*
@@ -194,17 +284,33 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 		
 	V(cs->cs_rsem);
+	pollq_wakeup(&con_pollq);
 }
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ * Send the next character, and once the ring is half empty, let any
+ * waiting writers in.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
+	bool wake = false;
+
+	spinlock_acquire(&cs->cs_outlock);
+	cs->cs_outbusy = false;
+	con_kick(cs);
+	if (cs->cs_outwanted &&
+	    cs->cs_outcount <= CONSOLE_OUTPUT_BUFFER_SIZE / 2) {
+		cs->cs_outwanted = false;
+		wake = true;
+	}
+	spinlock_release(&cs->cs_outlock);
 
-	V(cs->cs_wsem);
+	if (wake) {
+		wchan_wakeall(cs->cs_outwchan);
+	}
 }
 
 //////////////////////////////////////////////////
@@ -265,6 +371,16 @@ putch_complete(void)
 	}
 }
 
+/*
+ * Is there input waiting, so that getch won't block?
+ */
+static
+bool
+getch_ready(struct con_softc *cs)
+{
+	return cs->cs_gotchars_head != cs->cs_gotchars_tail;
+}
+
 int
 getch(void)
 {
@@ -304,7 +420,10 @@ con_io(struct device *dev, struct uio *uio)
 {
 	int result;
 	char ch;
+	char ubuf[64], obuf[2 * sizeof(ubuf)];
+	size_t n, i, j;
 	struct lock *lk;
+	size_t got = 0;
 
 	(void)dev;  // unused
 
@@ -320,7 +439,11 @@ con_io(struct device *dev, struct uio *uio)
 
 	while (uio->uio_resid > 0) {
 		if (uio->uio_rw==UIO_READ) {
+			if (got > 0 && !getch_ready(the_console)) {
+				break;
+			}
 			ch = getch();
+			got++;
 			if (ch=='\r') {
 				ch = '\n';
 			}
@@ -334,15 +457,21 @@ con_io(struct device *dev, struct uio *uio)
 			}
 		}
 		else {
-			result = uiomove(&ch, 1, uio);
+			/* a chunk at a time, straight into the output ring */
+			n = uio->uio_resid < sizeof(ubuf) ?
+				uio->uio_resid : sizeof(ubuf);
+			result = uiomove(ubuf, n, uio);
 			if (result) {
 				lock_release(lk);
 				return result;
 			}
-			if (ch=='\n') {
-				putch('\r');
+			for (i = j = 0; i < n; i++) {
+				if (ubuf[i]=='\n') {
+					obuf[j++] = '\r';
+				}
+				obuf[j++] = ubuf[i];
 			}
-			putch(ch);
+			con_write(the_console, obuf, j);
 		}
 	}
 	lock_release(lk);
@@ -360,6 +489,23 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Readable once there's input; writes never wait for long.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct pollentry *pe, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+
+	pollq_add(&con_pollq, pe);
+	*revents = events & POLLOUT;
+	if (getch_ready(cs)) {
+		*revents |= events & POLLIN;
+	}
+	return 0;
+}
+
 static
 int
 attach_console_to_vfs(struct con_softc *cs)
@@ -376,6 +522,7 @@ attach_console_to_vfs(struct con_softc *cs)
 	dev->d_close = con_close;
 	dev->d_io = con_io;
 	dev->d_ioctl = con_ioctl;
+	dev->d_poll = con_poll;
 	dev->d_blocks = 0;
 	dev->d_blocksize = 1;
 	dev->d_data = cs;
@@ -398,7 +545,8 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct semaphore *rsem;
+	struct wchan *outwchan;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -418,29 +566,35 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
+	outwchan = wchan_create("console write");
+	if (outwchan == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 
 	cs->cs_rsem = rsem; 
-	cs->cs_wsem = wsem; 
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outwchan = outwchan;
+	cs->cs_outhead = 0;
+	cs->cs_outcount = 0;
+	cs->cs_outbusy = false;
+	cs->cs_outwanted = false;
+	pollq_init(&con_pollq);
 
 	the_console = cs;
 	con_userlock_read = rlk;
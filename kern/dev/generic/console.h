@@ -35,9 +35,16 @@
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * Output goes into a ring that the device's write-done interrupt
+ * (con_start) drains a character at a time, so writers only wait when
+ * it's full.
  */
 
+#include <spinlock.h>
+
 #define CONSOLE_INPUT_BUFFER_SIZE 32
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -49,10 +56,17 @@ struct con_softc {
 
 	/* initialized by config routine */
 	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+
+	struct spinlock cs_outlock;	/* protects the output ring */
+	struct wchan *cs_outwchan;	/* writers waiting for room */
+	unsigned char cs_outbuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_outhead;		/* next char to send */
+	unsigned cs_outcount;		/* chars waiting to be sent */
+	bool cs_outbusy;		/* the device is sending one */
+	bool cs_outwanted;		/* someone's on cs_outwchan */
 };
 
 /*
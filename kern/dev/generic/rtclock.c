@@ -68,3 +68,22 @@ gettime(time_t *secs, uint32_t *nsecs)
 	KASSERT(the_clock!=NULL);
 	the_clock->rtc_gettime(the_clock->rtc_devdata, secs, nsecs);
 }
+
+/*
+ * Fetch the current time as a single 64-bit count of nanoseconds.
+ * This is meant for measuring intervals (scheduler accounting and
+ * the like), so unlike gettime() it quietly returns 0 if called
+ * before the clock device has attached.
+ */
+uint64_t
+gettime_ns(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (the_clock == NULL) {
+		return 0;
+	}
+	the_clock->rtc_gettime(the_clock->rtc_devdata, &secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
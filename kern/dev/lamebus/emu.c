@@ -43,6 +43,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -472,24 +473,28 @@ emufs_reclaim(struct vnode *v)
 	int result;
 
 	/*
-	 * Need both of these locks, e_lock to protect the device
-	 * and vfs_biglock to protect the fs-related material.
+	 * e_lock protects the device and also ef_vnodes, so while we
+	 * hold it nobody can find this vnode and take a new reference.
+	 * But someone may have done so before we got it; if so, drop
+	 * our reference and leave the vnode be.
 	 */
 
-	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
-	if (ev->ev_v.vn_refcount != 1) {
+	spinlock_acquire(&v->vn_countlock);
+	if (v->vn_refcount != 1) {
+		KASSERT(v->vn_refcount > 1);
+		v->vn_refcount--;
+		spinlock_release(&v->vn_countlock);
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		return EBUSY;
 	}
+	spinlock_release(&v->vn_countlock);
 
 	/* emu_close retries on I/O error */
 	result = emu_close(ev->ev_emu, ev->ev_handle);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -513,7 +518,6 @@ emufs_reclaim(struct vnode *v)
 	VOP_CLEANUP(&ev->ev_v);
 
 	lock_release(ef->ef_emu->e_lock);
-	vfs_biglock_release();
 
 	kfree(ev);
 	return 0;
@@ -589,6 +593,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
+	result = 0;
 	while (uio->uio_resid > 0) {
 		amt = uio->uio_resid;
 		if (amt > EMU_MAXIO) {
@@ -599,7 +604,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 		result = emu_write(ev->ev_emu, ev->ev_handle, amt, uio);
 		if (result) {
-			return result;
+			break;
 		}
 
 		if (uio->uio_resid == oldresid) {
@@ -608,7 +613,10 @@ emufs_write(struct vnode *v, struct uio *uio)
 		}
 	}
 
-	return 0;
+	/* After the write, so a reader can't cache the old contents as new */
+	vnode_written(v);
+
+	return result;
 }
 
 /*
@@ -698,6 +706,22 @@ emufs_tryseek(struct vnode *v, off_t pos)
 	return 0;
 }
 
+/*
+ * VOP_POLL
+ *
+ * Host files (and directories) never make us wait for long, so they
+ * are always ready.
+ */
+static
+int
+emufs_poll(struct vnode *v, int events, struct pollentry *pe, int *revents)
+{
+	(void)v;
+	(void)pe;
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
+
 /*
  * VOP_FSYNC
  */
@@ -717,7 +741,11 @@ int
 emufs_truncate(struct vnode *v, off_t len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	return emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	int result;
+
+	result = emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	vnode_written(v);
+	return result;
 }
 
 /*
@@ -1088,6 +1116,7 @@ static const struct vnode_ops emufs_fileops = {
 	emufs_stat,
 	emufs_file_gettype,
 	emufs_tryseek,
+	emufs_poll,
 	emufs_fsync,
 	emufs_mmap,
 	emufs_truncate,
@@ -1123,6 +1152,7 @@ static const struct vnode_ops emufs_dirops = {
 	emufs_stat,
 	emufs_dir_gettype,
 	emufs_dir_tryseek,
+	emufs_poll,
 	emufs_void_op_isdir,  /* fsync */
 	emufs_void_op_isdir,  /* mmap */
 	emufs_truncate_isdir,
@@ -1153,7 +1183,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
 	num = vnodearray_num(ef->ef_vnodes);
@@ -1166,7 +1195,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 			VOP_INCREF(&ev->ev_v);
 
 			lock_release(ef->ef_emu->e_lock);
-			vfs_biglock_release();
 			*ret = ev;
 			return 0;
 		}
@@ -1187,7 +1215,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 			   &ef->ef_fs, ev);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		kfree(ev);
 		return result;
 	}
@@ -1197,13 +1224,11 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 		/* note: VOP_CLEANUP undoes VOP_INIT - it does not kfree */
 		VOP_CLEANUP(&ev->ev_v);
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		kfree(ev);
 		return result;
 	}
 
 	lock_release(ef->ef_emu->e_lock);
-	vfs_biglock_release();
 
 	*ret = ev;
 	return 0;
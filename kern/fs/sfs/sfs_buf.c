@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * SFS filesystem
+ *
+ * Buffer cache.
+ *
+ * All block I/O on a mounted volume other than the superblock and
+ * free block bitmap (which are kept in memory anyway) goes through
+ * here: inodes, indirect blocks, directories, and file data. Buffers
+ * are found by (volume, block) through a hash table; those nobody
+ * has are reused in least recently released order.
+ *
+ * sfs_bread hands back a buffer marked busy, which keeps everyone
+ * else (and eviction) away from it until sfs_brelse. Changes are only
+ * made in the buffer; sfs_bdirty notes that it has to be written
+ * back, and for which file, which happens when it's evicted, on
+ * sfs_bsync (FS_SYNC, and so vfs_sync), on sfs_bsync_file for just
+ * one file's buffers (fsync, and last close), and every SFS_SYNCSECS
+ * seconds from the sync thread.
+ *
+ * The cache is shared by all mounted volumes and sized as a fraction
+ * of RAM when the first one is mounted.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <mainbus.h>
+#include <vfs.h>
+#include <sfs.h>
+
+#define SFS_BUFRAMFRAC	16	/* Use 1/16 of RAM for buffers */
+#define SFS_MINBUFS	16
+#define SFS_SYNCSECS	5	/* Write back dirty buffers this often */
+
+struct sfs_buf {
+	struct sfs_buf *b_hashnext;	/* Hash chain */
+	struct sfs_buf *b_lrunext;	/* Release order, oldest first */
+	struct sfs_buf *b_lruprev;
+	struct sfs_fs *b_fs;		/* Volume, or NULL if not in use */
+	uint32_t b_block;		/* Block number on b_fs */
+	bool b_busy;			/* Someone has it, or it's doing I/O */
+	bool b_dirty;			/* Needs writing back */
+	bool b_zeroed;			/* Zeroed, not read, and not yet dirty */
+	uint32_t b_owner;		/* Inode that dirtied it, or 0 */
+	void *b_data;			/* SFS_BLOCKSIZE bytes */
+};
+
+static struct sfs_buf *sfs_bufs;
+static unsigned sfs_nbufs;
+static struct sfs_buf **sfs_bufhash;	/* sfs_nbufs chains */
+static struct sfs_buf *sfs_lruhead, *sfs_lrutail;
+
+/* Protects all of the above, and the b_busy and b_dirty flags. */
+static struct lock *sfs_buflock;
+/* Signaled when a buffer stops being busy. */
+static struct cv *sfs_bufcv;
+
+static unsigned long sfs_bufhits;
+static unsigned long sfs_bufmisses;
+static unsigned long sfs_bufevictwrites;	/* Written back to reuse */
+static unsigned long sfs_bufsyncwrites;		/* Written back by sync */
+
+////////////////////////////////////////////////////////////
+//
+// Lists
+
+static
+unsigned
+sfs_bufhashfn(struct sfs_fs *sfs, uint32_t block)
+{
+	return (block + ((uintptr_t)sfs >> 4)) % sfs_nbufs;
+}
+
+static
+struct sfs_buf *
+sfs_buflookup(struct sfs_fs *sfs, uint32_t block)
+{
+	struct sfs_buf *b;
+
+	b = sfs_bufhash[sfs_bufhashfn(sfs, block)];
+	while (b != NULL && (b->b_fs != sfs || b->b_block != block)) {
+		b = b->b_hashnext;
+	}
+	return b;
+}
+
+static
+void
+sfs_bufhashin(struct sfs_buf *b)
+{
+	unsigned h = sfs_bufhashfn(b->b_fs, b->b_block);
+
+	b->b_hashnext = sfs_bufhash[h];
+	sfs_bufhash[h] = b;
+}
+
+static
+void
+sfs_bufhashout(struct sfs_buf *b)
+{
+	struct sfs_buf **bp;
+
+	bp = &sfs_bufhash[sfs_bufhashfn(b->b_fs, b->b_block)];
+	while (*bp != b) {
+		KASSERT(*bp != NULL);
+		bp = &(*bp)->b_hashnext;
+	}
+	*bp = b->b_hashnext;
+	b->b_hashnext = NULL;
+}
+
+static
+void
+sfs_lruremove(struct sfs_buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		sfs_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		sfs_lrutail = b->b_lruprev;
+	}
+}
+
+/* Put B at the end to be reused last (or, if FIRST, first). */
+static
+void
+sfs_lruinsert(struct sfs_buf *b, bool first)
+{
+	if (first) {
+		b->b_lruprev = NULL;
+		b->b_lrunext = sfs_lruhead;
+		if (sfs_lruhead != NULL) {
+			sfs_lruhead->b_lruprev = b;
+		}
+		else {
+			sfs_lrutail = b;
+		}
+		sfs_lruhead = b;
+	}
+	else {
+		b->b_lrunext = NULL;
+		b->b_lruprev = sfs_lrutail;
+		if (sfs_lrutail != NULL) {
+			sfs_lrutail->b_lrunext = b;
+		}
+		else {
+			sfs_lruhead = b;
+		}
+		sfs_lrutail = b;
+	}
+}
+
+/*
+ * Drop B from the cache; it gets reused first.
+ */
+static
+void
+sfs_bufforget(struct sfs_buf *b)
+{
+	KASSERT(lock_do_i_hold(sfs_buflock));
+
+	sfs_bufhashout(b);
+	b->b_fs = NULL;
+	b->b_dirty = false;
+	b->b_zeroed = false;
+	b->b_owner = 0;
+	sfs_lruremove(b);
+	sfs_lruinsert(b, true);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Setup
+
+/*
+ * The sync thread.
+ */
+static
+void
+sfs_syncthread(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+
+	for (;;) {
+		clocksleep(SFS_SYNCSECS);
+		vfs_sync();
+	}
+}
+
+/*
+ * Set up the cache. Called on the first mount.
+ */
+void
+sfs_bufbootstrap(void)
+{
+	char *data;
+	unsigned i;
+	int result;
+
+	if (sfs_bufs != NULL) {
+		return;
+	}
+
+	sfs_nbufs = mainbus_ramsize() / SFS_BUFRAMFRAC / SFS_BLOCKSIZE;
+	if (sfs_nbufs < SFS_MINBUFS) {
+		sfs_nbufs = SFS_MINBUFS;
+	}
+
+	sfs_buflock = lock_create("sfs buffers");
+	sfs_bufcv = cv_create("sfs buffers");
+	sfs_bufhash = kmalloc(sfs_nbufs * sizeof(*sfs_bufhash));
+	sfs_bufs = kmalloc(sfs_nbufs * sizeof(*sfs_bufs));
+	data = kmalloc(sfs_nbufs * SFS_BLOCKSIZE);
+	if (sfs_buflock == NULL || sfs_bufcv == NULL || sfs_bufhash == NULL ||
+	    sfs_bufs == NULL || data == NULL) {
+		panic("sfs: Out of memory for %u buffers\n", sfs_nbufs);
+	}
+
+	for (i=0; i<sfs_nbufs; i++) {
+		sfs_bufhash[i] = NULL;
+		sfs_bufs[i].b_hashnext = NULL;
+		sfs_bufs[i].b_fs = NULL;
+		sfs_bufs[i].b_block = 0;
+		sfs_bufs[i].b_busy = false;
+		sfs_bufs[i].b_dirty = false;
+		sfs_bufs[i].b_zeroed = false;
+		sfs_bufs[i].b_owner = 0;
+		sfs_bufs[i].b_data = data + i * SFS_BLOCKSIZE;
+		sfs_lruinsert(&sfs_bufs[i], false);
+	}
+
+	result = thread_fork("sfs sync", NULL, sfs_syncthread, NULL, 0);
+	if (result) {
+		/* Dirty buffers still go out on eviction and sync. */
+		kprintf("sfs: No sync thread: %s\n", strerror(result));
+	}
+
+	kprintf("sfs: %u buffers (%uK)\n", sfs_nbufs,
+		sfs_nbufs * SFS_BLOCKSIZE / 1024);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Buffer operations
+
+/*
+ * Write B back. B must be busy.
+ */
+static
+int
+sfs_bufwrite(struct sfs_buf *b)
+{
+	int result;
+
+	KASSERT(b->b_busy);
+	result = sfs_wblock(b->b_fs, b->b_data, b->b_block);
+	if (result == 0) {
+		b->b_dirty = false;
+	}
+	return result;
+}
+
+/*
+ * Get the buffer for BLOCK. If FILL is false, the caller is going to
+ * overwrite the whole block, so on a miss the buffer is zeroed
+ * instead of read.
+ */
+int
+sfs_bread(struct sfs_fs *sfs, uint32_t block, bool fill,
+	  struct sfs_buf **ret)
+{
+	struct sfs_buf *b;
+	int result;
+
+	lock_acquire(sfs_buflock);
+ again:
+	b = sfs_buflookup(sfs, block);
+	if (b != NULL) {
+		if (b->b_busy) {
+			cv_wait(sfs_bufcv, sfs_buflock);
+			goto again;
+		}
+		b->b_busy = true;
+		sfs_bufhits++;
+		lock_release(sfs_buflock);
+		*ret = b;
+		return 0;
+	}
+
+	/* Not cached; reuse the least recently released buffer. */
+	for (b = sfs_lruhead; b != NULL && b->b_busy; b = b->b_lrunext) {
+		/* nothing */
+	}
+	if (b == NULL) {
+		cv_wait(sfs_bufcv, sfs_buflock);
+		goto again;
+	}
+	b->b_busy = true;
+
+	if (b->b_dirty) {
+		lock_release(sfs_buflock);
+		result = sfs_bufwrite(b);
+		lock_acquire(sfs_buflock);
+		b->b_busy = false;
+		cv_broadcast(sfs_bufcv, sfs_buflock);
+		if (result) {
+			lock_release(sfs_buflock);
+			return result;
+		}
+		sfs_bufevictwrites++;
+		/* someone may have loaded BLOCK meanwhile */
+		goto again;
+	}
+
+	if (b->b_fs != NULL) {
+		sfs_bufhashout(b);
+	}
+	b->b_fs = sfs;
+	b->b_block = block;
+	sfs_bufhashin(b);
+	sfs_bufmisses++;
+	lock_release(sfs_buflock);
+
+	if (!fill) {
+		bzero(b->b_data, SFS_BLOCKSIZE);
+		b->b_zeroed = true;
+	}
+	else {
+		result = sfs_rblock(sfs, b->b_data, block);
+		if (result) {
+			lock_acquire(sfs_buflock);
+			sfs_bufforget(b);
+			b->b_busy = false;
+			cv_broadcast(sfs_bufcv, sfs_buflock);
+			lock_release(sfs_buflock);
+			return result;
+		}
+	}
+
+	*ret = b;
+	return 0;
+}
+
+void *
+sfs_bdata(struct sfs_buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_data;
+}
+
+/*
+ * Mark B dirty on behalf of inode OWNER, so fsync on that file will
+ * write it. OWNER is 0 for blocks no particular file's fsync needs.
+ */
+void
+sfs_bdirty(struct sfs_buf *b, uint32_t owner)
+{
+	KASSERT(b->b_busy);
+	b->b_dirty = true;
+	b->b_zeroed = false;
+	b->b_owner = owner;
+}
+
+/*
+ * The caller got B with FILL false and then failed partway through
+ * overwriting it (e.g. uiomove hit a bad user address). If B was
+ * zeroed on a miss it doesn't hold the block's contents, so drop it
+ * from the cache while it's still busy; left there, the zeros would
+ * be taken for the block. Otherwise B was already cached and whatever
+ * got copied in stands as a partial write by OWNER. The caller still
+ * has to sfs_brelse B.
+ */
+void
+sfs_bfillfailed(struct sfs_buf *b, uint32_t owner)
+{
+	KASSERT(b->b_busy);
+	if (b->b_zeroed) {
+		lock_acquire(sfs_buflock);
+		sfs_bufforget(b);
+		lock_release(sfs_buflock);
+	}
+	else {
+		sfs_bdirty(b, owner);
+	}
+}
+
+void
+sfs_brelse(struct sfs_buf *b)
+{
+	lock_acquire(sfs_buflock);
+	KASSERT(b->b_busy);
+	b->b_busy = false;
+	sfs_lruremove(b);
+	/* forgotten buffers (sfs_bfillfailed) get reused first */
+	sfs_lruinsert(b, b->b_fs == NULL);
+	cv_broadcast(sfs_bufcv, sfs_buflock);
+	lock_release(sfs_buflock);
+}
+
+/*
+ * Does B need writing for a sync of SFS, or of just inode OWNER on
+ * SFS if OWNER isn't 0?
+ */
+static
+bool
+sfs_bufsyncable(struct sfs_buf *b, struct sfs_fs *sfs, uint32_t owner)
+{
+	return b->b_fs == sfs && b->b_dirty &&
+		(owner == 0 || b->b_owner == owner);
+}
+
+/*
+ * Write back SFS's dirty buffers, or only those of inode OWNER if
+ * OWNER isn't 0. The caller mustn't have any buffers.
+ */
+static
+int
+sfs_bsyncsome(struct sfs_fs *sfs, uint32_t owner)
+{
+	struct sfs_buf *b;
+	unsigned i;
+	int result;
+
+	lock_acquire(sfs_buflock);
+	for (i=0; i<sfs_nbufs; i++) {
+		b = &sfs_bufs[i];
+		while (sfs_bufsyncable(b, sfs, owner) && b->b_busy) {
+			cv_wait(sfs_bufcv, sfs_buflock);
+		}
+		if (!sfs_bufsyncable(b, sfs, owner)) {
+			continue;
+		}
+
+		b->b_busy = true;
+		lock_release(sfs_buflock);
+		result = sfs_bufwrite(b);
+		lock_acquire(sfs_buflock);
+		b->b_busy = false;
+		cv_broadcast(sfs_bufcv, sfs_buflock);
+		if (result) {
+			lock_release(sfs_buflock);
+			return result;
+		}
+		sfs_bufsyncwrites++;
+	}
+	lock_release(sfs_buflock);
+	return 0;
+}
+
+/*
+ * Write back all of SFS's dirty buffers.
+ */
+int
+sfs_bsync(struct sfs_fs *sfs)
+{
+	return sfs_bsyncsome(sfs, 0);
+}
+
+/*
+ * Write back the dirty buffers of inode INO only: its data, indirect
+ * block, and the inode itself.
+ */
+int
+sfs_bsync_file(struct sfs_fs *sfs, uint32_t ino)
+{
+	KASSERT(ino != 0);
+	return sfs_bsyncsome(sfs, ino);
+}
+
+/*
+ * BLOCK has been freed; throw away its buffer, if any, without
+ * writing it back.
+ */
+void
+sfs_bforget(struct sfs_fs *sfs, uint32_t block)
+{
+	struct sfs_buf *b;
+
+	lock_acquire(sfs_buflock);
+	while ((b = sfs_buflookup(sfs, block)) != NULL && b->b_busy) {
+		cv_wait(sfs_bufcv, sfs_buflock);
+	}
+	if (b != NULL) {
+		sfs_bufforget(b);
+	}
+	lock_release(sfs_buflock);
+}
+
+/*
+ * SFS is being unmounted (and has been synced); drop its buffers.
+ */
+void
+sfs_bpurge(struct sfs_fs *sfs)
+{
+	unsigned i;
+
+	lock_acquire(sfs_buflock);
+	for (i=0; i<sfs_nbufs; i++) {
+		if (sfs_bufs[i].b_fs == sfs) {
+			KASSERT(!sfs_bufs[i].b_busy);
+			KASSERT(!sfs_bufs[i].b_dirty);
+			sfs_bufforget(&sfs_bufs[i]);
+		}
+	}
+	lock_release(sfs_buflock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Statistics
+
+void
+sfs_bufprintstats(void)
+{
+	unsigned long lookups;
+
+	if (sfs_bufs == NULL) {
+		kprintf("sfs: no buffer cache (nothing mounted yet)\n");
+		return;
+	}
+
+	lock_acquire(sfs_buflock);
+	lookups = sfs_bufhits + sfs_bufmisses;
+	kprintf("sfs: %u buffers, %lu hits, %lu misses (%lu%% hit)\n",
+		sfs_nbufs, sfs_bufhits, sfs_bufmisses,
+		lookups == 0 ? 0 : sfs_bufhits * 100 / lookups);
+	kprintf("sfs: %lu written back on eviction, %lu by sync\n",
+		sfs_bufevictwrites, sfs_bufsyncwrites);
+	lock_release(sfs_buflock);
+}
+
+void
+sfs_bufresetstats(void)
+{
+	if (sfs_bufs == NULL) {
+		return;
+	}
+
+	lock_acquire(sfs_buflock);
+	sfs_bufhits = 0;
+	sfs_bufmisses = 0;
+	sfs_bufevictwrites = 0;
+	sfs_bufsyncwrites = 0;
+	lock_release(sfs_buflock);
+}
@@ -39,6 +39,7 @@
 #include <array.h>
 #include <bitmap.h>
 #include <uio.h>
+#include <synch.h>
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
@@ -111,11 +112,8 @@ int
 sfs_sync(struct fs *fs)
 {
 	struct sfs_fs *sfs; 
-	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
-
 	/*
 	 * Get the sfs_fs from the generic abstract fs.
 	 *
@@ -148,18 +146,25 @@ sfs_sync(struct fs *fs)
 
 	sfs = fs->fs_data;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	for (i=0; i<num; i++) {
-		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+	/* Go over the loaded vnodes, syncing their inodes. */
+	result = sfs_sync_inodes(sfs);
+	if (result) {
+		return result;
+	}
+
+	/* Write back the buffer cache. */
+	result = sfs_bsync(sfs);
+	if (result) {
+		return result;
 	}
 
+	lock_acquire(sfs->sfs_freemaplock);
+
 	/* If the free block map needs to be written, write it. */
 	if (sfs->sfs_freemapdirty) {
 		result = sfs_mapio(sfs, UIO_WRITE);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_freemapdirty = false;
@@ -169,13 +174,13 @@ sfs_sync(struct fs *fs)
 	if (sfs->sfs_superdirty) {
 		result = sfs_wblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_superdirty = false;
 	}
 
-	vfs_biglock_release();
+	lock_release(sfs->sfs_freemaplock);
 	return 0;
 }
 
@@ -189,13 +194,9 @@ const char *
 sfs_getvolname(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
-	const char *ret;
-
-	vfs_biglock_acquire();
-	ret = sfs->sfs_super.sp_volname;
-	vfs_biglock_release();
 
-	return ret;
+	/* Set at mount time and never changed, so no locking needed. */
+	return sfs->sfs_super.sp_volname;
 }
 
 /*
@@ -209,21 +210,29 @@ sfs_unmount(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
 
-	vfs_biglock_acquire();
-	
-	/* Do we have any files open? If so, can't unmount. */
+	/*
+	 * Do we have any files open? If so, can't unmount. If not,
+	 * nobody can start using the volume again: they'd need to get
+	 * at it through vfs_getroot, and the VFS layer has the volume
+	 * list locked.
+	 */
+	lock_acquire(sfs->sfs_vnlock);
 	if (vnodearray_num(sfs->sfs_vnodes) > 0) {
-		vfs_biglock_release();
+		lock_release(sfs->sfs_vnlock);
 		return EBUSY;
 	}
+	lock_release(sfs->sfs_vnlock);
 
 	/* We should have just had sfs_sync called. */
 	KASSERT(sfs->sfs_superdirty == false);
 	KASSERT(sfs->sfs_freemapdirty == false);
 
 	/* Once we start nuking stuff we can't fail. */
+	sfs_bpurge(sfs);
 	vnodearray_destroy(sfs->sfs_vnodes);
 	bitmap_destroy(sfs->sfs_freemap);
+	lock_destroy(sfs->sfs_vnlock);
+	lock_destroy(sfs->sfs_freemaplock);
 	
 	/* The vfs layer takes care of the device for us */
 	(void)sfs->sfs_device;
@@ -232,7 +241,6 @@ sfs_unmount(struct fs *fs)
 	kfree(sfs);
 
 	/* nothing else to do */
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -257,8 +265,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	int result;
 	struct sfs_fs *sfs;
 
-	vfs_biglock_acquire();
-
 	/* We don't pass any options through mount */
 	(void)options;
 
@@ -278,14 +284,15 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	 * don't do that in sfs.)
 	 */
 	if (dev->d_blocksize != SFS_BLOCKSIZE) {
-		vfs_biglock_release();
 		return ENXIO;
 	}
 
+	/* Set up the buffer cache, if this is the first mount */
+	sfs_bufbootstrap();
+
 	/* Allocate object */
 	sfs = kmalloc(sizeof(struct sfs_fs));
 	if (sfs==NULL) {
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 
@@ -293,7 +300,21 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	sfs->sfs_vnodes = vnodearray_create();
 	if (sfs->sfs_vnodes == NULL) {
 		kfree(sfs);
-		vfs_biglock_release();
+		return ENOMEM;
+	}
+
+	/* and locks */
+	sfs->sfs_vnlock = lock_create("sfs vnodes");
+	if (sfs->sfs_vnlock == NULL) {
+		vnodearray_destroy(sfs->sfs_vnodes);
+		kfree(sfs);
+		return ENOMEM;
+	}
+	sfs->sfs_freemaplock = lock_create("sfs freemap");
+	if (sfs->sfs_freemaplock == NULL) {
+		lock_destroy(sfs->sfs_vnlock);
+		vnodearray_destroy(sfs->sfs_vnodes);
+		kfree(sfs);
 		return ENOMEM;
 	}
 
@@ -303,9 +324,10 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load superblock */
 	result = sfs_rblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
 	if (result) {
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		vnodearray_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -316,9 +338,10 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 			"(0x%x, should be 0x%x)\n", 
 			sfs->sfs_super.sp_magic,
 			SFS_MAGIC);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		vnodearray_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
-		vfs_biglock_release();
 		return EINVAL;
 	}
 	
@@ -333,17 +356,19 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load free space bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_BITMAPSIZE(sfs));
 	if (sfs->sfs_freemap == NULL) {
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		vnodearray_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 	result = sfs_mapio(sfs, UIO_READ);
 	if (result) {
 		bitmap_destroy(sfs->sfs_freemap);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		vnodearray_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -361,7 +386,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
-	vfs_biglock_release();
 	return 0;
 }
 
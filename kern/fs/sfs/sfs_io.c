@@ -39,6 +39,11 @@
 //
 // Basic block-level I/O routines
 //
+// These go straight to the device; only the superblock and free
+// block bitmap, which are kept in memory, are read and written with
+// them directly. Everything else goes through the buffer cache in
+// sfs_buf.c.
+//
 // Note: sfs_rblock is used to read the superblock
 // early in mount, before sfs is fully (or even mostly)
 // initialized, and so may not use anything from sfs
@@ -50,8 +55,6 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 	int result;
 	int tries=0;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
 	DEBUG(DB_SFS, "sfs: %s %llu\n", 
 	      uio->uio_rw == UIO_READ ? "read" : "write",
 	      uio->uio_offset / SFS_BLOCKSIZE);
@@ -35,6 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -45,6 +46,9 @@
 #include <device.h>
 #include <sfs.h>
 
+/* With the vnode ops, below */
+static int sfs_dotruncate(struct sfs_vnode *sv, off_t len);
+
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
 			 struct sfs_vnode **ret);
@@ -53,27 +57,41 @@ static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
 //
 // Simple stuff
 
-/* Zero out a disk block. */
+/* Zero out a disk block belonging to inode OWNER (or 0). */
 static
 int
-sfs_clearblock(struct sfs_fs *sfs, uint32_t block)
+sfs_clearblock(struct sfs_fs *sfs, uint32_t owner, uint32_t block)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
-	return sfs_wblock(sfs, zeros, block);
+	struct sfs_buf *buf;
+	int result;
+
+	result = sfs_bread(sfs, block, false, &buf);
+	if (result) {
+		return result;
+	}
+	bzero(sfs_bdata(buf), SFS_BLOCKSIZE);
+	sfs_bdirty(buf, owner);
+	sfs_brelse(buf);
+	return 0;
 }
 
-/* Write an on-disk inode structure back out to disk. */
+/* Write an on-disk inode structure back to its buffer. */
 static
 int
 sfs_sync_inode(struct sfs_vnode *sv)
 {
+	KASSERT(rwlock_do_i_hold_write(sv->sv_lock));
+
 	if (sv->sv_dirty) {
 		struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
-		int result = sfs_wblock(sfs, &sv->sv_i, sv->sv_ino);
+		struct sfs_buf *buf;
+		int result = sfs_bread(sfs, sv->sv_ino, false, &buf);
 		if (result) {
 			return result;
 		}
+		memcpy(sfs_bdata(buf), &sv->sv_i, SFS_BLOCKSIZE);
+		sfs_bdirty(buf, sv->sv_ino);
+		sfs_brelse(buf);
 		sv->sv_dirty = false;
 	}
 	return 0;
@@ -84,26 +102,33 @@ sfs_sync_inode(struct sfs_vnode *sv)
 // Space allocation
 
 /*
- * Allocate a block.
+ * Allocate a block for inode OWNER. When allocating an inode, OWNER
+ * is 0; the new inode gets written by its own fsync regardless.
  */
 static
 int
-sfs_balloc(struct sfs_fs *sfs, uint32_t *diskblock)
+sfs_balloc(struct sfs_fs *sfs, uint32_t owner, uint32_t *diskblock)
 {
 	int result;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
 	if (result) {
+		lock_release(sfs->sfs_freemaplock);
 		return result;
 	}
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 
 	if (*diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: balloc: invalid block %u\n", *diskblock);
 	}
 
-	/* Clear block before returning it */
-	return sfs_clearblock(sfs, *diskblock);
+	/*
+	 * Clear block before returning it. Nobody else can get at it
+	 * yet, so this doesn't need the freemap lock.
+	 */
+	return sfs_clearblock(sfs, owner, *diskblock);
 }
 
 /*
@@ -113,8 +138,13 @@ static
 void
 sfs_bfree(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	/* Drop the buffer first, while the block is still ours. */
+	sfs_bforget(sfs, diskblock);
+
+	lock_acquire(sfs->sfs_freemaplock);
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 }
 
 /*
@@ -124,11 +154,18 @@ static
 int
 sfs_bused(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	int ret;
+
 	if (diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: sfs_bused called on out of range block %u\n", 
 		      diskblock);
 	}
-	return bitmap_isset(sfs->sfs_freemap, diskblock);
+
+	lock_acquire(sfs->sfs_freemaplock);
+	ret = bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_release(sfs->sfs_freemaplock);
+
+	return ret;
 }
 
 ////////////////////////////////////////////////////////////
@@ -146,22 +183,15 @@ int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 	 uint32_t *diskblock)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *idbuf;
+	uint32_t *iddata;
 	uint32_t block;
 	uint32_t idblock;
 	uint32_t idnum, idoff;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	KASSERT(SFS_DBPERIDB * sizeof(*iddata) == SFS_BLOCKSIZE);
 
 	/*
 	 * If the block we want is one of the direct blocks...
@@ -176,7 +206,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 		 * Do we need to allocate?
 		 */
 		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+			result = sfs_balloc(sfs, sv->sv_ino, &block);
 			if (result) {
 				return result;
 			}
@@ -236,7 +266,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 		 * the indirect block. Thus, we need to allocate an
 		 * indirect block.
 		 */
-		result = sfs_balloc(sfs, &idblock);
+		result = sfs_balloc(sfs, sv->sv_ino, &idblock);
 		if (result) {
 			return result;
 		}
@@ -246,39 +276,36 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 
 		/* Mark the inode dirty */
 		sv->sv_dirty = true;
-
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
 	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_rblock(sfs, idbuf, idblock);
-		if (result) {
-			return result;
-		}
+
+	/*
+	 * Load the indirect block. (If we just allocated it, that
+	 * cleared it in the buffer cache, so this doesn't read.)
+	 */
+	result = sfs_bread(sfs, idblock, true, &idbuf);
+	if (result) {
+		return result;
 	}
+	iddata = sfs_bdata(idbuf);
 
 	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+	block = iddata[idoff];
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
+		result = sfs_balloc(sfs, sv->sv_ino, &block);
 		if (result) {
+			sfs_brelse(idbuf);
 			return result;
 		}
 
 		/* Remember the block we allocated */
-		idbuf[idoff] = block;
+		iddata[idoff] = block;
 
-		/* The indirect block is now dirty; write it back */
-		result = sfs_wblock(sfs, idbuf, idblock);
-		if (result) {
-			return result;
-		}
+		/* The indirect block is now dirty */
+		sfs_bdirty(idbuf, sv->sv_ino);
 	}
+	sfs_brelse(idbuf);
 
 	/* Hand back the result and return. */
 	if (block != 0 && !sfs_bused(sfs, block)) {
@@ -308,16 +335,8 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *iobuf;
 	uint32_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -339,40 +358,31 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Read zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_rblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = sfs_bread(sfs, diskblock, true, &iobuf);
 	if (result) {
 		return result;
 	}
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * Now perform the requested operation into/out of the buffer.
+	 * If it was a write, the block will be written back later.
 	 */
+	result = uiomove((char *)sfs_bdata(iobuf) + skipstart, len, uio);
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_wblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		sfs_bdirty(iobuf, sv->sv_ino);
 	}
+	sfs_brelse(iobuf);
 
-	return 0;
+	return result;
 }
 
 /*
@@ -383,14 +393,11 @@ int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *iobuf;
 	uint32_t diskblock;
 	uint32_t fileblock;
 	int result;
 	int doalloc = (uio->uio_rw==UIO_WRITE);
-	off_t saveoff;
-	off_t diskoff;
-	off_t saveres;
-	off_t diskres;
 
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -413,29 +420,25 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	}
 
 	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
-	 */
-	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
-	uio->uio_offset = diskoff;
-
-	/*
-	 * Temporarily set the residue to be one block size.
+	 * Go through the buffer cache. If we're writing the whole
+	 * block there's no need to read it first.
 	 */
 	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
-	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
-	uio->uio_resid = diskres;
-	
-	result = sfs_rwblock(sfs, uio);
-
-	/*
-	 * Now, restore the original uio_offset and uio_resid and update 
-	 * them by the amount of I/O done.
-	 */
-	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
-	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
+	result = sfs_bread(sfs, diskblock, uio->uio_rw == UIO_READ, &iobuf);
+	if (result) {
+		return result;
+	}
+	result = uiomove(sfs_bdata(iobuf), SFS_BLOCKSIZE, uio);
+	if (uio->uio_rw == UIO_WRITE) {
+		if (result) {
+			/* don't leave a zeroed buffer standing in for it */
+			sfs_bfillfailed(iobuf, sv->sv_ino);
+		}
+		else {
+			sfs_bdirty(iobuf, sv->sv_ino);
+		}
+	}
+	sfs_brelse(iobuf);
 
 	return result;
 }
@@ -801,7 +804,7 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * number is the block number, so just get a block.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, 0, &ino);
 	if (result) {
 		return result;
 	}
@@ -893,28 +896,39 @@ sfs_reclaim(struct vnode *v)
 	unsigned ix, i, num;
 	int result;
 
-	vfs_biglock_acquire();
+	/*
+	 * Nobody else should have the vnode locked, since they'd
+	 * need a reference, but take the lock anyway so the routines
+	 * below can check for it.
+	 */
+	rwlock_acquire_write(sv->sv_lock);
+	lock_acquire(sfs->sfs_vnlock);
 
 	/*
 	 * Make sure someone else hasn't picked up the vnode since the
-	 * decision was made to reclaim it. (You must also synchronize
-	 * this with sfs_loadvnode.)
+	 * decision was made to reclaim it. Holding sfs_vnlock keeps
+	 * sfs_loadvnode from handing out any more references.
 	 */
+	spinlock_acquire(&v->vn_countlock);
 	if (v->vn_refcount != 1) {
 
 		/* consume the reference VOP_DECREF gave us */
 		KASSERT(v->vn_refcount>1);
 		v->vn_refcount--;
 
-		vfs_biglock_release();
+		spinlock_release(&v->vn_countlock);
+		lock_release(sfs->sfs_vnlock);
+		rwlock_release_write(sv->sv_lock);
 		return EBUSY;
 	}
+	spinlock_release(&v->vn_countlock);
 
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount==0) {
-		result = VOP_TRUNCATE(&sv->sv_v, 0);
+		result = sfs_dotruncate(sv, 0);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_vnlock);
+			rwlock_release_write(sv->sv_lock);
 			return result;
 		}
 	}
@@ -922,7 +936,8 @@ sfs_reclaim(struct vnode *v)
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sfs->sfs_vnlock);
+		rwlock_release_write(sv->sv_lock);
 		return result;
 	}
 
@@ -950,7 +965,11 @@ sfs_reclaim(struct vnode *v)
 
 	VOP_CLEANUP(&sv->sv_v);
 
-	vfs_biglock_release();
+	lock_release(sfs->sfs_vnlock);
+
+	/* Now it's unreachable, so nobody can be waiting for the lock. */
+	rwlock_release_write(sv->sv_lock);
+	rwlock_destroy(sv->sv_lock);
 
 	/* Release the storage for the vnode structure itself. */
 	kfree(sv);
@@ -971,9 +990,9 @@ sfs_read(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	vfs_biglock_acquire();
+	rwlock_acquire_read(sv->sv_lock);
 	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	rwlock_release_read(sv->sv_lock);
 
 	return result;
 }
@@ -990,9 +1009,10 @@ sfs_write(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_lock);
 	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	vnode_written(v);
+	rwlock_release_write(sv->sv_lock);
 
 	return result;
 }
@@ -1033,7 +1053,9 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 		return result;
 	}
 
+	rwlock_acquire_read(sv->sv_lock);
 	statbuf->st_size = sv->sv_i.sfi_size;
+	rwlock_release_read(sv->sv_lock);
 
 	/* We don't support these yet; you get to implement them */
 	statbuf->st_nlink = 0;
@@ -1053,16 +1075,13 @@ sfs_gettype(struct vnode *v, uint32_t *ret)
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
+	/* The type doesn't change, so this doesn't need the lock. */
 	switch (sv->sv_i.sfi_type) {
 	case SFS_TYPE_FILE:
 		*ret = S_IFREG;
-		vfs_biglock_release();
 		return 0;
 	case SFS_TYPE_DIR:
 		*ret = S_IFDIR;
-		vfs_biglock_release();
 		return 0;
 	}
 	panic("sfs: gettype: Invalid inode type (inode %u, type %u)\n",
@@ -1092,19 +1111,39 @@ sfs_tryseek(struct vnode *v, off_t pos)
 }
 
 /*
- * Called for fsync(), and also on filesystem unmount, global sync(),
- * and some other cases.
+ * Called for poll() and select(). The disk never keeps us waiting for
+ * long, so files and directories are always ready.
+ */
+static
+int
+sfs_poll(struct vnode *v, int events, struct pollentry *pe, int *revents)
+{
+	(void)v;
+	(void)pe;
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
+
+/*
+ * Called for fsync(), and from sfs_close on the last close. Writes
+ * only this file's blocks; the rest of the volume is left to
+ * sfs_sync and the sync thread.
  */
 static
 int
 sfs_fsync(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_lock);
 	result = sfs_sync_inode(sv);
-	vfs_biglock_release();
+	rwlock_release_write(sv->sv_lock);
+	if (result == 0) {
+		/* just this file's blocks; sfs_sync does the rest */
+		result = sfs_bsync_file(sfs, sv->sv_ino);
+	}
 
 	return result;
 }
@@ -1121,35 +1160,26 @@ sfs_mmap(struct vnode *v   /* add stuff as needed */)
 }
 
 /*
- * Called for ftruncate() and from sfs_reclaim.
+ * Truncate (or extend) a file. Called from sfs_truncate and
+ * sfs_reclaim with the vnode locked.
  */
 static
 int
-sfs_truncate(struct vnode *v, off_t len)
+sfs_dotruncate(struct sfs_vnode *sv, off_t len)
 {
-	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
-	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 
 	/* Length in blocks (divide rounding up) */
 	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
 
+	struct sfs_buf *idbuf;
+	uint32_t *iddata;
 	uint32_t i, j, block;
 	uint32_t idblock, baseblock, highblock;
 	int result;
-	int hasnonzero, iddirty;
-
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	int hasnonzero;
 
-	vfs_biglock_acquire();
+	KASSERT(rwlock_do_i_hold_write(sv->sv_lock));
 
 	/*
 	 * Go through the direct blocks. Discard any that are
@@ -1177,26 +1207,26 @@ sfs_truncate(struct vnode *v, off_t len)
 		/* We're past the proposed EOF; may need to free stuff */
 
 		/* Read the indirect block */
-		result = sfs_rblock(sfs, idbuf, idblock);
+		result = sfs_bread(sfs, idblock, true, &idbuf);
 		if (result) {
-			vfs_biglock_release();
 			return result;
 		}
+		iddata = sfs_bdata(idbuf);
 		
 		hasnonzero = 0;
-		iddirty = 0;
 		for (j=0; j<SFS_DBPERIDB; j++) {
 			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
-				iddirty = 1;
+			if (blocklen < baseblock+j && iddata[j] != 0) {
+				sfs_bfree(sfs, iddata[j]);
+				iddata[j] = 0;
+				sfs_bdirty(idbuf, sv->sv_ino);
 			}
 			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
+			if (iddata[j]!=0) {
 				hasnonzero=1;
 			}
 		}
+		sfs_brelse(idbuf);
 
 		if (!hasnonzero) {
 			/* The whole indirect block is empty now; free it */
@@ -1204,14 +1234,6 @@ sfs_truncate(struct vnode *v, off_t len)
 			sv->sv_i.sfi_indirect = 0;
 			sv->sv_dirty = true;
 		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_wblock(sfs, idbuf, idblock);
-			if (result) {
-				vfs_biglock_release();
-				return result;
-			}
-		}
 	}
 
 	/* Set the file size */
@@ -1220,10 +1242,27 @@ sfs_truncate(struct vnode *v, off_t len)
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
-	vfs_biglock_release();
 	return 0;
 }
 
+/*
+ * Called for ftruncate().
+ */
+static
+int
+sfs_truncate(struct vnode *v, off_t len)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	rwlock_acquire_write(sv->sv_lock);
+	result = sfs_dotruncate(sv, len);
+	vnode_written(v);
+	rwlock_release_write(sv->sv_lock);
+
+	return result;
+}
+
 /*
  * Get the full pathname for a file. This only needs to work on directories.
  * Since we don't support subdirectories, assume it's the root directory
@@ -1259,37 +1298,36 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	uint32_t ino;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_lock);
 
 	/* Look up the name */
 	result = sfs_dir_findname(sv, name, &ino, NULL, NULL);
 	if (result!=0 && result!=ENOENT) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_lock);
 		return result;
 	}
 
 	/* If it exists and we didn't want it to, fail */
 	if (result==0 && excl) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_lock);
 		return EEXIST;
 	}
 
 	if (result==0) {
 		/* We got a file; load its vnode and return */
 		result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &newguy);
+		rwlock_release_write(sv->sv_lock);
 		if (result) {
-			vfs_biglock_release();
 			return result;
 		}
 		*ret = &newguy->sv_v;
-		vfs_biglock_release();
 		return 0;
 	}
 
 	/* Didn't exist - create it */
 	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_lock);
 		return result;
 	}
 
@@ -1299,20 +1337,22 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	/* Link it into the directory */
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
+		rwlock_release_write(sv->sv_lock);
 		VOP_DECREF(&newguy->sv_v);
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* Update the linkcount of the new file */
+	rwlock_acquire_write(newguy->sv_lock);
 	newguy->sv_i.sfi_linkcount++;
 
 	/* and consequently mark it dirty. */
 	newguy->sv_dirty = true;
+	rwlock_release_write(newguy->sv_lock);
+
+	rwlock_release_write(sv->sv_lock);
 
 	*ret = &newguy->sv_v;
-	
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1331,20 +1371,29 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 
 	KASSERT(file->vn_fs == dir->vn_fs);
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_lock);
 
 	/* Just create a link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_lock);
 		return result;
 	}
 
-	/* and update the link count, marking the inode dirty */
+	/*
+	 * and update the link count, marking the inode dirty. (If
+	 * it's a link to the directory itself, we have it locked.)
+	 */
+	if (f != sv) {
+		rwlock_acquire_write(f->sv_lock);
+	}
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = true;
+	if (f != sv) {
+		rwlock_release_write(f->sv_lock);
+	}
 
-	vfs_biglock_release();
+	rwlock_release_write(sv->sv_lock);
 	return 0;
 }
 
@@ -1360,28 +1409,42 @@ sfs_remove(struct vnode *dir, const char *name)
 	int slot;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_lock);
 
 	/* Look for the file and fetch a vnode for it. */
 	result = sfs_lookonce(sv, name, &victim, &slot);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_lock);
 		return result;
 	}
 
 	/* Erase its directory entry. */
 	result = sfs_dir_unlink(sv, slot);
 	if (result==0) {
-		/* If we succeeded, decrement the link count. */
+		/*
+		 * If we succeeded, decrement the link count. (The
+		 * victim might be the directory itself, by way of ".".)
+		 */
+		if (victim != sv) {
+			rwlock_acquire_write(victim->sv_lock);
+		}
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
 		victim->sv_i.sfi_linkcount--;
 		victim->sv_dirty = true;
+		if (victim != sv) {
+			rwlock_release_write(victim->sv_lock);
+		}
 	}
 
-	/* Discard the reference that sfs_lookonce got us */
+	rwlock_release_write(sv->sv_lock);
+
+	/*
+	 * Discard the reference that sfs_lookonce got us. If that
+	 * was the last one, this reclaims the file, which needs its
+	 * lock, so it's done after we've let go of everything.
+	 */
 	VOP_DECREF(&victim->sv_v);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -1389,7 +1452,8 @@ sfs_remove(struct vnode *dir, const char *name)
  * Rename a file.
  *
  * Since we don't support subdirectories, assumes that the two
- * directories passed are the same.
+ * directories passed are the same. We hold the directory locked
+ * throughout, and lock the file only to change its link count.
  */
 static
 int
@@ -1401,15 +1465,15 @@ sfs_rename(struct vnode *d1, const char *n1,
 	int slot1, slot2;
 	int result, result2;
 
-	vfs_biglock_acquire();
-
 	KASSERT(d1==d2);
 	KASSERT(sv->sv_ino == SFS_ROOT_LOCATION);
 
+	rwlock_acquire_write(sv->sv_lock);
+
 	/* Look up the old name of the file and get its inode and slot number*/
 	result = sfs_lookonce(sv, n1, &g1, &slot1);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_lock);
 		return result;
 	}
 
@@ -1430,8 +1494,10 @@ sfs_rename(struct vnode *d1, const char *n1,
 	}
 	
 	/* Increment the link count, and mark inode dirty */
+	rwlock_acquire_write(g1->sv_lock);
 	g1->sv_i.sfi_linkcount++;
 	g1->sv_dirty = true;
+	rwlock_release_write(g1->sv_lock);
 
 	/* Unlink the old slot */
 	result = sfs_dir_unlink(sv, slot1);
@@ -1443,14 +1509,17 @@ sfs_rename(struct vnode *d1, const char *n1,
 	 * Decrement the link count again, and mark the inode dirty again,
 	 * in case it's been synced behind our back.
 	 */
+	rwlock_acquire_write(g1->sv_lock);
 	KASSERT(g1->sv_i.sfi_linkcount>0);
 	g1->sv_i.sfi_linkcount--;
 	g1->sv_dirty = true;
+	rwlock_release_write(g1->sv_lock);
+
+	rwlock_release_write(sv->sv_lock);
 
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
 
-	vfs_biglock_release();
 	return 0;
 
  puke_harder:
@@ -1464,11 +1533,13 @@ sfs_rename(struct vnode *d1, const char *n1,
 			strerror(result2));
 		panic("sfs: rename: Cannot recover\n");
 	}
+	rwlock_acquire_write(g1->sv_lock);
 	g1->sv_i.sfi_linkcount--;
+	rwlock_release_write(g1->sv_lock);
  puke:
+	rwlock_release_write(sv->sv_lock);
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
-	vfs_biglock_release();
 	return result;
 }
 
@@ -1486,15 +1557,11 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 
 	if (strlen(path)+1 > buflen) {
-		vfs_biglock_release();
 		return ENAMETOOLONG;
 	}
 	strcpy(buf, path);
@@ -1502,7 +1569,6 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 	VOP_INCREF(&sv->sv_v);
 	*ret = &sv->sv_v;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1520,22 +1586,19 @@ sfs_lookup(struct vnode *v, char *path, struct vnode **ret)
 	struct sfs_vnode *final;
 	int result;
 
-	vfs_biglock_acquire();
-
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 	
+	rwlock_acquire_read(sv->sv_lock);
 	result = sfs_lookonce(sv, path, &final, NULL);
+	rwlock_release_read(sv->sv_lock);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	*ret = &final->sv_v;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1590,6 +1653,7 @@ static const struct vnode_ops sfs_fileops = {
 	sfs_stat,
 	sfs_gettype,
 	sfs_tryseek,
+	sfs_poll,
 	sfs_fsync,
 	sfs_mmap,
 	sfs_truncate,
@@ -1625,6 +1689,7 @@ static const struct vnode_ops sfs_dirops = {
 	sfs_stat,
 	sfs_gettype,
 	UNIMP,   /* tryseek */
+	sfs_poll,
 	sfs_fsync,
 	ISDIR,   /* mmap */
 	ISDIR,   /* truncate */
@@ -1645,6 +1710,10 @@ static const struct vnode_ops sfs_dirops = {
 /*
  * Function to load a inode into memory as a vnode, or dig up one
  * that's already resident.
+ *
+ * The vnodes table is locked throughout, so two threads can't both
+ * load the same inode, and sfs_reclaim can't take a vnode away while
+ * we're handing out a reference to it.
  */
 static
 int
@@ -1653,10 +1722,13 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 {
 	struct vnode *v;
 	struct sfs_vnode *sv;
+	struct sfs_buf *buf;
 	const struct vnode_ops *ops = NULL;
 	unsigned i, num;
 	int result;
 
+	lock_acquire(sfs->sfs_vnlock);
+
 	/* Look in the vnodes table */
 	num = vnodearray_num(sfs->sfs_vnodes);
 
@@ -1678,6 +1750,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 			KASSERT(forcetype==SFS_TYPE_INVAL);
 
 			VOP_INCREF(&sv->sv_v);
+			lock_release(sfs->sfs_vnlock);
 			*ret = sv;
 			return 0;
 		}
@@ -1687,6 +1760,14 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 
 	sv = kmalloc(sizeof(struct sfs_vnode));
 	if (sv==NULL) {
+		lock_release(sfs->sfs_vnlock);
+		return ENOMEM;
+	}
+
+	sv->sv_lock = rwlock_create("sfs vnode");
+	if (sv->sv_lock == NULL) {
+		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return ENOMEM;
 	}
 
@@ -1697,11 +1778,15 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	}
 
 	/* Read the block the inode is in */
-	result = sfs_rblock(sfs, &sv->sv_i, ino);
+	result = sfs_bread(sfs, ino, true, &buf);
 	if (result) {
+		rwlock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
+	memcpy(&sv->sv_i, sfs_bdata(buf), SFS_BLOCKSIZE);
+	sfs_brelse(buf);
 
 	/* Not dirty yet */
 	sv->sv_dirty = false;
@@ -1736,7 +1821,9 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = VOP_INIT(&sv->sv_v, ops, &sfs->sfs_absfs, sv);
 	if (result) {
+		rwlock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
@@ -1747,10 +1834,14 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_v, NULL);
 	if (result) {
 		VOP_CLEANUP(&sv->sv_v);
+		rwlock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
+	lock_release(sfs->sfs_vnlock);
+
 	/* Hand it back */
 	*ret = sv;
 	return 0;
@@ -1767,14 +1858,67 @@ sfs_getroot(struct fs *fs)
 	struct sfs_vnode *sv;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = sfs_loadvnode(sfs, SFS_ROOT_LOCATION, SFS_TYPE_INVAL, &sv);
 	if (result) {
 		panic("sfs: getroot: Cannot load root vnode\n");
 	}
 
-	vfs_biglock_release();
-
 	return &sv->sv_v;
 }
+
+/*
+ * Write back all the inodes in memory, for sfs_sync. Syncing an
+ * inode needs its vnode lock, which comes before sfs_vnlock, so we
+ * can't walk the table with it held; instead take a reference to
+ * each vnode so none of them can be reclaimed, and then go through
+ * them one at a time.
+ */
+int
+sfs_sync_inodes(struct sfs_fs *sfs)
+{
+	struct vnodearray *vns;
+	struct vnode *v;
+	struct sfs_vnode *sv;
+	unsigned i, num;
+	int result, ret = 0;
+
+	vns = vnodearray_create();
+	if (vns == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(sfs->sfs_vnlock);
+	num = vnodearray_num(sfs->sfs_vnodes);
+	result = vnodearray_setsize(vns, num);
+	if (result) {
+		lock_release(sfs->sfs_vnlock);
+		vnodearray_destroy(vns);
+		return result;
+	}
+	for (i=0; i<num; i++) {
+		v = vnodearray_get(sfs->sfs_vnodes, i);
+		VOP_INCREF(v);
+		vnodearray_set(vns, i, v);
+	}
+	lock_release(sfs->sfs_vnlock);
+
+	for (i=0; i<num; i++) {
+		v = vnodearray_get(vns, i);
+		sv = v->vn_data;
+		rwlock_acquire_write(sv->sv_lock);
+		result = sfs_sync_inode(sv);
+		rwlock_release_write(sv->sv_lock);
+		if (result && ret == 0) {
+			ret = result;
+		}
+	}
+
+	/* This may reclaim some of them, which is fine now. */
+	for (i=0; i<num; i++) {
+		VOP_DECREF(vnodearray_get(vns, i));
+	}
+	vnodearray_setsize(vns, 0);
+	vnodearray_destroy(vns);
+
+	return ret;
+}
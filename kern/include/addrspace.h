@@ -38,6 +38,7 @@
 #include <vm.h>
 
 struct vnode;
+struct exec_image;
 
 
 /* 
@@ -55,10 +56,12 @@ struct addrspace {
   paddr_t as_pbase2;
   size_t as_npages2;
   paddr_t as_stackpbase;
+  paddr_t as_procpbase;         /* kshared_proc page, or 0 until used */
   bool as_isloaded;
   int as_isreadable;
   int as_iswriteable;
   int as_isexecutable;
+  struct exec_image *as_image;  /* whose frames back region 1, or NULL */
 };
 
 /*
@@ -95,6 +98,25 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_share_text - give the frames of the first region defined (the
+ *                program's text, already loaded) to exec image IMG, so
+ *                later execs can map them. Returns false if this VM
+ *                system can't share them.
+ *
+ *    as_map_text - back the first region defined with IMG's text
+ *                frames instead of loading it. Call between
+ *                as_define_region and as_prepare_load. Returns false
+ *                if it can't, in which case load the text as usual.
+ *
+ *    as_kvaddr - find user address VA of AS in kernel memory, so it
+ *                can be written while AS isn't the current address
+ *                space. Trims *LEN to what's writeable and contiguous
+ *                from there. Returns NULL if VA isn't writeable.
+ *
+ *    as_setpid - change the pid shown on the address space's
+ *                kshared_proc page (see kern/kshared.h), for a vfork
+ *                child borrowing it.
  */
 
 struct addrspace *as_create(void);
@@ -111,6 +133,10 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+bool              as_share_text(struct addrspace *as, struct exec_image *img);
+bool              as_map_text(struct addrspace *as, struct exec_image *img);
+void             *as_kvaddr(struct addrspace *as, vaddr_t va, size_t *len);
+void              as_setpid(struct addrspace *as, pid_t pid);
 
 
 /*
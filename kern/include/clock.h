@@ -38,10 +38,12 @@
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU once every LT_GRANULARITY usec
+ * (see kern/dev/lamebus/ltimer.h) to run timeouts.
  *
  * gettime() may be used to fetch the current time of day.
+ * gettime_ns() returns the same thing as a single nanosecond count,
+ * which is handier for timing intervals.
  * getinterval() computes the time from time1 to time2.
  *
  * XXX we have struct timespec now, let's use it.
@@ -62,26 +64,59 @@ void hardclock(void);
 void timerclock(void);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
+uint64_t gettime_ns(void);
 
 void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
                  time_t *rsecs, uint32_t *rnsecs);
 
+/*
+ * Timeouts: call a function once, a given number of timer ticks from
+ * now. The callback runs in interrupt context on whichever CPU runs
+ * timerclock(), so it must not sleep.
+ *
+ * timeout_init initializes a timeout; the struct belongs to the
+ * caller and must stay put while the timeout is pending.
+ *
+ * timeout_add arranges for the callback to run after TICKS ticks
+ * (at least one). The timeout must not already be pending.
+ *
+ * timeout_cancel takes a pending timeout back off; it returns false
+ * if the timeout wasn't pending, meaning the callback has already
+ * run or is about to.
+ */
+struct timeout {
+	struct timeout *to_next;	/* Wheel bucket list */
+	struct timeout **to_pprev;
+	unsigned to_expire;		/* Tick to fire on */
+	void (*to_func)(void *);
+	void *to_data;
+	bool to_pending;		/* On the wheel */
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *data);
+void timeout_add(struct timeout *to, unsigned ticks);
+bool timeout_cancel(struct timeout *to);
+
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
- *
- *  this will be more efficient than clocknap() for longer sleeps
  */
 void clocksleep(int seconds);
 
 /*
  * clocknap() suspends execution for the requested number of timer ticks
  *
- * the timer ticks every LT_GRANULARITY usec (see kern/dev/ltimer.h)
+ * the timer ticks every LT_GRANULARITY usec (see kern/dev/lamebus/ltimer.h)
  *
  */
 void clocknap(int ticks);
 
+/*
+ * clocknanosleep() suspends execution for at least the requested
+ * time, rounded up to whole timer ticks, like nanosleep(2).
+ */
+void clocknanosleep(time_t secs, uint32_t nsecs);
+
 
 #endif /* _CLOCK_H_ */
@@ -36,6 +36,14 @@
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
+/*
+ * Buckets in the per-cpu wakeup latency histogram. Bucket N counts
+ * wakeups that waited less than 2^(N+1) microseconds to run (and at
+ * least 2^N, except for bucket 0); the last bucket takes everything
+ * longer.
+ */
+#define CPU_WAKELAT_BUCKETS	16
+
 /*
  * Per-cpu structure
  *
@@ -60,6 +68,10 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_switches;		/* Counter of context switches */
+	unsigned c_spinlock_waits;	/* Spinlock acquires that had to wait */
+	uint64_t c_spinlock_spins;	/* Total spin iterations waiting */
+	unsigned c_wakelat[CPU_WAKELAT_BUCKETS]; /* Wakeup latency histogram */
 
 	/*
 	 * Accessed by other cpus.
@@ -68,6 +80,8 @@ struct cpu {
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
+	unsigned c_wake_migrations;	/* Threads woken onto this cpu */
+	unsigned c_lb_migrations;	/* Threads moved here by balancing */
 
 	/*
 	 * Accessed by other cpus.
@@ -36,16 +36,21 @@
 
 
 struct uio;  /* in <uio.h> */
+struct pollentry;  /* in <poll.h> */
 
 /*
  * Filesystem-namespace-accessible device.
  * d_io is for both reads and writes; the uio indicates the direction.
+ * d_poll is as for VOP_POLL; devices that never block can leave it
+ * NULL.
  */
 struct device {
 	int (*d_open)(struct device *, int flags_from_open);
 	int (*d_close)(struct device *);
 	int (*d_io)(struct device *, struct uio *);
 	int (*d_ioctl)(struct device *, int op, userptr_t data);
+	int (*d_poll)(struct device *, int events, struct pollentry *pe,
+		      int *revents);
 
 	blkcnt_t d_blocks;
 	blksize_t d_blocksize;
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _EXECCACHE_H_
+#define _EXECCACHE_H_
+
+/*
+ * Exec image cache.
+ *
+ * Programs get exec'd over and over (the shell, the test programs),
+ * so load_elf keeps what it learned about each one: the entry point,
+ * the loadable segments, and the physical frames holding the
+ * read-only text segment once one process has loaded it. A later
+ * exec of the same file only has to load its data segment; the text
+ * is mapped straight from the cache.
+ *
+ * Images are keyed by vnode (the cache holds a reference, so the
+ * vnode stays the same one) and by the vnode's write generation (see
+ * vnode.h), size, and modification time when the file was loaded; if
+ * any of those have changed the entry is thrown away. The generation
+ * is what catches a rewrite that keeps the size, since neither SFS
+ * nor emufs keeps mtimes. Images are reference counted: the cache
+ * holds one reference and every address space mapping the text holds
+ * another, so evicting an image whose text is still in use is safe.
+ *
+ * execcache_bootstrap - set up the cache.
+ * execcache_get       - find the image for V. Sets *HIT and returns a
+ *                       filled-in image if there is one; otherwise
+ *                       returns an empty image with just the key set,
+ *                       for the caller to fill in and execcache_enter,
+ *                       or NULL if even that isn't possible. Either
+ *                       way the caller gets a reference.
+ * execcache_enter     - add a filled-in image to the cache.
+ * execcache_hold      - take another reference.
+ * execcache_release   - drop a reference; the last one frees the image
+ *                       and its text frames.
+ * execcache_flushfs   - drop the cache's references to files on FS,
+ *                       so it can be unmounted.
+ * execcache_printstats - print hit/miss counts.
+ */
+
+#include <kern/stat.h>
+
+struct vnode;
+struct fs;
+
+#define EXEC_MAXSEGS  4		/* most loadable segments we'll cache */
+
+struct exec_segment {
+	off_t es_offset;	/* file offset */
+	vaddr_t es_vaddr;	/* load address */
+	size_t es_memsize;	/* size in memory */
+	size_t es_filesize;	/* size in the file */
+	uint32_t es_flags;	/* PF_R, PF_W, PF_X */
+};
+
+struct exec_image {
+	struct vnode *ei_vnode;		/* file (referenced) */
+	unsigned ei_writegen;		/* vnode_writegen at load */
+	off_t ei_size;			/* file size and mtime at load */
+	time_t ei_mtime;
+	uint32_t ei_mtimensec;
+
+	vaddr_t ei_entry;		/* entry point */
+	unsigned ei_nsegs;		/* loadable segments */
+	struct exec_segment ei_segs[EXEC_MAXSEGS];
+
+	paddr_t ei_textpbase;		/* frames holding ei_segs[0], */
+	size_t ei_textnpages;		/* if it is shared text, or 0 */
+
+	unsigned ei_refcount;
+	bool ei_cached;			/* on the cache list */
+	struct exec_image *ei_next;	/* cache list, most recent first */
+};
+
+void execcache_bootstrap(void);
+struct exec_image *execcache_get(struct vnode *v, bool *hit);
+void execcache_enter(struct exec_image *img);
+void execcache_hold(struct exec_image *img);
+void execcache_release(struct exec_image *img);
+void execcache_flushfs(struct fs *fs);
+void execcache_printstats(void);
+
+#endif /* _EXECCACHE_H_ */
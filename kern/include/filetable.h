@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Open files and per-process file descriptor tables.
+ *
+ * An openfile is what open() creates: a vnode plus the access mode
+ * and the seek offset. Descriptors that share one (after dup2, or in
+ * a forked child) share the offset. Each openfile has its own lock,
+ * held across I/O on seekable objects so that reads and writes move
+ * the offset atomically; I/O on different openfiles never contends.
+ *
+ * A filetable maps descriptors to openfiles. Each process has its
+ * own; a fork copies it, taking another reference to every openfile.
+ * Lookups take a reference too, so an openfile can't go away under a
+ * read or write even if the descriptor is closed meanwhile.
+ *
+ * openfile_create   - make an openfile for a vnode that's already open
+ *                     (with FLAGS), such as one end of a pipe.
+ * openfile_open     - open PATH (vfs_open may modify it).
+ * openfile_incref   - take another reference.
+ * openfile_decref   - drop a reference; the last one closes the vnode.
+ *
+ * filetable_create  - create an empty table.
+ * filetable_copy    - create a table sharing all of SRC's openfiles.
+ * filetable_destroy - close everything and free the table.
+ * filetable_stdio   - open the console on descriptors 0, 1 and 2.
+ * filetable_place   - put FILE in the lowest free descriptor, which
+ *                     is handed back in FD. The table takes over the
+ *                     caller's reference.
+ * filetable_get     - look up FD, returning a new reference.
+ * filetable_close   - close FD.
+ * filetable_dup2    - make NEWFD refer to what OLDFD does, closing
+ *                     NEWFD first if need be.
+ */
+
+#include <spinlock.h>
+#include <limits.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_accmode;			/* O_RDONLY, O_WRONLY, O_RDWR */
+	bool of_append;			/* O_APPEND */
+	struct lock *of_lock;		/* protects of_offset */
+	off_t of_offset;
+	struct spinlock of_reflock;	/* protects of_refcount */
+	unsigned of_refcount;
+};
+
+struct filetable {
+	struct spinlock ft_lock;
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+int openfile_create(struct vnode *vn, int flags, struct openfile **ret);
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+void openfile_incref(struct openfile *file);
+void openfile_decref(struct openfile *file);
+
+struct filetable *filetable_create(void);
+int filetable_copy(struct filetable *src, struct filetable **ret);
+void filetable_destroy(struct filetable *ft);
+int filetable_stdio(struct filetable *ft);
+int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+int filetable_close(struct filetable *ft, int fd);
+int filetable_dup2(struct filetable *ft, int oldfd, int newfd);
+
+#endif /* _FILETABLE_H_ */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_KSHARED_H_
+#define _KERN_KSHARED_H_
+
+/*
+ * Pages the kernel maps read-only into every user address space, so
+ * that libc can answer time() and getpid() without a system call.
+ *
+ * KSHARED_TIMEVADDR holds the time of day, updated every timer tick
+ * (so it is only good to a tick) under a sequence count: the count
+ * is odd while an update is in progress, so a reader that sees an
+ * odd count, or a different count afterwards, must try again.
+ *
+ * KSHARED_PROCVADDR holds things about the process itself. It belongs
+ * to the address space, so a vfork child shares its parent's; the
+ * kernel shows the child's pid on it until the parent runs again.
+ */
+
+#define KSHARED_TIMEVADDR  0x7ffe0000	/* below the user stack */
+#define KSHARED_PROCVADDR  0x7ffe1000
+
+struct kshared_time {
+	__u32 kt_seq;		/* odd while being updated */
+	__u32 kt_nsec;
+	__i64 kt_sec;
+};
+
+struct kshared_proc {
+	__i32 kp_pid;
+};
+
+#endif /* _KERN_KSHARED_H_ */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SUBMIT_H_
+#define _KERN_SUBMIT_H_
+
+/*
+ * Batched system calls.
+ *
+ * A program queues requests in the submission queue of a struct
+ * submit_ring in its own memory and then makes one submit() call to
+ * have the kernel run them all. The kernel puts a completion for each
+ * in the completion queue, in the same order.
+ *
+ * Both queues are rings of SUBMIT_ENTRIES slots, with free-running
+ * head and tail counters (index with & (SUBMIT_ENTRIES-1)). The
+ * program owns sr_sqtail and sr_cqhead, the kernel sr_sqhead and
+ * sr_cqtail. submit() stops early if the completion queue fills up;
+ * it returns the number of requests it consumed.
+ *
+ * A request's sqe_offset is the file position for READ and WRITE (as
+ * for pread and pwrite), or -1 to use and advance the file's offset
+ * (as for read and write). A completion's cqe_res is what the call
+ * would have returned, or minus the error code.
+ */
+
+#define SUBMIT_ENTRIES  32	/* slots in each queue; a power of 2 */
+
+/* Request opcodes */
+#define SUBMIT_NOP     0	/* do nothing; cqe_res is 0 */
+#define SUBMIT_READ    1
+#define SUBMIT_WRITE   2
+
+struct submit_sqe {
+	__u32 sqe_op;		/* SUBMIT_* */
+	__i32 sqe_fd;
+	__u32 sqe_buf;		/* user address */
+	__u32 sqe_len;
+	__i64 sqe_offset;	/* position, or -1 */
+	__u64 sqe_data;		/* copied to the completion */
+};
+
+struct submit_cqe {
+	__u64 cqe_data;		/* sqe_data of the request */
+	__i32 cqe_res;		/* result, or -errno */
+	__u32 cqe_pad;
+};
+
+struct submit_ring {
+	__u32 sr_sqhead;	/* next request the kernel takes */
+	__u32 sr_sqtail;	/* next free request slot */
+	__u32 sr_cqhead;	/* next completion the program takes */
+	__u32 sr_cqtail;	/* next free completion slot */
+	struct submit_sqe sr_sq[SUBMIT_ENTRIES];
+	struct submit_cqe sr_cq[SUBMIT_ENTRIES];
+};
+
+#endif /* _KERN_SUBMIT_H_ */
@@ -86,7 +86,7 @@
 //#define SYS_sigaltstack 33
 //                              (resource tracking and usage)
 //#define SYS_wait4      34
-//#define SYS_getrusage  35
+#define SYS_getrusage    35
 //                              (resource limits)
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv        52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev       57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -197,6 +197,12 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- OS/161 extensions --
+#define SYS_spawn        121
+#define SYS_sysstat      122
+#define SYS_submit       123
+#define SYS_copy_file_range 124
+
 /*CALLEND*/
 
 
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SYSSTAT_H_
+#define _KERN_SYSSTAT_H_
+
+/*
+ * System call statistics, as returned by the sysstat() call in
+ * kernels built with "options syscallstat". There is one entry per
+ * system call number; times are in nanoseconds, from entry to the
+ * dispatcher to return from it. Bucket i of the histogram counts
+ * calls that took at least 2^i ns (and less than 2^(i+1), except for
+ * the last bucket).
+ */
+
+#define SYSSTAT_NBUCKETS  32
+
+struct sysstat {
+	__u32 ss_calls;		/* calls made */
+	__u32 ss_errors;	/* calls that failed */
+	__u64 ss_totalns;	/* total time */
+	__u64 ss_minns;		/* shortest call (0 if no calls) */
+	__u64 ss_maxns;		/* longest call */
+	__u32 ss_hist[SYSSTAT_NBUCKETS];
+};
+
+/* Flags for sysstat() */
+#define SYSSTAT_RESET  1	/* zero the statistics after reading them */
+
+#endif /* _KERN_SYSSTAT_H_ */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KLOG_H_
+#define _KLOG_H_
+
+/*
+ * Kernel log.
+ *
+ * kprintf doesn't print directly; it formats into records on the
+ * current cpu's log ring, and the klog thread copies them to the
+ * console. A cpu's ring is only written by that cpu, with interrupts
+ * off, so logging takes no global lock and doesn't wait for the
+ * console. Each cpu's records are printed in the order that cpu
+ * wrote them. Records also carry a global sequence number, and the
+ * klog thread interleaves the rings by it, so output is roughly in
+ * global order. It isn't strictly in order: a cpu takes its number
+ * before publishing the record, so a later number from another cpu
+ * can be printed first. The rings keep what's already been printed,
+ * until it's overwritten, for dmesg.
+ *
+ * If a cpu's ring fills up with unprinted records, a thread waits
+ * for the klog thread to catch up; an interrupt handler, or anyone
+ * holding a spinlock, can't, and the record is dropped.
+ *
+ * klog_cpu_init   - set up the ring for a new cpu.
+ * klog_bootstrap  - start the klog thread.
+ * klog_ready      - true if the current cpu has a ring.
+ * klog_async      - true if the klog thread is doing the printing.
+ *                   If not, whoever calls klog_put must print it
+ *                   with klog_flush.
+ * klog_put        - add LEN (at most KLOG_RECMAX) bytes of text to
+ *                   the current cpu's ring.
+ * klog_flush      - print everything not yet printed, here and now.
+ * klog_sync       - stop the klog thread and go back to printing
+ *                   synchronously; for shutdown.
+ * klog_panic      - same, without waiting for anything; for panic.
+ * klog_tick       - called from hardclock; wakes the klog thread for
+ *                   records written where it couldn't be woken.
+ * klog_dump       - print the whole log (dmesg).
+ */
+
+#define KLOG_RECMAX	128	/* Most bytes of text in one record */
+
+struct cpu;
+
+void klog_cpu_init(struct cpu *c);
+void klog_bootstrap(void);
+bool klog_ready(void);
+bool klog_async(void);
+void klog_put(const char *text, size_t len);
+void klog_flush(void);
+void klog_sync(void);
+void klog_panic(void);
+void klog_tick(void);
+void klog_dump(void);
+
+#endif /* _KLOG_H_ */
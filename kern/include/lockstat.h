@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention profiler.
+ *
+ * When the kernel is built with "options lockstat", every
+ * lock_acquire and spinlock_acquire is recorded, per lock and per
+ * call site, in a per-cpu table: number of acquisitions, how many of
+ * those had to wait, and total and maximum wait and hold times (in
+ * ns). The tables are only touched by their own cpu with interrupts
+ * off, so recording takes no locks.
+ *
+ * lockstat_cpu_init   - set up the table for a new cpu.
+ * lockstat_acquired   - record an acquisition of LOCK (named NAME, or
+ *                       NULL for a spinlock) from SITE, and the time
+ *                       spent waiting for it, if CONTENDED.
+ * lockstat_released   - record that LOCK, acquired from SITE, was
+ *                       held for HOLDNS.
+ * lockstat_report     - print the most contended locks and call sites.
+ * lockstat_reset      - zero all the counters.
+ *
+ * The first two must be called with interrupts off.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct cpu;
+
+void lockstat_cpu_init(struct cpu *c);
+void lockstat_acquired(const void *lock, const char *name, const void *site,
+		       bool contended, uint64_t waitns);
+void lockstat_released(const void *lock, const char *name, const void *site,
+		       uint64_t holdns);
+void lockstat_report(void);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Waiting for any of several objects to become ready, for poll()
+ * and select().
+ *
+ * Each object that can be polled has a pollq: a list of the pollers
+ * interested in it. A poller has one pollwait, for itself, and one
+ * pollentry for each object it's looking at. VOP_POLL takes the
+ * entry and adds it to the object's pollq (pollq_add); whenever the
+ * object might have become ready, it calls pollq_wakeup, which wakes
+ * every poller on the list. The poller then asks each object again.
+ *
+ * An object has to check its state after adding the entry, or under
+ * the same lock it calls pollq_wakeup with, so a change in between
+ * isn't missed.
+ *
+ * pollq_init/cleanup     - set up and tear down a pollq, which must be
+ *                          empty by then.
+ * pollq_add              - add PE to PQ, unless PE is NULL (meaning the
+ *                          caller is only asking) or already on it.
+ * pollq_wakeup           - wake everyone on PQ. May be called from an
+ *                          interrupt handler.
+ *
+ * pollwait_init          - set up a pollwait for the current thread.
+ * pollwait_clear         - forget earlier wakeups; call before asking
+ *                          the objects.
+ * pollwait_sleep         - sleep until some object on one of our
+ *                          entries calls pollq_wakeup, or TICKS timer
+ *                          ticks pass (never, if TICKS is negative),
+ *                          unless that already happened since the last
+ *                          pollwait_clear. Returns false on timeout.
+ *
+ * pollentry_init         - set up an entry for PW.
+ * pollentry_remove       - take PE off whatever pollq it's on.
+ */
+
+#include <spinlock.h>
+
+struct thread;
+struct pollwait;
+struct pollentry;
+
+struct pollq {
+	struct spinlock pq_lock;
+	struct pollentry *pq_head;
+};
+
+struct pollwait {
+	struct thread *pw_thread;
+	bool pw_woken;			/* something happened */
+	bool pw_sleeping;		/* pw_thread is on pollchan */
+	bool pw_expired;		/* our timeout has run */
+};
+
+struct pollentry {
+	struct pollwait *pe_wait;
+	struct pollq *pe_q;		/* what we're on, or NULL */
+	struct pollentry *pe_next;
+	struct pollentry **pe_pprev;
+};
+
+void pollq_init(struct pollq *pq);
+void pollq_cleanup(struct pollq *pq);
+void pollq_add(struct pollq *pq, struct pollentry *pe);
+void pollq_wakeup(struct pollq *pq);
+
+void pollwait_init(struct pollwait *pw);
+void pollwait_clear(struct pollwait *pw);
+bool pollwait_sleep(struct pollwait *pw, int ticks);
+
+void pollentry_init(struct pollentry *pe, struct pollwait *pw);
+void pollentry_remove(struct pollentry *pe);
+
+/* Create the wait channel; call before anything polls. */
+void poll_bootstrap(void);
+
+#endif /* _POLL_H_ */
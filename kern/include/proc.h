@@ -48,21 +48,67 @@
 #define PID_ORPHAN -1
 
 extern pid_t pids_n; // num pids allocated
-extern struct array *proc_table; // global table for holding process status info
-extern struct lock *pid_lock; 
-extern struct lock *ptable_lock;
-extern struct cv *ptable_cv;
+extern struct spinlock pid_lock; 
+
+/*
+ * Process table: one pt_entry per live or zombie process, indexed
+ * directly by pid (PID_MIN to PID_MAX) through a two-level table
+ * whose second level is allocated as pids in that range get used.
+ * Each entry also links its children (fork order, newest first) so
+ * exit only has to visit those, and queues the ones that have exited
+ * so waitpid(-1) can reap the first of them without a search.
+ *
+ * There's no lock for the whole table; each pid maps to one of a set
+ * of locks (pt_lock). A pid's lock covers its slot in the table and
+ * its entry's own children and zombies lists, and goes with its
+ * child_exit_cv. The fields that tie a child to its parent (the
+ * parent_pid, status, exit and accounting fields, vfork_borrowing,
+ * and the sibling and zombie links) change only with both the
+ * child's and the parent's locks held (pt_lock_pair), so either one
+ * is enough to read them; an orphan's are covered by its own lock.
+ * An entry is only ever freed by its own process (if orphaned) or by
+ * its parent, so both can keep using it without looking it up again.
+ */
+#define PT_CHUNK 256    /* entries per second-level table */
 
 struct pt_entry{
     pid_t pid;
     pid_t parent_pid;
     threadstate_t status;
     int exit_status;
+    /*
+     * signalled (with our pt_lock held) when one of our children exits,
+     * gives back a vfork'd address space, or finishes loading for spawn
+     */
+    struct cv *child_exit_cv;
+    bool vfork_borrowing;       /* still using the parent's address space */
+    /* scheduler accounting at exit, including reaped children */
+    uint64_t runtime;
+    unsigned nvcsw;
+    unsigned nivcsw;
+    /* table links */
+    struct pt_entry *children;          /* first child */
+    struct pt_entry *sibling_next;      /* parent's next child */
+    struct pt_entry **sibling_pprev;    /* NULL if not on a child list */
+    /* exited children not yet waited for, in exit order */
+    struct pt_entry *zombies;           /* oldest */
+    struct pt_entry **zombies_tail;     /* last zombie_next */
+    struct pt_entry *zombie_next;       /* parent's next zombie */
+    struct pt_entry **zombie_pprev;     /* NULL if not on a zombie queue */
 };
 
-pid_t genPID(void); // generate pid
+pid_t genPID(void); // generate pid; 0 if none left
+void freePID(pid_t pid);
+struct lock *pt_lock(pid_t pid);
+void pt_lock_pair(pid_t a, pid_t b);
+void pt_unlock_pair(pid_t a, pid_t b);
+pid_t pt_lock_withparent(pid_t pid);
+void pt_unlock_withparent(pid_t pid, pid_t ppid);
+void pt_discard(pid_t pid);
 struct pt_entry *pt_create_entry(pid_t pid);
 void add_pt_entry(pid_t pid);
+void add_pt_child(pid_t parent_pid, pid_t child_pid);
+void add_pt_zombie(pid_t pid);
 void remove_pt_entry(pid_t pid);
 struct pt_entry *get_ptable_entry(pid_t pid);
 void update_pt_children(pid_t pid);
@@ -72,6 +118,7 @@ void update_pt_children(pid_t pid);
 
 struct addrspace;
 struct vnode;
+struct filetable;
 #ifdef UW
 struct semaphore;
 #endif // UW
@@ -101,6 +148,13 @@ struct proc {
 #if OPT_A2
     pid_t pid; // process ID
     struct cv *wait_cv;
+    /* accumulated scheduler accounting of reaped children */
+    uint64_t p_child_runtime;
+    unsigned p_child_nvcsw;
+    unsigned p_child_nivcsw;
+    /* p_addrspace is our vfork parent's, which we must not destroy */
+    bool p_vforked;
+    struct filetable *p_filetable;  /* open file descriptors */
     
 #endif /* OPT_A2 */ 
 };
@@ -48,11 +48,54 @@
  */
 #include <kern/sfs.h>
 
+/*
+ * Locking.
+ *
+ * Each vnode has a reader-writer lock, sv_lock, covering sv_i,
+ * sv_dirty, and the contents of the file (its data blocks and
+ * indirect block); on a directory that means the directory entries.
+ * Reading (read, stat, lookup) holds it shared, so readers of one
+ * file don't get in each other's way; anything that changes the
+ * inode or the blocks holds it exclusive. sfi_type never changes once
+ * the vnode is loaded and can be read without locking. sfi_linkcount
+ * is only changed with both the file and the directory the link is
+ * in locked for writing, so holding either is enough to read it.
+ *
+ * Each volume has two more locks: sfs_vnlock, for the table of loaded
+ * vnodes (so, for finding a vnode and taking a reference to it, and
+ * for reclaiming one), and sfs_freemaplock, for the free block
+ * bitmap, the superblock, and their dirty flags. Below all of these
+ * is the buffer cache, which locks itself; a buffer held busy
+ * counts as a lock.
+ *
+ * Lock order, first to last:
+ *
+ *     the directory's sv_lock
+ *     a file's sv_lock
+ *     sfs_vnlock
+ *     busy buffers
+ *     sfs_freemaplock
+ *     the buffer cache's own lock
+ *
+ * A directory operation (lookup, creat, link, remove, rename) locks
+ * the directory, and then, if it changes the link count, the file.
+ * There's only the one directory, so there's never a second
+ * directory lock to order; rename holds the directory lock
+ * throughout, then the file's. No operation locks two files. (If
+ * subdirectories are ever added, rename across directories will need
+ * a per-volume rename lock taken before any vnode lock, so that the
+ * two directories can be locked parent first.)
+ *
+ * The VFS layer's own locks (vfs_listlock, when mounting or looking
+ * up a volume by name) come before all of these.
+ */
+
 struct sfs_vnode {
 	struct vnode sv_v;              /* abstract vnode structure */
 	struct sfs_inode sv_i;		/* on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct rwlock *sv_lock;         /* see above */
 };
 
 struct sfs_fs {
@@ -61,8 +104,10 @@ struct sfs_fs {
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
+	struct lock *sfs_vnlock;        /* protects sfs_vnodes */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
+	struct lock *sfs_freemaplock;   /* protects freemap and super */
 };
 
 /*
@@ -84,6 +129,25 @@ int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
 int sfs_rblock(struct sfs_fs *sfs, void *data, uint32_t block);
 int sfs_wblock(struct sfs_fs *sfs, void *data, uint32_t block);
 
+/* Buffer cache (see sfs_buf.c) */
+struct sfs_buf;
+void sfs_bufbootstrap(void);
+int sfs_bread(struct sfs_fs *sfs, uint32_t block, bool fill,
+	      struct sfs_buf **ret);
+void *sfs_bdata(struct sfs_buf *b);
+void sfs_bdirty(struct sfs_buf *b, uint32_t owner);
+void sfs_bfillfailed(struct sfs_buf *b, uint32_t owner);
+void sfs_brelse(struct sfs_buf *b);
+int sfs_bsync(struct sfs_fs *sfs);
+int sfs_bsync_file(struct sfs_fs *sfs, uint32_t ino);
+void sfs_bforget(struct sfs_fs *sfs, uint32_t block);
+void sfs_bpurge(struct sfs_fs *sfs);
+void sfs_bufprintstats(void);
+void sfs_bufresetstats(void);
+
+/* Write back all dirty inodes (to the buffer cache) */
+int sfs_sync_inodes(struct sfs_fs *sfs);
+
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
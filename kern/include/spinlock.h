@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include "opt-lockstat.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -50,19 +51,35 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * These are ticket locks: each CPU that wants the lock atomically
+ * takes the next number from lk_next and waits until lk_serving
+ * reaches it, so CPUs get the lock in the order they asked for it
+ * and none can be starved by the others.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+	volatile spinlock_data_t lk_next;    /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_serving; /* Ticket now holding the lock. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	const void *lk_site;		/* Where it was acquired (lockstat) */
+	uint64_t lk_stamp;		/* When it was acquired (lockstat) */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER	\
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL, NULL, 0 }
+#else
+#define SPINLOCK_INITIALIZER	\
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL }
+#endif
 
 /*
  * Spinlock functions.
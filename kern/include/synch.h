@@ -36,6 +36,7 @@
 
 
 #include <spinlock.h>
+#include "opt-lockstat.h"
 
 /*
  * Dijkstra-style semaphore.
@@ -71,6 +72,10 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * Waiters spin while the owner is running on another cpu and sleep
+ * otherwise; a release with sleepers hands the lock straight to the
+ * one it wakes (lk_handoff) instead of dropping it.
  */
 struct lock {
         char *lk_name;
@@ -78,6 +83,12 @@ struct lock {
         struct wchan *lock_wchan;
         bool held;
         struct thread *owner;         
+        unsigned lk_nsleepers;          /* threads asleep on lock_wchan */
+        bool lk_handoff;                /* held on behalf of a woken sleeper */
+#if OPT_LOCKSTAT
+        const void *lk_site;            /* where it was acquired */
+        uint64_t lk_stamp;              /* when it was acquired */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -139,4 +150,64 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or one writer.
+ * Writers get preference: once a writer is waiting, new readers
+ * wait behind it, so a steady stream of readers can't starve writers.
+ * (A steady stream of writers can starve readers, so this is meant
+ * for read-mostly data.)
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+        struct spinlock rw_spin;
+        struct wchan *rw_readchan;      /* readers wait here */
+        struct wchan *rw_writechan;     /* writers and upgraders wait here */
+        unsigned rw_readers;            /* threads holding it for reading */
+        unsigned rw_waitreaders;        /* threads asleep on rw_readchan */
+        unsigned rw_waitwriters;        /* writers asleep on rw_writechan */
+        struct thread *rw_writer;       /* thread holding it for writing */
+        struct thread *rw_upgrader;     /* reader waiting to upgrade */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read     - Get the lock for reading.
+ *    rwlock_release_read     - Give up a read hold.
+ *    rwlock_acquire_write    - Get the lock for writing.
+ *    rwlock_release_write    - Give up a write hold.
+ *    rwlock_tryacquire_read  - Get the lock for reading if that can be
+ *                              done without waiting; returns true if so.
+ *    rwlock_tryacquire_write - Likewise, for writing.
+ *    rwlock_upgrade          - Turn the current thread's read hold into
+ *                              a write hold, waiting for the other
+ *                              readers to leave. Only one upgrade can
+ *                              be pending; if another thread is already
+ *                              upgrading, returns false and the caller
+ *                              still has only its read hold (and
+ *                              should drop it to let the other finish).
+ *    rwlock_downgrade        - Turn a write hold into a read hold
+ *                              without letting any writer in between.
+ *    rwlock_do_i_hold_write  - True if the current thread holds the
+ *                              lock for writing. (Readers aren't
+ *                              tracked individually.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_tryacquire_read(struct rwlock *);
+bool rwlock_tryacquire_write(struct rwlock *);
+bool rwlock_upgrade(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -59,9 +59,27 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
 
 #ifdef UW
+int sys_open(userptr_t upath, int flags, mode_t mode, int *retval);
+int sys_close(int fdesc);
+int sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval);
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
+int sys_pread(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+	      int *retval);
+int sys_pwrite(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+	       int *retval);
+int sys_readv(int fdesc, const_userptr_t uiov, int iovcnt, int *retval);
+int sys_writev(int fdesc, const_userptr_t uiov, int iovcnt, int *retval);
+int sys_submit(userptr_t uring, unsigned count, int *retval);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_pipe(userptr_t ufds, int *retval);
+int sys_copy_file_range(int infd, int outfd, size_t len, int *retval);
+int sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval);
+int sys_select(int nfds, userptr_t ureadfds, userptr_t uwritefds,
+	       userptr_t uexceptfds, userptr_t utimeout, int *retval);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
@@ -70,8 +88,11 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 
 #if OPT_A2
 pid_t sys_fork(struct trapframe *parent_tf, pid_t *retval);
+int sys_vfork(struct trapframe *parent_tf, pid_t *retval);
+int sys_spawn(userptr_t program, userptr_t args, pid_t *retval);
 
 int sys_execv(const char *program, char **args);
+int sys_getrusage(int who, userptr_t usage);
 #endif /* OPT_A2 */
 
 
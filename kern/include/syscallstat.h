@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYSCALLSTAT_H_
+#define _SYSCALLSTAT_H_
+
+/*
+ * System call profiler.
+ *
+ * When the kernel is built with "options syscallstat", the syscall
+ * dispatcher times every call and records, per call number, in a
+ * per-cpu table: number of calls and failures, total, minimum and
+ * maximum time (in ns; we have no cycle counter to read), and a log2
+ * histogram of times. Calls that don't return (_exit, and execv that
+ * works) aren't recorded. The tables are only touched by their own
+ * cpu with interrupts off, so recording takes no locks.
+ *
+ * syscallstat_cpu_init - set up the table for a new cpu.
+ * syscallstat_record   - record that call CALLNO took NS, and whether
+ *                        it FAILED.
+ * syscallstat_report   - print the stats of every call that was made.
+ * syscallstat_reset    - zero all the counters.
+ *
+ * sys_sysstat is the sysstat() system call: copy the stats for call
+ * numbers 0 to COUNT-1 (as struct sysstat, see <kern/sysstat.h>) out
+ * to BUF, and then reset them if FLAGS has SYSSTAT_RESET.
+ */
+
+#include "opt-syscallstat.h"
+
+#if OPT_SYSCALLSTAT
+
+struct cpu;
+
+void syscallstat_cpu_init(struct cpu *c);
+void syscallstat_record(int callno, bool failed, uint64_t ns);
+void syscallstat_report(void);
+void syscallstat_reset(void);
+
+int sys_sysstat(userptr_t buf, unsigned count, int flags, int *retval);
+
+#endif /* OPT_SYSCALLSTAT */
+
+#endif /* _SYSCALLSTAT_H_ */
@@ -101,6 +101,30 @@ struct thread {
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Scheduler accounting. Maintained by thread_switch() and
+	 * thread_make_runnable(); times are in nanoseconds.
+	 *
+	 * t_stamp is when the thread last went onto a cpu (if it's
+	 * running) or last became runnable (if it's ready). t_woken
+	 * is set when a sleeping thread is made runnable, so the
+	 * wakeup-to-run latency can be recorded when it next runs.
+	 */
+	uint64_t t_runtime;		/* Total time spent running */
+	uint64_t t_waittime;		/* Total time spent runnable */
+	uint64_t t_stamp;		/* Time of last state change */
+	unsigned t_nvcsw;		/* Voluntary context switches */
+	unsigned t_nivcsw;		/* Involuntary context switches */
+	bool t_woken;			/* Woken up since last run */
+
+	/*
+	 * Cpu placement. t_lastran is when the thread last came off a
+	 * cpu; if that was recently (see thread_migration_cost) its
+	 * cache footprint is assumed to still be on t_cpu.
+	 */
+	uint64_t t_lastran;		/* Time thread last stopped running */
+	unsigned t_migrations;		/* Number of times moved between cpus */
+
 	/*
 	 * Public fields
 	 */
@@ -168,5 +192,27 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Cpu placement tunables (see thread.c).
+ *
+ * thread_migration_cost is in nanoseconds: a thread that last ran
+ * less than this long ago is considered cache-hot and is not moved
+ * off its cpu unless the load imbalance is large. thread_wake_affine
+ * allows woken threads to be placed on the waker's cpu.
+ */
+extern uint64_t thread_migration_cost;
+extern bool thread_wake_affine;
+
+/*
+ * Print the cpu placement settings and per-cpu migration counts.
+ */
+void thread_printmigration(void);
+
+/*
+ * Print per-thread scheduler accounting and the per-cpu
+ * wakeup-to-run latency histograms. For the kernel menu.
+ */
+void thread_printstats(void);
+
 
 #endif /* _THREAD_H_ */
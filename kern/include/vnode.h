@@ -30,9 +30,11 @@
 #ifndef _VNODE_H_
 #define _VNODE_H_
 
+#include <spinlock.h>
 
 struct uio;
 struct stat;
+struct pollentry;
 
 /*
  * A struct vnode is an abstract representation of a file.
@@ -50,10 +52,26 @@ struct stat;
  * vn_opencount is managed using VOP_INCOPEN and VOP_DECOPEN by
  * vfs_open() and vfs_close(). Code above the VFS layer should not
  * need to worry about it.
+ *
+ * vn_writegen counts changes to the file's contents: filesystems
+ * call vnode_written on every write and truncate, so caches of file
+ * contents kept above the filesystem (the exec cache) can tell when
+ * they've gone stale even where the filesystem keeps no mtime.
+ *
+ * vn_countlock protects the two counts and vn_writegen, and nothing
+ * else. Everything else about the file is the filesystem's business
+ * to lock. When the refcount drops to zero, VOP_RECLAIM is called
+ * without the countlock held and with the count still at 1; a
+ * filesystem that can hand out new references (by looking the vnode
+ * up in a table of loaded vnodes, say) must recheck the count under
+ * the countlock while holding whatever lock protects that table, and
+ * if it has gone up again, drop its own reference and return EBUSY.
  */
 struct vnode {
+	struct spinlock vn_countlock;   /* Lock for counts and writegen */
 	int vn_refcount;                /* Reference count */
 	int vn_opencount;
+	unsigned vn_writegen;           /* Bumped on each change */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
@@ -132,6 +150,14 @@ struct vnode {
  *                      past EOF on files whose sizes are fixed may be
  *                      as well.)
  *
+ *    vop_poll        - Report which of EVENTS (POLLIN, POLLOUT; see
+ *                      kern/poll.h) could be done now without blocking,
+ *                      plus POLLERR or POLLHUP if applicable, in
+ *                      *REVENTS. If PE isn't NULL, also add it to the
+ *                      object's pollq so the poller hears about changes
+ *                      (see poll.h). Objects that never block can just
+ *                      report everything ready.
+ *
  *    vop_fsync       - Force any dirty buffers associated with this file
  *                      to stable storage.
  *
@@ -208,6 +234,8 @@ struct vnode_ops {
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	int (*vop_tryseek)(struct vnode *object, off_t pos);
+	int (*vop_poll)(struct vnode *object, int events,
+			struct pollentry *pe, int *revents);
 	int (*vop_fsync)(struct vnode *object);
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
@@ -253,6 +281,7 @@ struct vnode_ops {
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_TRYSEEK(vn, pos)            (__VOP(vn, tryseek)(vn, pos))
+#define VOP_POLL(vn, ev, pe, rev)       (__VOP(vn, poll)(vn, ev, pe, rev))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
@@ -295,6 +324,14 @@ void vnode_decopen(struct vnode *);
 #define VOP_INCOPEN(vn) 		vnode_incopen(vn)
 #define VOP_DECOPEN(vn) 		vnode_decopen(vn)
 
+/*
+ * Contents generation (see vn_writegen above). vnode_written is for
+ * filesystems to call when the file changes; vnode_writegen returns
+ * the current value.
+ */
+void vnode_written(struct vnode *);
+unsigned vnode_writegen(struct vnode *);
+
 /*
  * Vnode initialization (intended for use by filesystem code)
  * The reference count is initialized to 1.
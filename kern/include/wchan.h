@@ -36,6 +36,7 @@
 
 
 struct wchan; /* Opaque */
+struct thread; /* from <thread.h> */
 
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
@@ -81,5 +82,13 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Wake up a particular thread T, which the caller knows is sleeping
+ * on the wait channel. Unlike the above, the channel must already be
+ * locked (that's how the caller knows T is on it), and it remains
+ * locked on return.
+ */
+void wchan_wakethread(struct wchan *wc, struct thread *t);
+
 
 #endif /* _WCHAN_H_ */
@@ -36,6 +36,7 @@
 #include <current.h>
 #include <synch.h>
 #include <mainbus.h>
+#include <klog.h>
 #include <vfs.h>          // for vfs_sync()
 
 
@@ -87,38 +88,93 @@ console_send(void *junk, const char *data, size_t len)
 	}
 }
 
+/*
+ * Send characters to the kernel log, a record's worth at a time.
+ * Backend for __printf.
+ */
+struct kprintf_buf {
+	char kb_buf[KLOG_RECMAX];
+	size_t kb_len;
+};
+
+static
+void
+klog_send(void *vkb, const char *data, size_t len)
+{
+	struct kprintf_buf *kb = vkb;
+	size_t n;
+
+	while (len > 0) {
+		n = KLOG_RECMAX - kb->kb_len;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(kb->kb_buf + kb->kb_len, data, n);
+		kb->kb_len += n;
+		data += n;
+		len -= n;
+		if (kb->kb_len == KLOG_RECMAX) {
+			klog_put(kb->kb_buf, kb->kb_len);
+			kb->kb_len = 0;
+		}
+	}
+}
+
 /*
  * Printf to the console.
+ *
+ * Once there's a kernel log (see klog.h), this goes into the log,
+ * and unless the klog thread is running, we print the log ourselves
+ * before returning. Either way, what's printed and in what order is
+ * the same as printing directly.
  */
 int
 kprintf(const char *fmt, ...)
 {
 	int chars;
 	va_list ap;
-	bool dolock;
+	bool dolock, uselog, sync;
+	struct kprintf_buf kb;
+
+	uselog = klog_ready();
+	sync = !uselog || !klog_async();
 
 	dolock = kprintf_lock != NULL
 		&& curthread->t_in_interrupt == false
 		&& curthread->t_iplhigh_count == 0;
 
-	if (dolock) {
-		lock_acquire(kprintf_lock);
-	}
-	else {
-		spinlock_acquire(&kprintf_spinlock);
+	if (sync) {
+		if (dolock) {
+			lock_acquire(kprintf_lock);
+		}
+		else {
+			spinlock_acquire(&kprintf_spinlock);
+		}
+		putch_prepare();
 	}
-	putch_prepare();
 
 	va_start(ap, fmt);
-	chars = __vprintf(console_send, NULL, fmt, ap);
-	va_end(ap);
-
-	putch_complete();
-	if (dolock) {
-		lock_release(kprintf_lock);
+	if (uselog) {
+		kb.kb_len = 0;
+		chars = __vprintf(klog_send, &kb, fmt, ap);
+		klog_put(kb.kb_buf, kb.kb_len);
 	}
 	else {
-		spinlock_release(&kprintf_spinlock);
+		chars = __vprintf(console_send, NULL, fmt, ap);
+	}
+	va_end(ap);
+
+	if (sync) {
+		if (uselog) {
+			klog_flush();
+		}
+		putch_complete();
+		if (dolock) {
+			lock_release(kprintf_lock);
+		}
+		else {
+			spinlock_release(&kprintf_spinlock);
+		}
 	}
 
 	return chars;
@@ -169,7 +225,8 @@ panic(const char *fmt, ...)
 	if (evil == 2) {
 		evil = 3;
 
-		/* Print the message. */
+		/* Print the message, after whatever's still in the log. */
+		klog_panic();
 		kprintf("panic: ");
 		putch_prepare();
 		va_start(ap, fmt);
@@ -49,7 +49,11 @@
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <cpu.h>
+#include <spl.h>
+#include <limits.h>
 #include <kern/fcntl.h>  
+#include <filetable.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -72,18 +76,196 @@ struct semaphore *no_proc_sem;
 
 #if OPT_A2
 pid_t pids_n = 0;
-struct lock *pid_lock; 
-struct lock *ptable_lock;
-struct cv *ptable_cv;
-struct array *proc_table;
+struct spinlock pid_lock = SPINLOCK_INITIALIZER;
+static struct pt_entry **pt_chunks[DIVROUNDUP(PID_MAX + 1, PT_CHUNK)];
+/* only for putting a new chunk in pt_chunks */
+static struct spinlock pt_chunklock = SPINLOCK_INITIALIZER;
+
+/*
+ * Process table locks; see proc.h. Pids share them round robin, so
+ * unrelated forks, exits and waits mostly take different ones. Two
+ * are always taken in array order.
+ */
+#define PT_NLOCKS 32
+static struct lock *pt_locks[PT_NLOCKS];
+
+/*
+ * PID allocation.
+ *
+ * PIDs come from PID_MIN to PID_MAX. pid_bitmap has a bit set for
+ * each pid in use (or sitting in a cpu's cache, below); the bits
+ * outside the range are set permanently. Allocation is next-fit from
+ * pid_next, so a freed pid isn't handed out again until the rest of
+ * the range has been, and a pid that was just reaped won't turn up
+ * again while someone might still be about to waitpid on it.
+ *
+ * To keep fork off pid_lock, each cpu takes PID_CACHE pids at a time
+ * and hands them out with only interrupts off. Caches are only
+ * refilled while pids are plentiful, so when the range is nearly full
+ * a few of the remaining pids may be sitting in other cpus' caches.
+ */
+#define PID_NWORDS      DIVROUNDUP(PID_MAX + 1, 32)
+#define PID_RANGE       (PID_MAX - PID_MIN + 1)
+#define PID_CACHE       8
+#define PID_MAXCPUS     32
+
+static uint32_t pid_bitmap[PID_NWORDS];
+static pid_t pid_next = PID_MIN;
+
+struct pidcache {
+    unsigned first;     /* next pid to hand out */
+    unsigned num;       /* pids[first..num-1] are ours */
+    pid_t pids[PID_CACHE];
+};
+static struct pidcache pid_caches[PID_MAXCPUS];
+
+static void pid_bootstrap(void){
+    pid_t pid;
+
+    for (pid = 0; pid < PID_NWORDS * 32; pid++){
+        if (pid < PID_MIN || pid > PID_MAX){
+            pid_bitmap[pid / 32] |= 1U << (pid % 32);
+        }
+    }
+}
+
+/* find and claim the next free pid; call with pid_lock held */
+static pid_t pid_alloc(void){
+    pid_t pid = pid_next;
+
+    KASSERT(spinlock_do_i_hold(&pid_lock));
+    if (pids_n == PID_RANGE){
+        return 0;
+    }
+    while (1){
+        if (pid_bitmap[pid / 32] == 0xffffffff){
+            /* whole word in use, skip to the next one */
+            pid += 32 - pid % 32;
+        } else if ((pid_bitmap[pid / 32] & (1U << (pid % 32))) == 0){
+            break;
+        } else {
+            pid++;
+        }
+        if (pid > PID_MAX){
+            pid = PID_MIN;
+        }
+    }
+    pid_bitmap[pid / 32] |= 1U << (pid % 32);
+    pids_n++;
+    pid_next = pid == PID_MAX ? PID_MIN : pid + 1;
+    return pid;
+}
 
 pid_t genPID(void){
-   lock_acquire(pid_lock);
-   pid_t pid = ++pids_n;
-   lock_release(pid_lock);
+    struct pidcache *pc = NULL;
+    pid_t pid;
+    int spl;
+
+    /* interrupts off so we stay on this cpu while using its cache */
+    spl = splhigh();
+    if (CURCPU_EXISTS() && curcpu->c_number < PID_MAXCPUS){
+        pc = &pid_caches[curcpu->c_number];
+    }
+    if (pc != NULL && pc->first < pc->num){
+        pid = pc->pids[pc->first++];
+    } else {
+        spinlock_acquire(&pid_lock);
+        pid = pid_alloc();
+        if (pid != 0 && pc != NULL
+                && pids_n + PID_CACHE * PID_MAXCPUS < PID_RANGE){
+            pc->first = pc->num = 0;
+            while (pc->num < PID_CACHE){
+                pc->pids[pc->num++] = pid_alloc();
+            }
+        }
+        spinlock_release(&pid_lock);
+    }
+    splx(spl);
     return pid;
 }
 
+void freePID(pid_t pid){
+    KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+
+    spinlock_acquire(&pid_lock);
+    KASSERT(pid_bitmap[pid / 32] & (1U << (pid % 32)));
+    pid_bitmap[pid / 32] &= ~(1U << (pid % 32));
+    pids_n--;
+    spinlock_release(&pid_lock);
+}
+
+
+struct lock *pt_lock(pid_t pid){
+    KASSERT(pid >= 0);
+    return pt_locks[pid % PT_NLOCKS];
+}
+
+/* lock the table locks for A and B, which may be the same one */
+void pt_lock_pair(pid_t a, pid_t b){
+    struct lock *la = pt_lock(a), *lb = pt_lock(b);
+
+    if (la == lb){
+        lock_acquire(la);
+    } else if (a % PT_NLOCKS < b % PT_NLOCKS){
+        lock_acquire(la);
+        lock_acquire(lb);
+    } else {
+        lock_acquire(lb);
+        lock_acquire(la);
+    }
+}
+
+void pt_unlock_pair(pid_t a, pid_t b){
+    struct lock *la = pt_lock(a), *lb = pt_lock(b);
+
+    lock_release(la);
+    if (lb != la){
+        lock_release(lb);
+    }
+}
+
+/*
+ * Lock PID and its parent, and return the parent's pid; for an
+ * orphan, just lock PID and return PID_ORPHAN. The caller must be
+ * PID or its parent, so the entry can't go away meanwhile.
+ */
+pid_t pt_lock_withparent(pid_t pid){
+    struct pt_entry *entry;
+    pid_t ppid;
+
+    while (1){
+        lock_acquire(pt_lock(pid));
+        entry = get_ptable_entry(pid);
+        KASSERT(entry != NULL);
+        ppid = entry->parent_pid;
+        if (ppid == PID_ORPHAN || pt_lock(ppid) == pt_lock(pid)){
+            return ppid;
+        }
+        lock_release(pt_lock(pid));
+        pt_lock_pair(pid, ppid);
+        /* the parent may have exited and orphaned us in between */
+        if (entry->parent_pid == ppid){
+            return ppid;
+        }
+        pt_unlock_pair(pid, ppid);
+    }
+}
+
+void pt_unlock_withparent(pid_t pid, pid_t ppid){
+    if (ppid == PID_ORPHAN){
+        lock_release(pt_lock(pid));
+    } else {
+        pt_unlock_pair(pid, ppid);
+    }
+}
+
+/* take PID out of the table, with whatever locks that needs */
+void pt_discard(pid_t pid){
+    pid_t ppid = pt_lock_withparent(pid);
+
+    remove_pt_entry(pid);
+    pt_unlock_withparent(pid, ppid);
+}
 
 struct pt_entry *pt_create_entry(pid_t pid){
     struct pt_entry *entry = kmalloc(sizeof(struct pt_entry));
@@ -94,49 +276,184 @@ struct pt_entry *pt_create_entry(pid_t pid){
     entry->parent_pid = PID_ORPHAN;
     entry->status = S_RUN;
     entry->exit_status = -1;
+    entry->child_exit_cv = cv_create("child exit");
+    if (entry->child_exit_cv == NULL){
+        panic("create_pt_entry failed to create child_exit_cv!\n");
+    }
+    entry->vfork_borrowing = false;
+    entry->runtime = 0;
+    entry->nvcsw = 0;
+    entry->nivcsw = 0;
+    entry->children = NULL;
+    entry->sibling_next = NULL;
+    entry->sibling_pprev = NULL;
+    entry->zombies = NULL;
+    entry->zombies_tail = &entry->zombies;
+    entry->zombie_next = NULL;
+    entry->zombie_pprev = NULL;
     return entry;
-    // should set exit status?
 }
 
 void add_pt_entry(pid_t pid){
-    struct pt_entry *entry = pt_create_entry(pid);
-    array_add(proc_table, entry, NULL);
+    struct pt_entry **chunk;
+
+    KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+    KASSERT(lock_do_i_hold(pt_lock(pid)));
+    if (pt_chunks[pid / PT_CHUNK] == NULL){
+        /* other pids in the chunk have other locks, so race for it */
+        chunk = kmalloc(PT_CHUNK * sizeof(struct pt_entry *));
+        if (chunk == NULL){
+            panic("add_pt_entry failed to allocate memory!\n");
+        }
+        for (unsigned i = 0; i < PT_CHUNK; i++){
+            chunk[i] = NULL;
+        }
+        spinlock_acquire(&pt_chunklock);
+        if (pt_chunks[pid / PT_CHUNK] == NULL){
+            pt_chunks[pid / PT_CHUNK] = chunk;
+            chunk = NULL;
+        }
+        spinlock_release(&pt_chunklock);
+        if (chunk != NULL){
+            kfree(chunk);
+        }
+    }
+    chunk = pt_chunks[pid / PT_CHUNK];
+    KASSERT(chunk[pid % PT_CHUNK] == NULL);
+    chunk[pid % PT_CHUNK] = pt_create_entry(pid);
+}
+
+/*
+ * make CHILD_PID a child of PARENT_PID; both must be in the table,
+ * and locked with pt_lock_pair
+ */
+void add_pt_child(pid_t parent_pid, pid_t child_pid){
+    struct pt_entry *parent = get_ptable_entry(parent_pid);
+    struct pt_entry *child = get_ptable_entry(child_pid);
+
+    KASSERT(parent != NULL && child != NULL);
+    KASSERT(child->parent_pid == PID_ORPHAN);
+    KASSERT(child->sibling_pprev == NULL);
+    child->parent_pid = parent_pid;
+    child->sibling_next = parent->children;
+    if (parent->children != NULL){
+        parent->children->sibling_pprev = &child->sibling_next;
+    }
+    parent->children = child;
+    child->sibling_pprev = &parent->children;
+}
+
+static void unlink_pt_child(struct pt_entry *child){
+    if (child->sibling_pprev == NULL){
+        return;
+    }
+    *child->sibling_pprev = child->sibling_next;
+    if (child->sibling_next != NULL){
+        child->sibling_next->sibling_pprev = child->sibling_pprev;
+    }
+    child->sibling_next = NULL;
+    child->sibling_pprev = NULL;
+}
+
+/* PID has exited: queue it for its parent's waitpid; both locked */
+void add_pt_zombie(pid_t pid){
+    struct pt_entry *child = get_ptable_entry(pid);
+    struct pt_entry *parent;
+
+    KASSERT(child != NULL && child->status == S_ZOMBIE);
+    KASSERT(child->zombie_pprev == NULL);
+    parent = get_ptable_entry(child->parent_pid);
+    KASSERT(parent != NULL);
+    child->zombie_next = NULL;
+    child->zombie_pprev = parent->zombies_tail;
+    *parent->zombies_tail = child;
+    parent->zombies_tail = &child->zombie_next;
+}
+
+static void unlink_pt_zombie(struct pt_entry *child){
+    struct pt_entry *parent;
+
+    if (child->zombie_pprev == NULL){
+        return;
+    }
+    parent = get_ptable_entry(child->parent_pid);
+    KASSERT(parent != NULL);
+    *child->zombie_pprev = child->zombie_next;
+    if (child->zombie_next != NULL){
+        child->zombie_next->zombie_pprev = child->zombie_pprev;
+    } else {
+        parent->zombies_tail = child->zombie_pprev;
+    }
+    child->zombie_next = NULL;
+    child->zombie_pprev = NULL;
 }
 
+/*
+ * the entry's children must have been dealt with (update_pt_children),
+ * and it must be locked along with its parent, if any (pt_discard does
+ * that); this also frees the pid
+ */
 void remove_pt_entry(pid_t pid){
-    for (unsigned int i = 0; i < array_num(proc_table); i++){
-        struct pt_entry *entry = array_get(proc_table, i);
-        if (entry->pid == pid){
-            kfree(entry);
-            array_remove(proc_table, i);
-        }
+    struct pt_entry *entry = get_ptable_entry(pid);
+
+    if (entry == NULL){
+        return;
     }
+    KASSERT(entry->children == NULL);
+    KASSERT(entry->parent_pid == PID_ORPHAN ||
+            lock_do_i_hold(pt_lock(entry->parent_pid)));
+    pt_chunks[pid / PT_CHUNK][pid % PT_CHUNK] = NULL;
+    unlink_pt_zombie(entry);
+    unlink_pt_child(entry);
+    cv_destroy(entry->child_exit_cv);
+    kfree(entry);
+    freePID(pid);
 }
 
 
 struct pt_entry *get_ptable_entry(pid_t pid){
-    for (unsigned int i = 0; i < array_num(proc_table); i++){
-        struct pt_entry *entry = array_get(proc_table, i);
-        if (entry->pid == pid){
-           return entry; 
-        }
+    struct pt_entry **chunk;
+
+    if (pid < PID_MIN || pid > PID_MAX){
+        return NULL;
+    }
+    KASSERT(lock_do_i_hold(pt_lock(pid)));
+    chunk = pt_chunks[pid / PT_CHUNK];
+    if (chunk == NULL){
+        // never existed
+        return NULL;
     }
-    // process exited
-    return NULL;
+    // NULL if the process exited
+    return chunk[pid % PT_CHUNK];
 }
 
+/*
+ * PID is exiting: reap its zombie children and orphan the rest. Call
+ * without any table locks held.
+ */
 void update_pt_children(pid_t pid){
-    for (unsigned int i = 0; i < array_num(proc_table); i++){
-        struct pt_entry *entry = array_get(proc_table, i);
-        if (entry->parent_pid == pid 
-                && entry->status == S_ZOMBIE){
-            pid_t *child_pid = kmalloc(sizeof(pid_t));
-            *child_pid = entry->pid;
-            remove_pt_entry(*child_pid);
-        } else if (entry->parent_pid == pid) {
-            entry->parent_pid = PID_ORPHAN;
+    struct pt_entry *parent, *child;
+    pid_t cpid;
+
+    lock_acquire(pt_lock(pid));
+    parent = get_ptable_entry(pid);
+    KASSERT(parent != NULL);
+    while ((child = parent->children) != NULL){
+        /* only we take our children off the list, so it stays put */
+        cpid = child->pid;
+        lock_release(pt_lock(pid));
+        pt_lock_pair(pid, cpid);
+        unlink_pt_child(child);
+        if (child->status == S_ZOMBIE){
+            remove_pt_entry(cpid);
+        } else {
+            child->parent_pid = PID_ORPHAN;
         }
+        pt_unlock_pair(pid, cpid);
+        lock_acquire(pt_lock(pid));
     }
+    lock_release(pt_lock(pid));
+    KASSERT(parent->zombies == NULL);
 }
 
 
@@ -175,6 +492,14 @@ proc_create(const char *name)
 	proc->console = NULL;
 #endif // UW
 
+#if OPT_A2
+	proc->p_child_runtime = 0;
+	proc->p_child_nvcsw = 0;
+	proc->p_child_nivcsw = 0;
+	proc->p_vforked = false;
+	proc->p_filetable = NULL;
+#endif /* OPT_A2 */
+
 	return proc;
 }
 
@@ -234,6 +559,12 @@ proc_destroy(struct proc *proc)
 	  vfs_close(proc->console);
 	}
 #endif // UW
+#if OPT_A2
+	if (proc->p_filetable) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
+	}
+#endif /* OPT_A2 */
 
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
@@ -281,18 +612,13 @@ proc_bootstrap(void)
   }
 #endif // UW 
 #if OPT_A2
-  pid_lock = lock_create("pid lock");
-  if (pid_lock == NULL) panic("coud not ceate pid_lock\n");
-
-  ptable_lock = lock_create("process table lock");
-  if (ptable_lock == NULL) panic("could not create ptable_lock\n");
-
-  ptable_cv = cv_create("process table condition variable");
-  if (ptable_cv == NULL) panic("could not create ptable_cv\n");
+  pid_bootstrap();
 
+  for (int i = 0; i < PT_NLOCKS; i++){
+    pt_locks[i] = lock_create("process table lock");
+    if (pt_locks[i] == NULL) panic("could not create pt_locks\n");
+  }
 
-  proc_table = array_create();
-  array_init(proc_table);
 
 #endif /* OPT_A2 */
 }
@@ -307,14 +633,16 @@ struct proc *
 proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
+#if defined(UW) && !OPT_A2
 	char *console_path;
+#endif
 
 	proc = proc_create(name);
 	if (proc == NULL) {
 		return NULL;
 	}
 
-#ifdef UW
+#if defined(UW) && !OPT_A2
 	/* open the console - this should always succeed */
 	console_path = kstrdup("con:");
 	if (console_path == NULL) {
@@ -324,7 +652,7 @@ proc_create_runprogram(const char *name)
 	  panic("unable to open the console during process creation\n");
 	}
 	kfree(console_path);
-#endif // UW
+#endif // UW && !OPT_A2
 	  
 	/* VM fields */
 
@@ -359,11 +687,32 @@ proc_create_runprogram(const char *name)
 #endif // UW
     
 #if OPT_A2
+    /*
+     * Processes started from the menu get the console on stdin,
+     * stdout and stderr; fork, vfork and spawn children inherit
+     * their parent's descriptors.
+     */
+    if (curproc == kproc) {
+        proc->p_filetable = filetable_create();
+        if (proc->p_filetable == NULL ||
+            filetable_stdio(proc->p_filetable) != 0) {
+            proc_destroy(proc);
+            return NULL;
+        }
+    } else if (filetable_copy(curproc->p_filetable, &proc->p_filetable)) {
+        proc_destroy(proc);
+        return NULL;
+    }
+
     proc->pid = genPID();
+    if (proc->pid == 0){
+        proc_destroy(proc);
+        return NULL;
+    }
 
-    lock_acquire(ptable_lock);
+    lock_acquire(pt_lock(proc->pid));
     add_pt_entry(proc->pid);
-    lock_release(ptable_lock);
+    lock_release(pt_lock(proc->pid));
 
 #endif /* OPT_A2 */
 
@@ -45,6 +45,10 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
+#include <execcache.h>
+#include <poll.h>
+#include <kshared.h>
+#include <klog.h>
 #include <device.h>
 #include <syscall.h>
 #include <test.h>
@@ -111,6 +115,8 @@ boot(void)
 	thread_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	poll_bootstrap();
+	execcache_bootstrap();
 
 	/* Probe and initialize devices. Interrupts should come on. */
 	kprintf("Device probe...\n");
@@ -123,7 +129,9 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	kshared_bootstrap();
 	kprintf_bootstrap();
+	klog_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -145,6 +153,7 @@ void
 shutdown(void)
 {
 
+	klog_sync();
 	kprintf("Shutting down.\n");
 	
 	vfs_clearbootfs();
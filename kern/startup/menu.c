@@ -42,6 +42,10 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <syscallstat.h>
+#include <execcache.h>
+#include <klog.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -405,6 +409,140 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+#if OPT_SFS
+/*
+ * Command for SFS buffer cache stats.
+ */
+static
+int
+cmd_bufstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		sfs_bufresetstats();
+		return 0;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: bc [reset]\n");
+		return EINVAL;
+	}
+
+	sfs_bufprintstats();
+
+	return 0;
+}
+#endif
+
+/*
+ * Command for printing the kernel log.
+ */
+static
+int
+cmd_dmesg(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	klog_dump();
+
+	return 0;
+}
+
+/*
+ * Command for printing exec image cache stats.
+ */
+static
+int
+cmd_execstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	execcache_printstats();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for the lock contention profiler.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+		return 0;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: lockstat [reset]\n");
+		return EINVAL;
+	}
+
+	lockstat_report();
+
+	return 0;
+}
+#endif
+
+#if OPT_SYSCALLSTAT
+/*
+ * Command for the system call profiler.
+ */
+static
+int
+cmd_sysstat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		syscallstat_reset();
+		return 0;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: sysstat [reset]\n");
+		return EINVAL;
+	}
+
+	syscallstat_report();
+
+	return 0;
+}
+#endif
+
+/*
+ * Command for showing and tuning cpu placement of threads.
+ */
+static
+int
+cmd_sched(int nargs, char **args)
+{
+	if (nargs == 3 && !strcmp(args[1], "migcost")) {
+		thread_migration_cost = (uint64_t)atoi(args[2]) * 1000;
+	}
+	else if (nargs == 3 && !strcmp(args[1], "affine")) {
+		thread_wake_affine = atoi(args[2]) != 0;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: sched [migcost usecs | affine 0|1]\n");
+		return EINVAL;
+	}
+
+	thread_printmigration();
+
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -475,6 +613,9 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[lkb] Lock benchmark        (1)     ",
+	"[rw1] Rwlock test                   ",
+	"[rwb] Rwlock reader benchmark       ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -515,6 +656,19 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ps] Thread scheduling stats        ",
+	"[sched] Cpu placement settings      ",
+	"[ec] Exec image cache stats         ",
+#if OPT_SFS
+	"[bc] SFS buffer cache stats [reset] ",
+#endif
+	"[dmesg] Kernel log                  ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention [reset]  ",
+#endif
+#if OPT_SYSCALLSTAT
+	"[sysstat] Syscall times [reset]     ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -572,6 +726,19 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ec",		cmd_execstats },
+#if OPT_SFS
+	{ "bc",		cmd_bufstats },
+#endif
+	{ "dmesg",	cmd_dmesg },
+	{ "ps",		cmd_ps },
+	{ "sched",	cmd_sched },
+#if OPT_LOCKSTAT
+	{ "lockstat",	cmd_lockstat },
+#endif
+#if OPT_SYSCALLSTAT
+	{ "sysstat",	cmd_sysstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -589,6 +756,9 @@ static struct {
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "lkb",	lockbench },
+	{ "rw1",	rwtest },
+	{ "rwb",	rwbench },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
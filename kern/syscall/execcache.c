@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Exec image cache. See execcache.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vm.h>
+#include <execcache.h>
+
+/* most images to keep */
+#define EXECCACHE_SIZE  8
+
+static struct lock *execcache_lock;
+static struct exec_image *execcache_head;	/* most recently used first */
+static unsigned execcache_count;
+
+static unsigned long execcache_hits;
+static unsigned long execcache_misses;
+static unsigned long execcache_evictions;
+
+void
+execcache_bootstrap(void)
+{
+	execcache_lock = lock_create("execcache");
+	if (execcache_lock == NULL) {
+		panic("execcache_bootstrap: Out of memory\n");
+	}
+	execcache_head = NULL;
+	execcache_count = 0;
+}
+
+/*
+ * Take IMG off the cache list. The list's reference becomes the
+ * caller's to drop (after releasing the lock).
+ */
+static
+void
+execcache_unlink(struct exec_image *img)
+{
+	struct exec_image **pp;
+
+	KASSERT(lock_do_i_hold(execcache_lock));
+	KASSERT(img->ei_cached);
+
+	for (pp = &execcache_head; *pp != img; pp = &(*pp)->ei_next) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = img->ei_next;
+	img->ei_next = NULL;
+	img->ei_cached = false;
+	execcache_count--;
+}
+
+static
+struct exec_image *
+execcache_find(struct vnode *v)
+{
+	struct exec_image *img;
+
+	KASSERT(lock_do_i_hold(execcache_lock));
+	for (img = execcache_head; img != NULL; img = img->ei_next) {
+		if (img->ei_vnode == v) {
+			return img;
+		}
+	}
+	return NULL;
+}
+
+struct exec_image *
+execcache_get(struct vnode *v, bool *hit)
+{
+	struct exec_image *img, *stale = NULL;
+	struct stat st;
+	unsigned gen;
+	int result;
+
+	/* before reading anything, so a write meanwhile invalidates us */
+	gen = vnode_writegen(v);
+
+	/* file systems that don't keep mtimes leave it zero */
+	bzero(&st, sizeof(st));
+	result = VOP_STAT(v, &st);
+	if (result) {
+		return NULL;
+	}
+
+	lock_acquire(execcache_lock);
+	img = execcache_find(v);
+	if (img != NULL) {
+		if (img->ei_writegen == gen &&
+		    img->ei_size == st.st_size &&
+		    img->ei_mtime == st.st_mtime &&
+		    img->ei_mtimensec == st.st_mtimensec) {
+			/* move it to the front */
+			execcache_unlink(img);
+			img->ei_next = execcache_head;
+			img->ei_cached = true;
+			execcache_head = img;
+			execcache_count++;
+
+			img->ei_refcount++;
+			execcache_hits++;
+			lock_release(execcache_lock);
+			*hit = true;
+			return img;
+		}
+		/* the file has changed since; forget it */
+		execcache_unlink(img);
+		stale = img;
+	}
+	execcache_misses++;
+	lock_release(execcache_lock);
+
+	if (stale != NULL) {
+		execcache_release(stale);
+	}
+
+	img = kmalloc(sizeof(*img));
+	if (img == NULL) {
+		return NULL;
+	}
+	VOP_INCREF(v);
+	img->ei_vnode = v;
+	img->ei_writegen = gen;
+	img->ei_size = st.st_size;
+	img->ei_mtime = st.st_mtime;
+	img->ei_mtimensec = st.st_mtimensec;
+	img->ei_entry = 0;
+	img->ei_nsegs = 0;
+	img->ei_textpbase = 0;
+	img->ei_textnpages = 0;
+	img->ei_refcount = 1;
+	img->ei_cached = false;
+	img->ei_next = NULL;
+
+	*hit = false;
+	return img;
+}
+
+void
+execcache_enter(struct exec_image *img)
+{
+	struct exec_image *old, *victim = NULL;
+
+	lock_acquire(execcache_lock);
+	KASSERT(!img->ei_cached);
+
+	/* someone else may have loaded the same file meanwhile */
+	old = execcache_find(img->ei_vnode);
+	if (old != NULL) {
+		execcache_unlink(old);
+	}
+	else if (execcache_count == EXECCACHE_SIZE) {
+		/* evict the least recently used */
+		for (victim = execcache_head; victim->ei_next != NULL;
+		     victim = victim->ei_next) {
+			/* nothing */
+		}
+		execcache_unlink(victim);
+		execcache_evictions++;
+	}
+
+	img->ei_refcount++;
+	img->ei_cached = true;
+	img->ei_next = execcache_head;
+	execcache_head = img;
+	execcache_count++;
+	lock_release(execcache_lock);
+
+	if (old != NULL) {
+		execcache_release(old);
+	}
+	if (victim != NULL) {
+		execcache_release(victim);
+	}
+}
+
+void
+execcache_hold(struct exec_image *img)
+{
+	lock_acquire(execcache_lock);
+	KASSERT(img->ei_refcount > 0);
+	img->ei_refcount++;
+	lock_release(execcache_lock);
+}
+
+void
+execcache_release(struct exec_image *img)
+{
+	bool dead;
+
+	lock_acquire(execcache_lock);
+	KASSERT(img->ei_refcount > 0);
+	img->ei_refcount--;
+	dead = img->ei_refcount == 0;
+	lock_release(execcache_lock);
+
+	if (!dead) {
+		return;
+	}
+	KASSERT(!img->ei_cached);
+	if (img->ei_textnpages > 0) {
+		free_kpages(PADDR_TO_KVADDR(img->ei_textpbase));
+	}
+	VOP_DECREF(img->ei_vnode);
+	kfree(img);
+}
+
+/*
+ * Drop every cached image of a file on FS. Images still mapped by
+ * some process keep their references (and so keep FS busy) until
+ * that process lets go.
+ */
+void
+execcache_flushfs(struct fs *fs)
+{
+	struct exec_image *img, *next, *dead = NULL;
+
+	lock_acquire(execcache_lock);
+	for (img = execcache_head; img != NULL; img = next) {
+		next = img->ei_next;
+		if (img->ei_vnode->vn_fs == fs) {
+			execcache_unlink(img);
+			img->ei_next = dead;
+			dead = img;
+		}
+	}
+	lock_release(execcache_lock);
+
+	/* dropping the vnodes may reclaim them, so not with the lock */
+	while (dead != NULL) {
+		img = dead;
+		dead = img->ei_next;
+		img->ei_next = NULL;
+		execcache_release(img);
+	}
+}
+
+void
+execcache_printstats(void)
+{
+	struct exec_image *img;
+	size_t textpages = 0;
+
+	lock_acquire(execcache_lock);
+	for (img = execcache_head; img != NULL; img = img->ei_next) {
+		textpages += img->ei_textnpages;
+	}
+	kprintf("execcache: %u images, %lu text pages\n",
+		execcache_count, (unsigned long) textpages);
+	kprintf("execcache: %lu hits, %lu misses, %lu evictions\n",
+		execcache_hits, execcache_misses, execcache_evictions);
+	lock_release(execcache_lock);
+}
@@ -1,60 +1,858 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/poll.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
+#include <kern/submit.h>
+#include <kern/time.h>
 #include <kern/unistd.h>
 #include <lib.h>
 #include <uio.h>
+#include <synch.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include <copyinout.h>
+#include <filetable.h>
+#include <pipe.h>
+#include <poll.h>
+#include <clock.h>
+#include <lamebus/ltimer.h>
+#include <limits.h>
+#include <vm.h>
 
-/* handler for write() system call                  */
 /*
- * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
- *
- * You will need to improve this implementation
+ * File system calls. Descriptors are looked up in the current
+ * process's file table (see filetable.h); the lookup takes a
+ * reference to the open file, which we drop when we're done with it.
  */
 
+/* handler for open() system call                   */
 int
-sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
 {
-  struct iovec iov;
+  struct openfile *file;
+  char *path;
+  int fd, res;
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  res = copyinstr(upath, path, PATH_MAX, NULL);
+  if (res) {
+    kfree(path);
+    return res;
+  }
+
+  res = openfile_open(path, flags, mode, &file);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+
+  res = filetable_place(curproc->p_filetable, file, &fd);
+  if (res) {
+    openfile_decref(file);
+    return res;
+  }
+  *retval = fd;
+  return 0;
+}
+
+/* handler for close() system call                  */
+int
+sys_close(int fdesc)
+{
+  return filetable_close(curproc->p_filetable, fdesc);
+}
+
+/*
+ * Common code for the read and write calls: move LEN bytes between
+ * the user buffers in IOV and the file open on FDESC. POS is where in
+ * the file to do it, or -1 for the file's own offset, which is then
+ * advanced.
+ *
+ * The open file's lock is only held when using its offset on a
+ * seekable object. Positional I/O doesn't touch the offset at all,
+ * and there's no offset to protect on the console and the like;
+ * holding the lock while a read blocks for input would hold up
+ * writers.
+ */
+static
+int
+file_io(int fdesc, struct iovec *iov, unsigned iovcnt, size_t len,
+	off_t pos, enum uio_rw rw, int *retval)
+{
+  struct openfile *file;
   struct uio u;
+  struct stat st;
+  bool seekable, useoffset;
   int res;
 
-  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
+  res = filetable_get(curproc->p_filetable, fdesc, &file);
+  if (res) {
+    return res;
+  }
+  if ((rw == UIO_READ && file->of_accmode == O_WRONLY) ||
+      (rw == UIO_WRITE && file->of_accmode == O_RDONLY)) {
+    openfile_decref(file);
+    return EBADF;
   }
-  KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
-  KASSERT(curproc->p_addrspace != NULL);
 
-  /* set up a uio structure to refer to the user program's buffer (ubuf) */
-  iov.iov_ubase = ubuf;
-  iov.iov_len = nbytes;
-  u.uio_iov = &iov;
-  u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
-  u.uio_resid = nbytes;
+  seekable = VOP_TRYSEEK(file->of_vnode, 0) == 0;
+  useoffset = seekable && pos == -1;
+  if (pos != -1) {
+    res = seekable ? VOP_TRYSEEK(file->of_vnode, pos) : ESPIPE;
+    if (res) {
+      openfile_decref(file);
+      return res;
+    }
+  }
+
+  /* set up a uio structure to refer to the user program's buffers */
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_offset = pos == -1 ? 0 : pos;
+  u.uio_resid = len;
   u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
+  u.uio_rw = rw;
   u.uio_space = curproc->p_addrspace;
 
-  res = VOP_WRITE(curproc->console,&u);
+  if (useoffset) {
+    lock_acquire(file->of_lock);
+    if (rw == UIO_WRITE && file->of_append) {
+      res = VOP_STAT(file->of_vnode, &st);
+      if (res) {
+        lock_release(file->of_lock);
+        openfile_decref(file);
+        return res;
+      }
+      file->of_offset = st.st_size;
+    }
+    u.uio_offset = file->of_offset;
+  }
+
+  if (rw == UIO_READ) {
+    res = VOP_READ(file->of_vnode, &u);
+  } else {
+    res = VOP_WRITE(file->of_vnode, &u);
+  }
+
+  if (useoffset) {
+    /* count whatever got moved, even on error */
+    file->of_offset = u.uio_offset;
+    lock_release(file->of_lock);
+  }
+  openfile_decref(file);
+
   if (res) {
     return res;
   }
 
-  /* pass back the number of bytes actually written */
-  *retval = nbytes - u.uio_resid;
+  /* pass back the number of bytes actually moved */
+  *retval = len - u.uio_resid;
   KASSERT(*retval >= 0);
   return 0;
 }
+
+/*
+ * read/write, and pread/pwrite at POS: one user buffer.
+ */
+static
+int
+file_io1(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos,
+	 enum uio_rw rw, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_io(fdesc, &iov, 1, nbytes, pos, rw, retval);
+}
+
+/* iovecs readv/writev can take without a kmalloc */
+#define FASTIOV 8
+
+/*
+ * readv/writev: copy in the user's iovec array and hand it down as
+ * is, so the data moves straight between the file and the user's
+ * buffers.
+ */
+static
+int
+file_iov(int fdesc, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	 int *retval)
+{
+  struct iovec fastiov[FASTIOV];
+  struct iovec *iov;
+  size_t len;
+  int i, res;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+  if (iovcnt <= FASTIOV) {
+    iov = fastiov;
+  } else {
+    iov = kmalloc(iovcnt * sizeof(struct iovec));
+    if (iov == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  res = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+  if (res) {
+    goto out;
+  }
+
+  /* the total has to fit in the return value */
+  len = 0;
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len > 0x7fffffff - len) {
+      res = EINVAL;
+      goto out;
+    }
+    len += iov[i].iov_len;
+  }
+
+  res = file_io(fdesc, iov, iovcnt, len, -1, rw, retval);
+
+ out:
+  if (iov != fastiov) {
+    kfree(iov);
+  }
+  return res;
+}
+
+/* handler for read() system call                   */
+int
+sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+  return file_io1(fdesc, ubuf, nbytes, -1, UIO_READ, retval);
+}
+
+/* handler for write() system call                  */
+int
+sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+  return file_io1(fdesc, ubuf, nbytes, -1, UIO_WRITE, retval);
+}
+
+/* handler for pread() system call                  */
+int
+sys_pread(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+	  int *retval)
+{
+  if (pos < 0) {
+    return EINVAL;
+  }
+  return file_io1(fdesc, ubuf, nbytes, pos, UIO_READ, retval);
+}
+
+/* handler for pwrite() system call                 */
+int
+sys_pwrite(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+	   int *retval)
+{
+  if (pos < 0) {
+    return EINVAL;
+  }
+  return file_io1(fdesc, ubuf, nbytes, pos, UIO_WRITE, retval);
+}
+
+/* handler for readv() system call                  */
+int
+sys_readv(int fdesc, const_userptr_t uiov, int iovcnt, int *retval)
+{
+  return file_iov(fdesc, uiov, iovcnt, UIO_READ, retval);
+}
+
+/* handler for writev() system call                 */
+int
+sys_writev(int fdesc, const_userptr_t uiov, int iovcnt, int *retval)
+{
+  return file_iov(fdesc, uiov, iovcnt, UIO_WRITE, retval);
+}
+
+/* handler for lseek() system call                  */
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *file;
+  struct stat st;
+  off_t newpos;
+  int res;
+
+  res = filetable_get(curproc->p_filetable, fdesc, &file);
+  if (res) {
+    return res;
+  }
+  /* devices without blocks say ESPIPE */
+  res = VOP_TRYSEEK(file->of_vnode, 0);
+  if (res) {
+    openfile_decref(file);
+    return res;
+  }
+
+  lock_acquire(file->of_lock);
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = file->of_offset + pos;
+    break;
+  case SEEK_END:
+    res = VOP_STAT(file->of_vnode, &st);
+    if (res) {
+      goto out;
+    }
+    newpos = st.st_size + pos;
+    break;
+  default:
+    res = EINVAL;
+    goto out;
+  }
+  res = VOP_TRYSEEK(file->of_vnode, newpos);
+  if (res) {
+    goto out;
+  }
+  file->of_offset = newpos;
+  *retval = newpos;
+
+ out:
+  lock_release(file->of_lock);
+  openfile_decref(file);
+  return res;
+}
+
+/* handler for dup2() system call                   */
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  int res;
+
+  res = filetable_dup2(curproc->p_filetable, oldfd, newfd);
+  if (res) {
+    return res;
+  }
+  *retval = newfd;
+  return 0;
+}
+
+/* handler for pipe() system call                   */
+int
+sys_pipe(userptr_t ufds, int *retval)
+{
+  struct vnode *rvn, *wvn;
+  struct openfile *rfile, *wfile;
+  int fds[2];
+  int res;
+
+  res = pipe_create(&rvn, &wvn);
+  if (res) {
+    return res;
+  }
+  res = openfile_create(rvn, O_RDONLY, &rfile);
+  if (res) {
+    vfs_close(rvn);
+    vfs_close(wvn);
+    return res;
+  }
+  res = openfile_create(wvn, O_WRONLY, &wfile);
+  if (res) {
+    openfile_decref(rfile);
+    vfs_close(wvn);
+    return res;
+  }
+
+  res = filetable_place(curproc->p_filetable, rfile, &fds[0]);
+  if (res) {
+    openfile_decref(rfile);
+    openfile_decref(wfile);
+    return res;
+  }
+  res = filetable_place(curproc->p_filetable, wfile, &fds[1]);
+  if (res) {
+    filetable_close(curproc->p_filetable, fds[0]);
+    openfile_decref(wfile);
+    return res;
+  }
+
+  res = copyout(fds, ufds, sizeof(fds));
+  if (res) {
+    filetable_close(curproc->p_filetable, fds[0]);
+    filetable_close(curproc->p_filetable, fds[1]);
+    return res;
+  }
+  *retval = 0;
+  return 0;
+}
+
+/* bytes copy_file_range moves at a time: a whole number of blocks */
+#define COPY_CHUNK PAGE_SIZE
+
+/*
+ * handler for copy_file_range() system call: copy up to LEN bytes
+ * from INFD to OUTFD, at and advancing their offsets, without the data
+ * going through user space. One kernel buffer is reused for each
+ * chunk.
+ *
+ * If the write side comes up short or fails, the read side's offset
+ * only moves past what was written; on something that can't seek,
+ * like a pipe, the rest of that chunk is lost. Returns the number of
+ * bytes copied, or the error if nothing was.
+ */
+int
+sys_copy_file_range(int infd, int outfd, size_t len, int *retval)
+{
+  struct openfile *in, *out;
+  struct lock *locks[2];
+  struct iovec iov;
+  struct uio u;
+  struct stat st;
+  bool inseek, outseek;
+  int i;
+  size_t total = 0, chunk, got, put;
+  char *buf;
+  int res;
+
+  if (len > 0x7fffffff) {
+    len = 0x7fffffff;
+  }
+  res = filetable_get(curproc->p_filetable, infd, &in);
+  if (res) {
+    return res;
+  }
+  res = filetable_get(curproc->p_filetable, outfd, &out);
+  if (res) {
+    openfile_decref(in);
+    return res;
+  }
+  if (in->of_accmode == O_WRONLY || out->of_accmode == O_RDONLY) {
+    res = EBADF;
+    goto fail;
+  }
+  if (in->of_vnode == out->of_vnode) {
+    /* the offsets would chase each other */
+    res = EINVAL;
+    goto fail;
+  }
+  buf = kmalloc(COPY_CHUNK);
+  if (buf == NULL) {
+    res = ENOMEM;
+    goto fail;
+  }
+
+  /* as in file_io, the offsets are only locked when they matter */
+  inseek = VOP_TRYSEEK(in->of_vnode, 0) == 0;
+  outseek = VOP_TRYSEEK(out->of_vnode, 0) == 0;
+  locks[0] = inseek ? in->of_lock : NULL;
+  locks[1] = outseek ? out->of_lock : NULL;
+  /* and always take two in the same order */
+  if (locks[0] != NULL && locks[1] != NULL && locks[0] > locks[1]) {
+    locks[0] = out->of_lock;
+    locks[1] = in->of_lock;
+  }
+  for (i = 0; i < 2; i++) {
+    if (locks[i] != NULL) {
+      lock_acquire(locks[i]);
+    }
+  }
+  if (outseek && out->of_append) {
+    res = VOP_STAT(out->of_vnode, &st);
+    if (res) {
+      goto out;
+    }
+    out->of_offset = st.st_size;
+  }
+
+  while (total < len) {
+    chunk = len - total < COPY_CHUNK ? len - total : COPY_CHUNK;
+    uio_kinit(&iov, &u, buf, chunk, inseek ? in->of_offset : 0, UIO_READ);
+    res = VOP_READ(in->of_vnode, &u);
+    got = chunk - u.uio_resid;
+    if (res || got == 0) {
+      break;
+    }
+
+    uio_kinit(&iov, &u, buf, got, outseek ? out->of_offset : 0, UIO_WRITE);
+    res = VOP_WRITE(out->of_vnode, &u);
+    put = got - u.uio_resid;
+    if (inseek) {
+      in->of_offset += put;
+    }
+    if (outseek) {
+      out->of_offset += put;
+    }
+    total += put;
+    if (res || put < got) {
+      break;
+    }
+  }
+  if (total > 0) {
+    /* report what got done; the error will turn up again next time */
+    res = 0;
+  }
+
+ out:
+  for (i = 1; i >= 0; i--) {
+    if (locks[i] != NULL) {
+      lock_release(locks[i]);
+    }
+  }
+  kfree(buf);
+  openfile_decref(out);
+  openfile_decref(in);
+  if (res) {
+    return res;
+  }
+  *retval = total;
+  return 0;
+
+ fail:
+  openfile_decref(out);
+  openfile_decref(in);
+  return res;
+}
+
+/*
+ * handler for submit() system call: run up to COUNT of the requests
+ * queued in the user's submit_ring (see <kern/submit.h>), one after
+ * the other, as if by read, write, pread or pwrite, without a trap
+ * for each.
+ */
+int
+sys_submit(userptr_t uring, unsigned count, int *retval)
+{
+  struct submit_ring *ring = (struct submit_ring *)uring;
+  struct submit_sqe sqe;
+  struct submit_cqe cqe;
+  uint32_t sqhead, sqtail, cqhead, cqtail;
+  unsigned n;
+  int res, result;
+
+  result = copyin((const_userptr_t)&ring->sr_sqhead, &sqhead, sizeof(sqhead));
+  if (!result) {
+    result = copyin((const_userptr_t)&ring->sr_sqtail, &sqtail, sizeof(sqtail));
+  }
+  if (!result) {
+    result = copyin((const_userptr_t)&ring->sr_cqhead, &cqhead, sizeof(cqhead));
+  }
+  if (!result) {
+    result = copyin((const_userptr_t)&ring->sr_cqtail, &cqtail, sizeof(cqtail));
+  }
+  if (result) {
+    return result;
+  }
+  if (sqtail - sqhead > SUBMIT_ENTRIES || cqtail - cqhead > SUBMIT_ENTRIES) {
+    return EINVAL;
+  }
+
+  for (n = 0; n < count && sqhead != sqtail &&
+	 cqtail - cqhead < SUBMIT_ENTRIES; n++) {
+    result = copyin((const_userptr_t)&ring->sr_sq[sqhead % SUBMIT_ENTRIES],
+		    &sqe, sizeof(sqe));
+    if (result) {
+      break;
+    }
+
+    res = 0;
+    switch (sqe.sqe_op) {
+    case SUBMIT_NOP:
+      result = 0;
+      break;
+    case SUBMIT_READ:
+    case SUBMIT_WRITE:
+      if (sqe.sqe_offset < -1) {
+	result = EINVAL;
+	break;
+      }
+      result = file_io1(sqe.sqe_fd, (userptr_t)sqe.sqe_buf, sqe.sqe_len,
+			sqe.sqe_offset,
+			sqe.sqe_op == SUBMIT_READ ? UIO_READ : UIO_WRITE,
+			&res);
+      break;
+    default:
+      result = EINVAL;
+      break;
+    }
+
+    cqe.cqe_data = sqe.sqe_data;
+    cqe.cqe_res = result ? -result : res;
+    cqe.cqe_pad = 0;
+    result = copyout(&cqe, (userptr_t)&ring->sr_cq[cqtail % SUBMIT_ENTRIES],
+		     sizeof(cqe));
+    if (result) {
+      break;
+    }
+    sqhead++;
+    cqtail++;
+  }
+
+  /* hand back what we did, even if we stopped on a fault */
+  res = copyout(&sqhead, (userptr_t)&ring->sr_sqhead, sizeof(sqhead));
+  if (!res) {
+    res = copyout(&cqtail, (userptr_t)&ring->sr_cqtail, sizeof(cqtail));
+  }
+  if (result || res) {
+    return result ? result : res;
+  }
+  *retval = n;
+  return 0;
+}
+
+/*
+ * Common code for poll and select: wait until at least one of the
+ * NFDS descriptors in FDS is ready for what it asks, or TIMEOUT
+ * milliseconds pass (forever if negative), and fill in the revents.
+ * Negative descriptors are skipped; ones that aren't open get
+ * POLLNVAL. Hands back the number with anything in revents.
+ *
+ * We hold a reference to every open file for the duration, so the
+ * entries we put on their pollqs stay valid until we take them off.
+ */
+static
+int
+file_poll(struct pollfd *fds, unsigned nfds, int timeout, int *retval)
+{
+  struct pollwait pw;
+  struct pollentry *pes;
+  struct openfile **files;
+  uint64_t deadline = 0, now, usecs;
+  bool first, timedout;
+  unsigned i;
+  int n, ticks, revents, res;
+
+  pes = kmalloc(nfds * sizeof(*pes));
+  files = kmalloc(nfds * sizeof(*files));
+  if (pes == NULL || files == NULL) {
+    if (pes != NULL) {
+      kfree(pes);
+    }
+    if (files != NULL) {
+      kfree(files);
+    }
+    return ENOMEM;
+  }
+
+  pollwait_init(&pw);
+  for (i = 0; i < nfds; i++) {
+    pollentry_init(&pes[i], &pw);
+    files[i] = NULL;
+    if (fds[i].fd >= 0) {
+      /* leaves files[i] NULL if fd isn't open */
+      filetable_get(curproc->p_filetable, fds[i].fd, &files[i]);
+    }
+  }
+  if (timeout >= 0) {
+    deadline = gettime_ns() + (uint64_t)timeout * 1000000;
+  }
+
+  first = true;
+  timedout = false;
+  for (;;) {
+    pollwait_clear(&pw);
+    n = 0;
+    for (i = 0; i < nfds; i++) {
+      fds[i].revents = 0;
+      if (fds[i].fd < 0) {
+        continue;
+      }
+      if (files[i] == NULL) {
+        fds[i].revents = POLLNVAL;
+        n++;
+        continue;
+      }
+      /* only get on the pollq the first time round */
+      res = VOP_POLL(files[i]->of_vnode, fds[i].events,
+                     first ? &pes[i] : NULL, &revents);
+      if (res) {
+        revents = POLLERR;
+      }
+      fds[i].revents = revents & (fds[i].events | POLLERR | POLLHUP);
+      if (fds[i].revents) {
+        n++;
+      }
+    }
+    first = false;
+    if (n > 0 || timedout) {
+      break;
+    }
+
+    if (timeout < 0) {
+      ticks = -1;
+    }
+    else {
+      now = gettime_ns();
+      if (now >= deadline) {
+        break;
+      }
+      usecs = DIVROUNDUP(deadline - now, 1000);
+      usecs = DIVROUNDUP(usecs, LT_GRANULARITY);
+      ticks = usecs > 0x7fffffff ? 0x7fffffff : (int)usecs;
+    }
+    timedout = !pollwait_sleep(&pw, ticks);
+  }
+
+  for (i = 0; i < nfds; i++) {
+    pollentry_remove(&pes[i]);
+    if (files[i] != NULL) {
+      openfile_decref(files[i]);
+    }
+  }
+  kfree(files);
+  kfree(pes);
+
+  *retval = n;
+  return 0;
+}
+
+/* handler for poll() system call                   */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+  struct pollfd *fds;
+  int res;
+
+  if (nfds > OPEN_MAX) {
+    return EINVAL;
+  }
+  fds = kmalloc(nfds * sizeof(*fds));
+  if (fds == NULL) {
+    return ENOMEM;
+  }
+  res = copyin(ufds, fds, nfds * sizeof(*fds));
+  if (!res) {
+    res = file_poll(fds, nfds, timeout, retval);
+  }
+  if (!res) {
+    res = copyout(fds, ufds, nfds * sizeof(*fds));
+  }
+  kfree(fds);
+  return res;
+}
+
+/*
+ * handler for select() system call: turn the sets into an array of
+ * pollfds, one per descriptor in any of them, and back again.
+ */
+int
+sys_select(int nfds, userptr_t ureadfds, userptr_t uwritefds,
+	   userptr_t uexceptfds, userptr_t utimeout, int *retval)
+{
+  fd_set sets[3];
+  userptr_t usets[3] = { ureadfds, uwritefds, uexceptfds };
+  struct pollfd *fds;
+  struct timeval tv;
+  short events;
+  int timeout, fd, i, j, n, res;
+
+  if (nfds < 0 || nfds > FD_SETSIZE) {
+    return EINVAL;
+  }
+  for (i = 0; i < 3; i++) {
+    FD_ZERO(&sets[i]);
+    if (usets[i] != NULL) {
+      res = copyin(usets[i], &sets[i], sizeof(fd_set));
+      if (res) {
+        return res;
+      }
+    }
+  }
+  timeout = -1;
+  if (utimeout != NULL) {
+    res = copyin(utimeout, &tv, sizeof(tv));
+    if (res) {
+      return res;
+    }
+    if (tv.tv_sec < 0 || tv.tv_usec < 0 || tv.tv_usec >= 1000000) {
+      return EINVAL;
+    }
+    timeout = tv.tv_sec > 0x7fffffff / 1000 ? 0x7fffffff :
+      tv.tv_sec * 1000 + DIVROUNDUP(tv.tv_usec, 1000);
+  }
+
+  /* the sets are small; the pollfds only need room for what's set */
+  n = 0;
+  for (fd = 0; fd < nfds; fd++) {
+    if (FD_ISSET(fd, &sets[0]) || FD_ISSET(fd, &sets[1]) ||
+        FD_ISSET(fd, &sets[2])) {
+      n++;
+    }
+  }
+  fds = kmalloc(n * sizeof(*fds));
+  if (fds == NULL) {
+    return ENOMEM;
+  }
+
+  n = 0;
+  for (fd = 0; fd < nfds; fd++) {
+    events = 0;
+    if (FD_ISSET(fd, &sets[0])) {
+      events |= POLLIN;
+    }
+    if (FD_ISSET(fd, &sets[1])) {
+      events |= POLLOUT;
+    }
+    if (FD_ISSET(fd, &sets[2])) {
+      events |= POLLPRI;
+    }
+    if (events != 0) {
+      fds[n].fd = fd;
+      fds[n].events = events;
+      n++;
+    }
+  }
+
+  res = file_poll(fds, n, timeout, &j);
+  if (res) {
+    kfree(fds);
+    return res;
+  }
+
+  for (i = 0; i < 3; i++) {
+    FD_ZERO(&sets[i]);
+  }
+  j = 0;
+  for (i = 0; i < n; i++) {
+    fd = fds[i].fd;
+    if (fds[i].revents & POLLNVAL) {
+      kfree(fds);
+      return EBADF;
+    }
+    /* errors and hangups count as ready, so the read or write finds out */
+    if (fds[i].events & POLLIN &&
+        fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+      FD_SET(fd, &sets[0]);
+      j++;
+    }
+    if (fds[i].events & POLLOUT &&
+        fds[i].revents & (POLLOUT | POLLERR)) {
+      FD_SET(fd, &sets[1]);
+      j++;
+    }
+    if (fds[i].revents & POLLPRI) {
+      FD_SET(fd, &sets[2]);
+      j++;
+    }
+  }
+  kfree(fds);
+
+  for (i = 0; i < 3; i++) {
+    if (usets[i] != NULL) {
+      res = copyout(&sets[i], usets[i], sizeof(fd_set));
+      if (res) {
+        return res;
+      }
+    }
+  }
+  *retval = j;
+  return 0;
+}
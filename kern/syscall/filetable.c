@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Open files and file descriptor tables. See filetable.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <filetable.h>
+
+/*
+ * Make an openfile for VN, which has been opened already; VN is only
+ * consumed on success.
+ */
+int
+openfile_create(struct vnode *vn, int flags, struct openfile **ret)
+{
+	struct openfile *file;
+
+	file = kmalloc(sizeof(*file));
+	if (file == NULL) {
+		return ENOMEM;
+	}
+	file->of_lock = lock_create("openfile");
+	if (file->of_lock == NULL) {
+		kfree(file);
+		return ENOMEM;
+	}
+
+	file->of_vnode = vn;
+	file->of_accmode = flags & O_ACCMODE;
+	file->of_append = (flags & O_APPEND) != 0;
+	file->of_offset = 0;
+	spinlock_init(&file->of_reflock);
+	file->of_refcount = 1;
+
+	*ret = file;
+	return 0;
+}
+
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct vnode *vn;
+	int result;
+
+	if ((flags & O_ACCMODE) == O_ACCMODE) {
+		return EINVAL;
+	}
+
+	result = vfs_open(path, flags, mode, &vn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_create(vn, flags, ret);
+	if (result) {
+		vfs_close(vn);
+		return result;
+	}
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *file)
+{
+	spinlock_acquire(&file->of_reflock);
+	KASSERT(file->of_refcount > 0);
+	file->of_refcount++;
+	spinlock_release(&file->of_reflock);
+}
+
+void
+openfile_decref(struct openfile *file)
+{
+	bool dead;
+
+	spinlock_acquire(&file->of_reflock);
+	KASSERT(file->of_refcount > 0);
+	file->of_refcount--;
+	dead = file->of_refcount == 0;
+	spinlock_release(&file->of_reflock);
+
+	if (!dead) {
+		return;
+	}
+	vfs_close(file->of_vnode);
+	lock_destroy(file->of_lock);
+	spinlock_cleanup(&file->of_reflock);
+	kfree(file);
+}
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	int fd;
+
+	ft = kmalloc(sizeof(*ft));
+	if (ft == NULL) {
+		return NULL;
+	}
+	spinlock_init(&ft->ft_lock);
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		ft->ft_files[fd] = NULL;
+	}
+	return ft;
+}
+
+int
+filetable_copy(struct filetable *src, struct filetable **ret)
+{
+	struct filetable *ft;
+	int fd;
+
+	ft = filetable_create();
+	if (ft == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&src->ft_lock);
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		if (src->ft_files[fd] != NULL) {
+			openfile_incref(src->ft_files[fd]);
+			ft->ft_files[fd] = src->ft_files[fd];
+		}
+	}
+	spinlock_release(&src->ft_lock);
+
+	*ret = ft;
+	return 0;
+}
+
+void
+filetable_destroy(struct filetable *ft)
+{
+	int fd;
+
+	/* we have the only reference to the table */
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		if (ft->ft_files[fd] != NULL) {
+			openfile_decref(ft->ft_files[fd]);
+			ft->ft_files[fd] = NULL;
+		}
+	}
+	spinlock_cleanup(&ft->ft_lock);
+	kfree(ft);
+}
+
+int
+filetable_stdio(struct filetable *ft)
+{
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct openfile *file;
+	char path[5];
+	int fd, result;
+
+	for (fd = 0; fd < 3; fd++) {
+		KASSERT(ft->ft_files[fd] == NULL);
+		/* vfs_open may write on the path */
+		strcpy(path, "con:");
+		result = openfile_open(path, modes[fd], 0, &file);
+		if (result) {
+			return result;
+		}
+		ft->ft_files[fd] = file;
+	}
+	return 0;
+}
+
+int
+filetable_place(struct filetable *ft, struct openfile *file, int *fd)
+{
+	int i;
+
+	spinlock_acquire(&ft->ft_lock);
+	for (i = 0; i < OPEN_MAX; i++) {
+		if (ft->ft_files[i] == NULL) {
+			ft->ft_files[i] = file;
+			spinlock_release(&ft->ft_lock);
+			*fd = i;
+			return 0;
+		}
+	}
+	spinlock_release(&ft->ft_lock);
+	return EMFILE;
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	struct openfile *file;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	file = ft->ft_files[fd];
+	if (file != NULL) {
+		openfile_incref(file);
+	}
+	spinlock_release(&ft->ft_lock);
+
+	if (file == NULL) {
+		return EBADF;
+	}
+	*ret = file;
+	return 0;
+}
+
+int
+filetable_close(struct filetable *ft, int fd)
+{
+	struct openfile *file;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	file = ft->ft_files[fd];
+	ft->ft_files[fd] = NULL;
+	spinlock_release(&ft->ft_lock);
+
+	if (file == NULL) {
+		return EBADF;
+	}
+	/* may sleep closing the vnode, so not under ft_lock */
+	openfile_decref(file);
+	return 0;
+}
+
+int
+filetable_dup2(struct filetable *ft, int oldfd, int newfd)
+{
+	struct openfile *file, *old;
+
+	if (oldfd < 0 || oldfd >= OPEN_MAX || newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	file = ft->ft_files[oldfd];
+	if (file == NULL) {
+		spinlock_release(&ft->ft_lock);
+		return EBADF;
+	}
+	if (oldfd == newfd) {
+		spinlock_release(&ft->ft_lock);
+		return 0;
+	}
+	openfile_incref(file);
+	old = ft->ft_files[newfd];
+	ft->ft_files[newfd] = file;
+	spinlock_release(&ft->ft_lock);
+
+	if (old != NULL) {
+		openfile_decref(old);
+	}
+	return 0;
+}
@@ -45,6 +45,11 @@
  * If you wanted to support memory-mapped executables you would need
  * to rearrange this to map each segment.
  *
+ * What we learn about each program is kept in the exec image cache
+ * (see execcache.h), so exec'ing it again skips parsing the headers
+ * and maps the already-loaded text instead of reading it again; only
+ * the writable segments get loaded from the file.
+ *
  * To support dynamically linked executables with shared libraries
  * you'd need to change this to load the "ELF interpreter" (dynamic
  * linker). And you'd have to write a dynamic linker...
@@ -59,6 +64,7 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#include <execcache.h>
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -146,12 +152,13 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
- *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Load an ELF executable from the file, describing it in IMG (if not
+ * NULL) as we go. Sets *CACHEABLE if IMG ends up complete.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+load_elf_file(struct vnode *v, struct exec_image *img, bool *cacheable,
+	      vaddr_t *entrypoint)
 {
 	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
@@ -161,6 +168,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	struct addrspace *as;
 
 	as = curproc_getas();
+	*cacheable = false;
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -251,6 +259,20 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		if (result) {
 			return result;
 		}
+
+		if (img != NULL) {
+			if (img->ei_nsegs == EXEC_MAXSEGS) {
+				/* too many to remember */
+				img = NULL;
+				continue;
+			}
+			img->ei_segs[img->ei_nsegs].es_offset = ph.p_offset;
+			img->ei_segs[img->ei_nsegs].es_vaddr = ph.p_vaddr;
+			img->ei_segs[img->ei_nsegs].es_memsize = ph.p_memsz;
+			img->ei_segs[img->ei_nsegs].es_filesize = ph.p_filesz;
+			img->ei_segs[img->ei_nsegs].es_flags = ph.p_flags;
+			img->ei_nsegs++;
+		}
 	}
 
 	result = as_prepare_load(as);
@@ -303,5 +325,102 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 
 	*entrypoint = eh.e_entry;
 
+	if (img != NULL && img->ei_nsegs > 0) {
+		img->ei_entry = eh.e_entry;
+		if ((img->ei_segs[0].es_flags & PF_W) == 0) {
+			/* read-only text: keep its frames for next time */
+			as_share_text(as, img);
+		}
+		*cacheable = true;
+	}
+
+	return 0;
+}
+
+/*
+ * Load an ELF executable described by a cached image: define the
+ * regions from it, map its text if we can, and load the rest.
+ */
+static
+int
+load_elf_image(struct vnode *v, struct exec_image *img, vaddr_t *entrypoint)
+{
+	struct exec_segment *es;
+	struct addrspace *as;
+	bool shared;
+	unsigned i;
+	int result;
+
+	as = curproc_getas();
+
+	for (i=0; i<img->ei_nsegs; i++) {
+		es = &img->ei_segs[i];
+		result = as_define_region(as,
+					  es->es_vaddr, es->es_memsize,
+					  es->es_flags & PF_R,
+					  es->es_flags & PF_W,
+					  es->es_flags & PF_X);
+		if (result) {
+			return result;
+		}
+	}
+
+	shared = (img->ei_segs[0].es_flags & PF_W) == 0 &&
+		as_map_text(as, img);
+
+	result = as_prepare_load(as);
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<img->ei_nsegs; i++) {
+		if (i == 0 && shared) {
+			continue;
+		}
+		es = &img->ei_segs[i];
+		result = load_segment(as, v, es->es_offset, es->es_vaddr,
+				      es->es_memsize, es->es_filesize,
+				      es->es_flags & PF_X);
+		if (result) {
+			return result;
+		}
+	}
+
+	result = as_complete_load(as);
+	if (result) {
+		return result;
+	}
+
+	*entrypoint = img->ei_entry;
+
 	return 0;
 }
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct exec_image *img;
+	bool hit, cacheable;
+	int result;
+
+	img = execcache_get(v, &hit);
+	if (img != NULL && hit) {
+		result = load_elf_image(v, img, entrypoint);
+	}
+	else {
+		result = load_elf_file(v, img, &cacheable, entrypoint);
+		if (result == 0 && cacheable) {
+			execcache_enter(img);
+		}
+	}
+
+	if (img != NULL) {
+		execcache_release(img);
+	}
+	return result;
+}
@@ -15,9 +15,16 @@
 #include <synch.h>
 #include <vnode.h>
 #include <vfs.h>
+#include <spl.h>
+#include <clock.h>
 #include <kern/fcntl.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <limits.h>
 
 #if OPT_A2
+static void vfork_release(struct proc *p);
+
 pid_t sys_fork(struct trapframe *parent_tf, pid_t *retval){
     /* Create new process struct */
     struct proc *child_proc = proc_create_runprogram(curproc->p_name);
@@ -30,9 +37,7 @@ pid_t sys_fork(struct trapframe *parent_tf, pid_t *retval){
     struct addrspace *newas[1];
     if (as_copy(curproc_getas(), newas) != 0){
         DEBUG(DB_SYSCALL, "as_copy() out of memory in sys_fork()!\n");
-        lock_acquire(ptable_lock);
-        remove_pt_entry(child_proc->pid);
-        lock_release(ptable_lock);
+        pt_discard(child_proc->pid);
 
         proc_destroy(child_proc);
         return ENOMEM;
@@ -43,9 +48,7 @@ pid_t sys_fork(struct trapframe *parent_tf, pid_t *retval){
     struct trapframe *child_tf = kmalloc(sizeof(struct trapframe));
     if (child_tf == NULL){
         DEBUG(DB_SYSCALL, "couldn't create trapframe in sys_fork().\n");
-        lock_acquire(ptable_lock);
-        remove_pt_entry(child_proc->pid);
-        lock_release(ptable_lock);
+        pt_discard(child_proc->pid);
 
         proc_destroy(child_proc);
         return ENOMEM;
@@ -54,24 +57,22 @@ pid_t sys_fork(struct trapframe *parent_tf, pid_t *retval){
     // synch issues?
     memcpy(child_tf, parent_tf, sizeof(struct trapframe));
 
+    /* link the child in before it can run (and possibly exit) */
+    pt_lock_pair(curproc->pid, child_proc->pid);
+    add_pt_child(curproc->pid, child_proc->pid);
+    pt_unlock_pair(curproc->pid, child_proc->pid);
+
     int exit_status = thread_fork(curproc->p_name, child_proc, enter_forked_process, child_tf, -1);
     if(exit_status){
         DEBUG(DB_SYSCALL, "thread_fork() fail in sys_fork()");
 
-        lock_acquire(ptable_lock);
-        remove_pt_entry(child_proc->pid);
-        lock_release(ptable_lock);
+        pt_discard(child_proc->pid);
 
         proc_destroy(child_proc);
         kfree(child_tf);
         return exit_status; 
     }
 
-    lock_acquire(ptable_lock);
-    struct pt_entry *pt_child = get_ptable_entry(child_proc->pid);
-    pt_child->parent_pid = curproc->pid;
-    lock_release(ptable_lock);
-
     *retval = child_proc->pid;
 
     return 0;
@@ -91,18 +92,17 @@ void sys__exit(int exitcode) {
      an unused variable */
 
 #if OPT_A2
-  lock_acquire(ptable_lock);
-  struct pt_entry *pt_curr = get_ptable_entry(curproc->pid);
-  if (pt_curr == NULL){
-      DEBUG(DB_THREADS, "ptable entry missing for currproc in call sys__exit\n");
-      // do stuff
-  } 
+  /* reap or orphan our own children first; that takes its own locks */
+  update_pt_children(p->pid);
+
+  pid_t ppid = pt_lock_withparent(p->pid);
+  struct pt_entry *pt_curr = get_ptable_entry(p->pid);
+  KASSERT(pt_curr != NULL);
 
   //kprintf("pid: %d is exiting", pt_curr->pid);
 
-  if (pt_curr->parent_pid == PID_ORPHAN){
-   remove_pt_entry(curproc->pid);
-   update_pt_children(curproc->pid);
+  if (ppid == PID_ORPHAN){
+   remove_pt_entry(p->pid);
   } else {
    // check if process exited or was signalled/stopped
    if (WIFEXITED(exitcode)){
@@ -113,11 +113,17 @@ void sys__exit(int exitcode) {
     pt_curr->exit_status = _MKWAIT_STOP(exitcode);
    }
    pt_curr->status = S_ZOMBIE;
-   update_pt_children(curproc->pid);
-   cv_broadcast(ptable_cv, ptable_lock); // maybe should wakeone instead of broadcast
+   /* leave our cpu usage behind for the parent's getrusage */
+   pt_curr->runtime = curthread->t_runtime + p->p_child_runtime;
+   pt_curr->nvcsw = curthread->t_nvcsw + p->p_child_nvcsw;
+   pt_curr->nivcsw = curthread->t_nivcsw + p->p_child_nivcsw;
+   /* wake only our parent, not everyone waiting on any process */
+   struct pt_entry *pt_parent = get_ptable_entry(ppid);
+   add_pt_zombie(p->pid);
+   cv_broadcast(pt_parent->child_exit_cv, pt_lock(ppid));
   }
 
-  lock_release(ptable_lock);
+  pt_unlock_withparent(p->pid, ppid);
 
 #endif /* OPT_A2 */
 
@@ -133,6 +139,13 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
+#if OPT_A2
+  if (p->p_vforked) {
+    /* it was our vfork parent's all along */
+    vfork_release(p);
+  }
+  else
+#endif /* OPT_A2 */
   as_destroy(as);
 
   /* detach this thread from its process */
@@ -179,32 +192,70 @@ sys_waitpid(pid_t pid,
      Fix this!
   */
 
-  lock_acquire(ptable_lock);
-  struct pt_entry *pt_child = get_ptable_entry(pid);
-
-  if (options != 0) {
-    lock_release(ptable_lock);
+  if ((options & ~WNOHANG) != 0) {
     return EINVAL;
-  } else if (pt_child == NULL) {
-    lock_release(ptable_lock);
-    return ESRCH;
-  } else if (pt_child->parent_pid != curproc->pid){
-    lock_release(ptable_lock);
-    return ECHILD;
   } else if (status == NULL){
-    lock_release(ptable_lock);
     return EFAULT;
   }
 
-  while(pt_child->status == S_RUN){
-      cv_wait(ptable_cv, ptable_lock);
+  pid_t self = curproc->pid;
+  struct pt_entry *pt_self;
+  struct pt_entry *pt_child;
+  pid_t ppid;
+
+  if (pid != -1) {
+    if (pid < PID_MIN || pid > PID_MAX) {
+      return ESRCH;
+    }
+    /* look it up under its own lock; if it's ours, it stays put */
+    lock_acquire(pt_lock(pid));
+    pt_child = get_ptable_entry(pid);
+    ppid = pt_child == NULL ? PID_ORPHAN : pt_child->parent_pid;
+    lock_release(pt_lock(pid));
+    if (pt_child == NULL) {
+      return ESRCH;
+    } else if (ppid != self){
+      return ECHILD;
+    }
   }
 
+  /* our children's status only changes with our lock held too */
+  lock_acquire(pt_lock(self));
+  pt_self = get_ptable_entry(self);
+  if (pid == -1) {
+    /* any child: take the one that exited first */
+    if (pt_self->children == NULL) {
+      lock_release(pt_lock(self));
+      return ECHILD;
+    }
+    while (pt_self->zombies == NULL) {
+      if (options & WNOHANG) {
+        lock_release(pt_lock(self));
+        *retval = 0;
+        return 0;
+      }
+      cv_wait(pt_self->child_exit_cv, pt_lock(self));
+    }
+    pt_child = pt_self->zombies;
+  } else {
+    while(pt_child->status == S_RUN){
+      if (options & WNOHANG) {
+        lock_release(pt_lock(self));
+        *retval = 0;
+        return 0;
+      }
+      cv_wait(pt_self->child_exit_cv, pt_lock(self));
+    }
+  }
+  lock_release(pt_lock(self));
 
-  /* for now, just pretend the exitstatus is 0 */
+  /* it's a zombie now, so none of this changes until we remove it */
   exitstatus = pt_child->exit_status;
-  remove_pt_entry(pt_child->pid);
-  lock_release(ptable_lock);
+  curproc->p_child_runtime += pt_child->runtime;
+  curproc->p_child_nvcsw += pt_child->nvcsw;
+  curproc->p_child_nivcsw += pt_child->nivcsw;
+  pid = pt_child->pid;
+  pt_discard(pid);
 
   result = copyout((void *)&exitstatus,status,sizeof(int));
   if (result) {
@@ -215,73 +266,102 @@ sys_waitpid(pid_t pid,
 }
 
 #if OPT_A2
-int sys_execv(const char *program, char **args){
-    struct addrspace *curr_as = curproc_getas();
-    struct addrspace *as;
-	vaddr_t entrypoint, stackptr;
-    struct vnode *v;
-    int argc = 0;    
-    bool kmalloc_fail = false;
-    bool cpy_fail = false;
+#define EXEC_MAXARGS 16     /* most arguments execv/spawn take */
+#define EXEC_MAXARGLEN 512  /* longest argument */
+
+static void free_args(char *kprogram, char **kargs, int argc){
+    for (int i = 0; i < argc; ++i) kfree(kargs[i]);
+    kfree(kargs);
+    kfree(kprogram);
+}
+
+/*
+ * Copy the program path and argument vector for execv or spawn in
+ * from userspace.
+ */
+static int copyin_args(userptr_t program, userptr_t args,
+                       char **kprogram_ret, char ***kargs_ret, int *argc_ret){
+    char *kprogram, *buf;
+    char **kargs;
+    userptr_t uarg;
+    int argc = 0;
     int result;
 
     if (program == NULL){
         return ENOENT;
     }
 
-    for (; args[argc] != NULL; ++argc){
-        if (strlen(args[argc]) > 512){
-            return E2BIG;
-        }
-    }
-   
-    if (argc > 16){
-        return E2BIG;
-    }
-    
-    char *kprogram = kmalloc(sizeof(char) * (strlen(program) + 1));
-    if (kprogram == NULL){
-        return ENOMEM;
-    }
-
-    char **kargs = kmalloc(sizeof(char *) * (argc + 1));
-    if (kargs == NULL){
-        kfree(kprogram);
-        return ENOMEM;
+    kprogram = kmalloc(PATH_MAX);
+    kargs = kmalloc(sizeof(char *) * (EXEC_MAXARGS + 1));
+    buf = kmalloc(EXEC_MAXARGLEN + 1);
+    if (kprogram == NULL || kargs == NULL || buf == NULL){
+        result = ENOMEM;
+        goto fail;
     }
 
-    result = copyinstr((userptr_t) program, kprogram, strlen(program)+1, NULL);
+    result = copyinstr(program, kprogram, PATH_MAX, NULL);
     if (result){
-        kfree(kprogram);
-        kfree(kargs);
-        return ENOEXEC;
+        goto fail;
     }
 
-    for (int i = 0; i < argc; ++i){
-        kargs[i] = kmalloc(sizeof(char) * (strlen(args[i]) + 1));
-        if (kargs[i] == NULL) kmalloc_fail = true;
-    }
-    
-    if (kmalloc_fail){
-        for (int i = 0; i < argc; ++i) kfree(kargs[i]); 
-        kfree(kargs);
-        kfree(kprogram);
-        return ENOMEM;
+    while (1){
+        result = copyin((userptr_t)((userptr_t *)args + argc), &uarg,
+                        sizeof(uarg));
+        if (result){
+            goto fail;
+        }
+        if (uarg == NULL){
+            break;
+        }
+        if (argc == EXEC_MAXARGS){
+            result = E2BIG;
+            goto fail;
+        }
+        result = copyinstr(uarg, buf, EXEC_MAXARGLEN + 1, NULL);
+        if (result){
+            if (result == ENAMETOOLONG) result = E2BIG;
+            goto fail;
+        }
+        kargs[argc] = kstrdup(buf);
+        if (kargs[argc] == NULL){
+            result = ENOMEM;
+            goto fail;
+        }
+        argc++;
     }
+    kargs[argc] = NULL;
+    kfree(buf);
 
-    for (int i = 0; i < argc; ++i){
-        int cpy_result = copyinstr((userptr_t) args[i], kargs[i], strlen(args[i])+1, NULL);
-        if (cpy_result) cpy_fail = true;
-    }
+    *kprogram_ret = kprogram;
+    *kargs_ret = kargs;
+    *argc_ret = argc;
+    return 0;
 
-    if (cpy_fail){
-        for (int i = 0; i < argc; ++i) kfree(kargs[i]);
-        kfree(kargs);
+fail:
+    kfree(buf);
+    if (kargs == NULL){
         kfree(kprogram);
-        return EFAULT;
+    } else {
+        free_args(kprogram, kargs, argc);
     }
+    return result;
+}
+
+/*
+ * Give the current process a new address space holding KPROGRAM, with
+ * the arguments copied onto its stack. On success the old address
+ * space (possibly NULL) is handed back in OLDAS for the caller to dispose
+ * of; on failure it is put back.
+ */
+static int load_program(char *kprogram, char **kargs, int argc,
+                        struct addrspace **oldas, vaddr_t *entrypoint,
+                        userptr_t *argv, vaddr_t *stackptr){
+    struct addrspace *as;
+    struct vnode *v;
+    vaddr_t argsptr[argc+1];
+    vaddr_t sp;
+    int result;
 
-    kargs[argc] = NULL;
     result = vfs_open(kprogram, O_RDONLY, 0, &v);
     if (result) { return result; }
 
@@ -291,61 +371,302 @@ int sys_execv(const char *program, char **args){
         return ENOMEM;
     }
 
-    curproc_setas(as);
+    *oldas = curproc_setas(as);
     as_activate();
 
-    result = load_elf(v, &entrypoint);
+    result = load_elf(v, entrypoint);
+    vfs_close(v);
     if (result){
-        vfs_close(v);
-        curproc_setas(curr_as);
-        return result;
+        goto fail;
     }
 
-    vfs_close(v);
-
-    result = as_define_stack(as, &stackptr);
+    result = as_define_stack(as, &sp);
     if (result){
-        curproc_setas(curr_as);
-        return result;
+        goto fail;
     }
 
     // stackptr must be 8-byte aligned
-    for (; (stackptr % 8) != 0; --stackptr);
-    vaddr_t argsptr[argc+1];
+    sp -= sp % 8;
 
     for (int i = argc-1; i >= 0; --i){
-        stackptr -= strlen(kargs[i]) + 1;
-        argsptr[i] = stackptr;
-        result = copyoutstr(kargs[i], (userptr_t) stackptr, 
+        sp -= strlen(kargs[i]) + 1;
+        argsptr[i] = sp;
+        result = copyoutstr(kargs[i], (userptr_t) sp,
                             strlen(kargs[i])+1, NULL);
         if (result){
-            for (int j = 0; j < argc; ++j) kfree(kargs[j]);
-            kfree(kargs);
-            kfree(kprogram);
-            curproc_setas(curr_as);
-            return result;
+            goto fail;
         }
     }
 
-    for (; (stackptr % 4) != 0; --stackptr);
-    
+    sp -= sp % 4;
+
     argsptr[argc] = 0;
     for (int i = argc; i >= 0; --i){
-        stackptr -= ROUNDUP(sizeof(vaddr_t), 4);
-        result = copyout(&argsptr[i], (userptr_t) stackptr, sizeof(vaddr_t));
+        sp -= sizeof(vaddr_t);
+        result = copyout(&argsptr[i], (userptr_t) sp, sizeof(vaddr_t));
         if (result){
-            for (int j = 0; j <= argc; ++j) kfree(kargs[j]);
-            kfree(kargs);
-            kfree(kprogram);
-            curproc_setas(curr_as);
-            return result;
+            goto fail;
         }
     }
 
-    as_destroy(curr_as);
+    *argv = (userptr_t) sp;
+    *stackptr = sp - sp % 8;
+    return 0;
+
+fail:
+    curproc_setas(*oldas);
+    as_activate();
+    as_destroy(as);
+    return result;
+}
 
-    enter_new_process(argc, (userptr_t) stackptr, stackptr, entrypoint);
+/*
+ * A vfork child is finished with its parent's address space (it has
+ * exec'd or is exiting): let the parent run again.
+ */
+static void vfork_release(struct proc *p){
+    KASSERT(p->p_vforked);
+    p->p_vforked = false;
+
+    /* our parent is waiting in vfork, so it hasn't orphaned us */
+    pid_t ppid = pt_lock_withparent(p->pid);
+    KASSERT(ppid != PID_ORPHAN);
+    struct pt_entry *pt_self = get_ptable_entry(p->pid);
+    KASSERT(pt_self->vfork_borrowing);
+    pt_self->vfork_borrowing = false;
+    struct pt_entry *pt_parent = get_ptable_entry(ppid);
+    KASSERT(pt_parent != NULL);
+    cv_broadcast(pt_parent->child_exit_cv, pt_lock(ppid));
+    pt_unlock_withparent(p->pid, ppid);
+}
+
+int sys_execv(const char *program, char **args){
+    struct addrspace *oldas;
+    vaddr_t entrypoint, stackptr;
+    userptr_t argv;
+    char *kprogram;
+    char **kargs;
+    int argc;
+    int result;
+
+    result = copyin_args((userptr_t) program, (userptr_t) args,
+                         &kprogram, &kargs, &argc);
+    if (result){
+        return result;
+    }
+
+    result = load_program(kprogram, kargs, argc, &oldas, &entrypoint,
+                          &argv, &stackptr);
+    free_args(kprogram, kargs, argc);
+    if (result){
+        return result;
+    }
+
+    if (curproc->p_vforked){
+        /* the old address space is our parent's; give it back */
+        vfork_release(curproc);
+    } else {
+        as_destroy(oldas);
+    }
+
+    enter_new_process(argc, argv, stackptr, entrypoint);
     panic("sys_execv: enter_new_process returned\n");
     return EINVAL;
 }
+
+/*
+ * vfork: like fork, but the child borrows our address space instead
+ * of getting a copy, and we wait until it has exec'd or exited before
+ * returning. Until then the child must not return from the function
+ * that called vfork, since it's running on our stack.
+ */
+int sys_vfork(struct trapframe *parent_tf, pid_t *retval){
+    struct proc *child_proc = proc_create_runprogram(curproc->p_name);
+    if (child_proc == NULL){
+        return ENPROC;
+    }
+    pid_t pid = child_proc->pid;
+
+    struct trapframe *child_tf = kmalloc(sizeof(struct trapframe));
+    if (child_tf == NULL){
+        pt_discard(pid);
+
+        proc_destroy(child_proc);
+        return ENOMEM;
+    }
+    memcpy(child_tf, parent_tf, sizeof(struct trapframe));
+
+    child_proc->p_addrspace = curproc_getas();
+    child_proc->p_vforked = true;
+    /* getpid in the child should say the child */
+    as_setpid(child_proc->p_addrspace, pid);
+
+    pt_lock_pair(curproc->pid, pid);
+    add_pt_child(curproc->pid, pid);
+    struct pt_entry *pt_child = get_ptable_entry(pid);
+    pt_child->vfork_borrowing = true;
+    pt_unlock_pair(curproc->pid, pid);
+
+    int result = thread_fork(curproc->p_name, child_proc, enter_forked_process, child_tf, -1);
+    if (result){
+        pt_discard(pid);
+
+        as_setpid(child_proc->p_addrspace, curproc->pid);
+        child_proc->p_addrspace = NULL;
+        proc_destroy(child_proc);
+        kfree(child_tf);
+        return result;
+    }
+
+    /* our entry (and the child's) can't go away while we're here */
+    lock_acquire(pt_lock(curproc->pid));
+    struct pt_entry *pt_self = get_ptable_entry(curproc->pid);
+    while (pt_child->vfork_borrowing){
+        cv_wait(pt_self->child_exit_cv, pt_lock(curproc->pid));
+    }
+    lock_release(pt_lock(curproc->pid));
+    as_setpid(curproc_getas(), curproc->pid);
+
+    *retval = pid;
+    return 0;
+}
+
+/*
+ * State shared between sys_spawn and the new process's first thread.
+ * sa_done and sa_result are protected by the parent's pt_lock.
+ */
+struct spawn_args {
+    char *sa_program;
+    char **sa_args;
+    int sa_argc;
+    bool sa_done;
+    int sa_result;
+};
+
+/*
+ * First thread of a spawned process: load the program and go to user
+ * mode. The parent waits to hear whether the load worked; if it
+ * didn't, the parent cleans up the process, so we just detach from it
+ * and go away.
+ */
+static void spawn_start(void *data1, unsigned long data2){
+    struct spawn_args *sa = data1;
+    struct proc *p = curproc;
+    struct addrspace *oldas = NULL;
+    vaddr_t entrypoint, stackptr;
+    userptr_t argv;
+    int argc = sa->sa_argc;
+    int result;
+
+    (void)data2;
+
+    result = load_program(sa->sa_program, sa->sa_args, argc, &oldas,
+                          &entrypoint, &argv, &stackptr);
+    KASSERT(oldas == NULL);
+    if (result){
+        proc_remthread(curthread);
+    }
+
+    /* our parent is waiting in spawn, so it hasn't orphaned us */
+    pid_t ppid = pt_lock_withparent(p->pid);
+    KASSERT(ppid != PID_ORPHAN);
+    struct pt_entry *pt_parent = get_ptable_entry(ppid);
+    sa->sa_result = result;
+    sa->sa_done = true;
+    cv_broadcast(pt_parent->child_exit_cv, pt_lock(ppid));
+    pt_unlock_withparent(p->pid, ppid);
+    /* sa is gone now */
+
+    if (result){
+        thread_exit();
+    }
+    enter_new_process(argc, argv, stackptr, entrypoint);
+    panic("spawn_start: enter_new_process returned\n");
+}
+
+/*
+ * spawn: create a child process running PROGRAM with ARGS, without
+ * copying our address space first the way fork+execv would.
+ */
+int sys_spawn(userptr_t program, userptr_t args, pid_t *retval){
+    struct spawn_args sa;
+    int result;
+
+    result = copyin_args(program, args, &sa.sa_program, &sa.sa_args,
+                         &sa.sa_argc);
+    if (result){
+        return result;
+    }
+    sa.sa_done = false;
+    sa.sa_result = 0;
+
+    struct proc *child_proc = proc_create_runprogram(sa.sa_program);
+    if (child_proc == NULL){
+        free_args(sa.sa_program, sa.sa_args, sa.sa_argc);
+        return ENPROC;
+    }
+    pid_t pid = child_proc->pid;
+
+    pt_lock_pair(curproc->pid, pid);
+    add_pt_child(curproc->pid, pid);
+    pt_unlock_pair(curproc->pid, pid);
+
+    result = thread_fork(child_proc->p_name, child_proc, spawn_start, &sa, 0);
+    if (result == 0){
+        lock_acquire(pt_lock(curproc->pid));
+        struct pt_entry *pt_self = get_ptable_entry(curproc->pid);
+        while (!sa.sa_done){
+            cv_wait(pt_self->child_exit_cv, pt_lock(curproc->pid));
+        }
+        lock_release(pt_lock(curproc->pid));
+        result = sa.sa_result;
+    }
+    free_args(sa.sa_program, sa.sa_args, sa.sa_argc);
+
+    if (result){
+        pt_discard(pid);
+
+        proc_destroy(child_proc);
+        return result;
+    }
+
+    *retval = pid;
+    return 0;
+}
+
+/*
+ * getrusage: report the scheduler's accounting for this process, or
+ * for the children it has waited for. We don't split time on the cpu
+ * into user and system time, so all of it is reported as ru_utime.
+ */
+int sys_getrusage(int who, userptr_t usage){
+    struct rusage ru;
+    uint64_t runtime;
+    unsigned nvcsw, nivcsw;
+    int spl;
+
+    if (who == RUSAGE_SELF){
+        /* keep a context switch from moving t_stamp under us */
+        spl = splhigh();
+        runtime = curthread->t_runtime + (gettime_ns() - curthread->t_stamp);
+        nvcsw = curthread->t_nvcsw;
+        nivcsw = curthread->t_nivcsw;
+        splx(spl);
+    } else if (who == RUSAGE_CHILDREN){
+        /* only our own waitpid changes these */
+        runtime = curproc->p_child_runtime;
+        nvcsw = curproc->p_child_nvcsw;
+        nivcsw = curproc->p_child_nivcsw;
+    } else {
+        return EINVAL;
+    }
+
+    bzero(&ru, sizeof(ru));
+    ru.ru_utime.tv_sec = runtime / 1000000000;
+    ru.ru_utime.tv_usec = (runtime % 1000000000) / 1000;
+    ru.ru_nvcsw = nvcsw;
+    ru.ru_nivcsw = nivcsw;
+
+    return copyout(&ru, usage, sizeof(ru));
+}
 #endif // OPT_A2
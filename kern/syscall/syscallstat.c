@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * System call profiler. See syscallstat.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <kern/sysstat.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscallstat.h>
+
+#define SYSCALLSTAT_MAXCPUS	32	/* Most cpus System/161 supports */
+#define SYSCALLSTAT_NCALLS	128	/* Call numbers recorded */
+
+/*
+ * One cpu's table, indexed by call number. Only its own cpu writes
+ * it. Resetting bumps syscallstat_gen; each cpu notices and clears its
+ * own table the next time it records something, the way lockstat
+ * does.
+ */
+struct syscallstat_cpu {
+	unsigned sc_gen;		/* Value of syscallstat_gen last cleared at */
+	struct sysstat sc_calls[SYSCALLSTAT_NCALLS];
+};
+
+static struct syscallstat_cpu *syscallstat_cpus[SYSCALLSTAT_MAXCPUS];
+static volatile unsigned syscallstat_gen;
+
+/* Names for the report, for the calls we implement. */
+static const char *const syscallstat_names[SYSCALLSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_getrusage] = "getrusage",
+	[SYS_open] = "open",
+	[SYS_dup2] = "dup2",
+	[SYS_pipe] = "pipe",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_readv] = "readv",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_writev] = "writev",
+	[SYS_copy_file_range] = "copy_file_range",
+	[SYS_lseek] = "lseek",
+	[SYS_select] = "select",
+	[SYS_poll] = "poll",
+	[SYS___time] = "__time",
+	[SYS_nanosleep] = "nanosleep",
+	[SYS_reboot] = "reboot",
+	[SYS_spawn] = "spawn",
+	[SYS_sysstat] = "sysstat",
+	[SYS_submit] = "submit",
+};
+
+static
+void
+syscallstat_clear(struct syscallstat_cpu *sc)
+{
+	sc->sc_gen = syscallstat_gen;
+	bzero(sc->sc_calls, sizeof(sc->sc_calls));
+}
+
+void
+syscallstat_cpu_init(struct cpu *c)
+{
+	struct syscallstat_cpu *sc;
+
+	if (c->c_number >= SYSCALLSTAT_MAXCPUS) {
+		/* Not recorded. */
+		return;
+	}
+
+	sc = kmalloc(sizeof(*sc));
+	if (sc == NULL) {
+		panic("syscallstat_cpu_init: Out of memory\n");
+	}
+	syscallstat_clear(sc);
+	syscallstat_cpus[c->c_number] = sc;
+}
+
+void
+syscallstat_record(int callno, bool failed, uint64_t ns)
+{
+	struct syscallstat_cpu *sc;
+	struct sysstat *s;
+	unsigned bucket;
+	int spl;
+
+	if (callno < 0 || callno >= SYSCALLSTAT_NCALLS) {
+		return;
+	}
+
+	for (bucket = 0; bucket < SYSSTAT_NBUCKETS - 1 &&
+		     (ns >> (bucket + 1)) != 0; bucket++) {
+		/* nothing */
+	}
+
+	/* stay on this cpu while we update its table */
+	spl = splhigh();
+	if (curcpu->c_number >= SYSCALLSTAT_MAXCPUS) {
+		splx(spl);
+		return;
+	}
+	sc = syscallstat_cpus[curcpu->c_number];
+	if (sc->sc_gen != syscallstat_gen) {
+		syscallstat_clear(sc);
+	}
+
+	s = &sc->sc_calls[callno];
+	if (s->ss_calls == 0 || ns < s->ss_minns) {
+		s->ss_minns = ns;
+	}
+	if (ns > s->ss_maxns) {
+		s->ss_maxns = ns;
+	}
+	s->ss_calls++;
+	if (failed) {
+		s->ss_errors++;
+	}
+	s->ss_totalns += ns;
+	s->ss_hist[bucket]++;
+	splx(spl);
+}
+
+/*
+ * Add up all the cpus' stats for call numbers 0 to COUNT-1 into ALL.
+ * The other cpus keep recording while we read their tables, so the
+ * numbers may be a little inconsistent; that's fine for this purpose.
+ */
+static
+void
+syscallstat_sum(struct sysstat *all, unsigned count)
+{
+	struct syscallstat_cpu *sc;
+	struct sysstat *a, *s;
+	unsigned i, callno, b;
+
+	bzero(all, count * sizeof(*all));
+	for (i=0; i<SYSCALLSTAT_MAXCPUS; i++) {
+		sc = syscallstat_cpus[i];
+		if (sc == NULL || sc->sc_gen != syscallstat_gen) {
+			continue;
+		}
+		for (callno=0; callno<count; callno++) {
+			a = &all[callno];
+			s = &sc->sc_calls[callno];
+			if (s->ss_calls == 0) {
+				continue;
+			}
+			if (a->ss_calls == 0 || s->ss_minns < a->ss_minns) {
+				a->ss_minns = s->ss_minns;
+			}
+			if (s->ss_maxns > a->ss_maxns) {
+				a->ss_maxns = s->ss_maxns;
+			}
+			a->ss_calls += s->ss_calls;
+			a->ss_errors += s->ss_errors;
+			a->ss_totalns += s->ss_totalns;
+			for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+				a->ss_hist[b] += s->ss_hist[b];
+			}
+		}
+	}
+}
+
+void
+syscallstat_report(void)
+{
+	struct sysstat *all, *a;
+	unsigned callno, b, median, seen;
+
+	all = kmalloc(SYSCALLSTAT_NCALLS * sizeof(*all));
+	if (all == NULL) {
+		kprintf("syscallstat: Out of memory\n");
+		return;
+	}
+	syscallstat_sum(all, SYSCALLSTAT_NCALLS);
+
+	kprintf("System calls (times in us):\n");
+	kprintf("%-4s %-15s %8s %7s %10s %7s %7s %7s %7s\n", "NUM", "NAME",
+		"CALLS", "ERRORS", "TOTAL", "AVG", "MIN", "MAX", "~MEDIAN");
+	for (callno=0; callno<SYSCALLSTAT_NCALLS; callno++) {
+		a = &all[callno];
+		if (a->ss_calls == 0) {
+			continue;
+		}
+		/* lower bound of the bucket holding the median */
+		seen = 0;
+		for (b=0; b<SYSSTAT_NBUCKETS - 1; b++) {
+			seen += a->ss_hist[b];
+			if (seen * 2 >= a->ss_calls) {
+				break;
+			}
+		}
+		median = (1U << b) / 1000;
+		kprintf("%-4u %-15s %8u %7u %10llu %7llu %7llu %7llu %7u\n",
+			callno, syscallstat_names[callno] != NULL ?
+			syscallstat_names[callno] : "?",
+			a->ss_calls, a->ss_errors, a->ss_totalns / 1000,
+			a->ss_totalns / a->ss_calls / 1000,
+			a->ss_minns / 1000, a->ss_maxns / 1000, median);
+	}
+	kfree(all);
+}
+
+void
+syscallstat_reset(void)
+{
+	syscallstat_gen++;
+}
+
+int
+sys_sysstat(userptr_t buf, unsigned count, int flags, int *retval)
+{
+	struct sysstat *all;
+	int result;
+
+	if ((flags & ~SYSSTAT_RESET) != 0) {
+		return EINVAL;
+	}
+	if (count > SYSCALLSTAT_NCALLS) {
+		count = SYSCALLSTAT_NCALLS;
+	}
+
+	all = kmalloc(SYSCALLSTAT_NCALLS * sizeof(*all));
+	if (all == NULL) {
+		return ENOMEM;
+	}
+	syscallstat_sum(all, count);
+	if (flags & SYSSTAT_RESET) {
+		syscallstat_reset();
+	}
+
+	result = copyout(all, buf, count * sizeof(*all));
+	kfree(all);
+	if (result) {
+		return result;
+	}
+	*retval = count;
+	return 0;
+}
@@ -32,6 +32,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
@@ -68,6 +69,11 @@ cleanitems(void)
 	lock_destroy(testlock);
 	cv_destroy(testcv);
 	sem_destroy(donesem);
+	/* so inititems makes new ones for the next test */
+	testsem = NULL;
+	testlock = NULL;
+	testcv = NULL;
+	donesem = NULL;
 	}
 #endif
 
@@ -347,3 +353,367 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Contended lock benchmark: NTHREADS threads all hammer one lock
+ * around a very short critical section, which is the case adaptive
+ * locks are meant for. Run it with different numbers of cpus
+ * configured in sys161.conf to see how it scales.
+ */
+
+#define LOCKBENCH_DEFTHREADS	8
+#define LOCKBENCH_DEFLOOPS	10000
+
+static unsigned long lockbench_loops;
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<lockbench_loops; i++) {
+		lock_acquire(testlock);
+		testval1++;
+		lock_release(testlock);
+	}
+	V(donesem);
+#ifdef UW
+	thread_exit();
+#endif
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	unsigned long i, nthreads;
+	uint64_t start, end;
+	int result;
+
+	if (nargs > 3) {
+		kprintf("Usage: lkb [threads [iterations]]\n");
+		return EINVAL;
+	}
+	nthreads = nargs > 1 ? atoi(args[1]) : LOCKBENCH_DEFTHREADS;
+	lockbench_loops = nargs > 2 ? atoi(args[2]) : LOCKBENCH_DEFLOOPS;
+	if (nthreads == 0 || lockbench_loops == 0) {
+		kprintf("lkb: threads and iterations must be positive\n");
+		return EINVAL;
+	}
+
+	inititems();
+	kprintf("Starting lock benchmark: %lu threads, %lu iterations...\n",
+		nthreads, lockbench_loops);
+
+	testval1 = 0;
+	start = gettime_ns();
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("lockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	end = gettime_ns();
+
+	if (testval1 != nthreads * lockbench_loops) {
+		kprintf("lkb: count is %lu, should be %lu\n",
+			testval1, nthreads * lockbench_loops);
+		panic("lockbench: lost updates\n");
+	}
+
+	kprintf("%lu acquires in %llu us (%llu ns per acquire)\n",
+		testval1, (end - start) / 1000,
+		(end - start) / testval1);
+
+#ifdef UW
+	cleanitems();
+#endif
+	kprintf("Lock benchmark done.\n");
+
+	return 0;
+}
+
+/*
+ * Reader-writer lock test. Writers store their number into testval1
+ * and testval2 with a pause in between; readers check that they never
+ * see the two differ. Some readers also upgrade to write and then
+ * downgrade again. We also count how many readers were ever inside
+ * at once, which should be more than one with multiple cpus.
+ */
+
+#define NRWLOOPS      40
+
+static struct rwlock *testrw;
+static struct spinlock rwcount_lock = SPINLOCK_INITIALIZER;
+static unsigned rwcount_readers;
+static unsigned rwcount_max;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: Mismatch on %s\n", num, msg);
+	panic("rwtest: Test failed\n");
+}
+
+static
+void
+rwtest_write(unsigned long num)
+{
+	volatile int j;
+
+	testval1 = num;
+	for (j=0; j<300; j++);
+	testval2 = num;
+	if (testval1 != num) {
+		rwfail(num, "testval1 (write)");
+	}
+}
+
+static
+void
+rwtest_read(unsigned long num)
+{
+	volatile int j;
+	unsigned long v1;
+
+	spinlock_acquire(&rwcount_lock);
+	rwcount_readers++;
+	if (rwcount_readers > rwcount_max) {
+		rwcount_max = rwcount_readers;
+	}
+	spinlock_release(&rwcount_lock);
+
+	v1 = testval1;
+	for (j=0; j<300; j++);
+	if (testval2 != v1 || testval1 != v1) {
+		rwfail(num, "testval1/testval2 (read)");
+	}
+
+	spinlock_acquire(&rwcount_lock);
+	rwcount_readers--;
+	spinlock_release(&rwcount_lock);
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % 4 == 0) {
+			rwlock_acquire_write(testrw);
+			rwtest_write(num);
+			rwlock_release_write(testrw);
+		}
+		else if (num % 4 == 1 && i % 4 == 0) {
+			rwlock_acquire_read(testrw);
+			rwtest_read(num);
+			if (rwlock_upgrade(testrw)) {
+				rwtest_write(num);
+				rwlock_downgrade(testrw);
+				rwtest_read(num);
+			}
+			rwlock_release_read(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			rwtest_read(num);
+			rwlock_release_read(testrw);
+		}
+		thread_yield();
+	}
+	V(donesem);
+#ifdef UW
+	thread_exit();
+#endif
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	kprintf("Starting rwlock test...\n");
+
+	/* The try, upgrade, and downgrade operations, single-threaded. */
+	if (!rwlock_tryacquire_write(testrw)) {
+		panic("rwtest: tryacquire_write failed on a free lock\n");
+	}
+	KASSERT(rwlock_do_i_hold_write(testrw));
+	if (rwlock_tryacquire_read(testrw)) {
+		panic("rwtest: tryacquire_read succeeded against a writer\n");
+	}
+	rwlock_downgrade(testrw);
+	KASSERT(!rwlock_do_i_hold_write(testrw));
+	if (!rwlock_tryacquire_read(testrw)) {
+		panic("rwtest: tryacquire_read failed against a reader\n");
+	}
+	if (rwlock_tryacquire_write(testrw)) {
+		panic("rwtest: tryacquire_write succeeded against readers\n");
+	}
+	rwlock_release_read(testrw);
+	if (!rwlock_upgrade(testrw)) {
+		panic("rwtest: upgrade failed for the only reader\n");
+	}
+	KASSERT(rwlock_do_i_hold_write(testrw));
+	rwlock_release_write(testrw);
+	kprintf("Single-thread operations ok\n");
+
+	testval1 = testval2 = 0;
+	rwcount_readers = rwcount_max = 0;
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("Up to %u readers at once\n", rwcount_max);
+	rwlock_destroy(testrw);
+	testrw = NULL;
+#ifdef UW
+	cleanitems();
+#endif
+	kprintf("Rwlock test done.\n");
+
+	return 0;
+}
+
+/*
+ * Reader scalability benchmark: threads that only ever read a shared
+ * value, first under the rwlock for reading and then under a plain
+ * lock. With more than one cpu the read side should scale where the
+ * lock serializes.
+ */
+
+#define RWBENCH_DEFTHREADS	8
+#define RWBENCH_DEFLOOPS	5000
+
+static unsigned long rwbench_loops;
+static bool rwbench_uselock;
+
+static
+void
+rwbenchthread(void *junk, unsigned long num)
+{
+	unsigned long i;
+	volatile unsigned long v;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<rwbench_loops; i++) {
+		if (rwbench_uselock) {
+			lock_acquire(testlock);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+		}
+		v = testval1;
+		for (j=0; j<20; j++);
+		(void)v;
+		if (rwbench_uselock) {
+			lock_release(testlock);
+		}
+		else {
+			rwlock_release_read(testrw);
+		}
+	}
+	V(donesem);
+#ifdef UW
+	thread_exit();
+#endif
+}
+
+static
+uint64_t
+rwbench_run(unsigned long nthreads)
+{
+	unsigned long i;
+	uint64_t start;
+	int result;
+
+	start = gettime_ns();
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("rwbench", NULL, rwbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("rwbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	return gettime_ns() - start;
+}
+
+int
+rwbench(int nargs, char **args)
+{
+	unsigned long nthreads;
+	uint64_t rwtime, locktime;
+
+	if (nargs > 3) {
+		kprintf("Usage: rwb [threads [iterations]]\n");
+		return EINVAL;
+	}
+	nthreads = nargs > 1 ? atoi(args[1]) : RWBENCH_DEFTHREADS;
+	rwbench_loops = nargs > 2 ? atoi(args[2]) : RWBENCH_DEFLOOPS;
+	if (nthreads == 0 || rwbench_loops == 0) {
+		kprintf("rwb: threads and iterations must be positive\n");
+		return EINVAL;
+	}
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwbench: rwlock_create failed\n");
+	}
+	kprintf("Starting reader benchmark: %lu threads, %lu reads each...\n",
+		nthreads, rwbench_loops);
+
+	rwbench_uselock = false;
+	rwtime = rwbench_run(nthreads);
+	rwbench_uselock = true;
+	locktime = rwbench_run(nthreads);
+
+	kprintf("rwlock: %llu us (%llu ns per read)\n", rwtime / 1000,
+		rwtime / (nthreads * rwbench_loops));
+	kprintf("lock:   %llu us (%llu ns per read)\n", locktime / 1000,
+		locktime / (nthreads * rwbench_loops));
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+#ifdef UW
+	cleanitems();
+#endif
+	kprintf("Reader benchmark done.\n");
+
+	return 0;
+}
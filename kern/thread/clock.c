@@ -32,6 +32,8 @@
 #include <cpu.h>
 #include <wchan.h>
 #include <clock.h>
+#include <kshared.h>
+#include <klog.h>
 #include <thread.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
@@ -39,9 +41,9 @@
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Callbacks can be scheduled to happen at specific points in the
+ * future, with a resolution of one timer tick (LT_GRANULARITY usec),
+ * using timeouts; clocksleep and clocknap are built on top of those.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -55,23 +57,46 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Number of timerclock() ticks per second.
  */
-static struct wchan *lbolt;
+#define TICKS_PER_SECOND (1000000/LT_GRANULARITY)
+
 /*
- * Once every LT_GRANULARITY usec, everything on minibolt is awakenened by CPU 0
+ * Timeouts.
+ *
+ * Pending timeouts are kept in a two-level hierarchical timing wheel
+ * indexed by timerclock() tick, so adding, cancelling, and expiring a
+ * timeout are all O(1) no matter how many are pending, and each tick
+ * only looks at the timeouts that are actually due.
+ *
+ * Level 0 has one bucket per tick for the next TW_L0_SIZE ticks.
+ * Level 1 has one bucket per TW_L0_SIZE ticks beyond that; whenever
+ * the level 0 index wraps around, the next level 1 bucket is
+ * cascaded down into level 0. Timeouts further out than level 1
+ * reaches are parked in its farthest bucket and re-sorted each time
+ * they are cascaded.
+ *
+ * Tick numbers wrap; that's fine as long as nobody asks for a timeout
+ * more than 2^31 ticks away, which is a bit over eight months.
  */
-static struct wchan *minibolt;
+#define TW_L0_BITS	8
+#define TW_L0_SIZE	(1U << TW_L0_BITS)
+#define TW_L0_MASK	(TW_L0_SIZE - 1)
+#define TW_L1_BITS	6
+#define TW_L1_SIZE	(1U << TW_L1_BITS)
+#define TW_L1_MASK	(TW_L1_SIZE - 1)
+#define TW_MAXDELTA	((TW_L0_SIZE << TW_L1_BITS) - 1)
 
-/* 
- * number of minibolts per second
- */
-#define MINI_PER_SECOND (1000000/LT_GRANULARITY);
+static struct timeout *tw_level0[TW_L0_SIZE];
+static struct timeout *tw_level1[TW_L1_SIZE];
+static unsigned tw_ticks;	/* Number of the last tick processed */
+static struct spinlock tw_lock = SPINLOCK_INITIALIZER;
 
 /*
- * minibolt countdown
+ * Sleeping threads waiting for a timeout sit here; each is woken
+ * individually by its own timeout (see clocknap).
  */
-static int minicount;
+static struct wchan *napchan;
 
 /*
  * Setup.
@@ -79,17 +104,150 @@ static int minicount;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	napchan = wchan_create("nap");
+	if (napchan == NULL) {
+		panic("Couldn't create napchan\n");
+	}
+	/* we assume TICKS_PER_SECOND > 0 */
+	KASSERT(TICKS_PER_SECOND > 0);
+}
+
+/*
+ * Put a timeout on (or take it off) a wheel bucket.
+ */
+static
+void
+tw_link(struct timeout **bucket, struct timeout *to)
+{
+	to->to_next = *bucket;
+	if (*bucket != NULL) {
+		(*bucket)->to_pprev = &to->to_next;
+	}
+	*bucket = to;
+	to->to_pprev = bucket;
+}
+
+static
+void
+tw_unlink(struct timeout *to)
+{
+	*to->to_pprev = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = to->to_pprev;
+	}
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+}
+
+/*
+ * File a timeout in the right bucket for its expiry time relative to
+ * the current tick. Call with tw_lock held.
+ */
+static
+void
+tw_insert(struct timeout *to)
+{
+	unsigned delta;
+
+	delta = to->to_expire - tw_ticks;
+	if (delta < TW_L0_SIZE) {
+		tw_link(&tw_level0[to->to_expire & TW_L0_MASK], to);
+	}
+	else if (delta <= TW_MAXDELTA) {
+		tw_link(&tw_level1[(to->to_expire >> TW_L0_BITS) & TW_L1_MASK],
+			to);
+	}
+	else {
+		tw_link(&tw_level1[((tw_ticks + TW_MAXDELTA) >> TW_L0_BITS)
+				   & TW_L1_MASK], to);
+	}
+}
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *data)
+{
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+	to->to_expire = 0;
+	to->to_func = func;
+	to->to_data = data;
+	to->to_pending = false;
+}
+
+void
+timeout_add(struct timeout *to, unsigned ticks)
+{
+	KASSERT(ticks <= 0x7fffffff);
+
+	/* Fire no earlier than the next tick. */
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	spinlock_acquire(&tw_lock);
+	KASSERT(!to->to_pending);
+	to->to_expire = tw_ticks + ticks;
+	to->to_pending = true;
+	tw_insert(to);
+	spinlock_release(&tw_lock);
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	bool wasqueued;
+
+	spinlock_acquire(&tw_lock);
+	wasqueued = to->to_pending;
+	if (wasqueued) {
+		tw_unlink(to);
+		to->to_pending = false;
 	}
-	minibolt = wchan_create("minibolt");
-	if (minibolt == NULL) {
-		panic("Couldn't create minibolt\n");
+	spinlock_release(&tw_lock);
+
+	return wasqueued;
+}
+
+/*
+ * Advance the wheel by one tick and run whatever is due. The
+ * callbacks are unhooked under the lock but run without it, so they
+ * are free to add timeouts (including themselves) again.
+ */
+static
+void
+timeout_tick(void)
+{
+	struct timeout *to, *expired, *next;
+
+	spinlock_acquire(&tw_lock);
+	tw_ticks++;
+
+	if ((tw_ticks & TW_L0_MASK) == 0) {
+		/* Cascade the next level 1 bucket down into level 0. */
+		to = tw_level1[(tw_ticks >> TW_L0_BITS) & TW_L1_MASK];
+		tw_level1[(tw_ticks >> TW_L0_BITS) & TW_L1_MASK] = NULL;
+		while (to != NULL) {
+			next = to->to_next;
+			tw_insert(to);
+			to = next;
+		}
+	}
+
+	expired = tw_level0[tw_ticks & TW_L0_MASK];
+	tw_level0[tw_ticks & TW_L0_MASK] = NULL;
+	for (to = expired; to != NULL; to = to->to_next) {
+		KASSERT(to->to_expire == tw_ticks);
+		to->to_pending = false;
+		to->to_pprev = NULL;
+	}
+	spinlock_release(&tw_lock);
+
+	while (expired != NULL) {
+		to = expired;
+		expired = to->to_next;
+		to->to_next = NULL;
+		to->to_func(to->to_data);
 	}
-	minicount = MINI_PER_SECOND;
-	/* we assume MINI_PER_SECOND > 0 */
-	KASSERT(minicount > 0);
 }
 
 /*
@@ -99,13 +257,8 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Broadcast on minibolt */
-	wchan_wakeall(minibolt);
-	/* Broadcast on lbolt if a second has elapsed */
-	if (--minicount <= 0) {
-	  minicount = MINI_PER_SECOND;
-	  wchan_wakeall(lbolt);
-	}
+	kshared_update();
+	timeout_tick();
 }
 
 /*
@@ -120,6 +273,7 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	klog_tick();
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
@@ -129,17 +283,50 @@ hardclock(void)
 	thread_yield();
 }
 
+/*
+ * State for one thread napping in clocknap(). Lives on the napping
+ * thread's stack; n_done and n_sleeping are protected by napchan's
+ * lock.
+ */
+struct nap {
+	struct timeout n_timeout;
+	struct thread *n_thread;
+	bool n_done;		/* the timeout has fired */
+	bool n_sleeping;	/* n_thread is on napchan */
+};
+
+/*
+ * Timeout callback for clocknap: wake exactly the thread that's
+ * waiting for this timeout. If it hasn't got as far as going to sleep
+ * yet, n_done tells it not to. Once we unlock napchan the nap may
+ * disappear, so don't touch it after that.
+ */
+static
+void
+clocknap_wakeup(void *data)
+{
+	struct nap *n = data;
+
+	wchan_lock(napchan);
+	n->n_done = true;
+	if (n->n_sleeping) {
+		wchan_wakethread(napchan, n->n_thread);
+	}
+	wchan_unlock(napchan);
+}
+
 /*
  * Suspend execution for n seconds.
  */
 void
 clocksleep(int num_secs)
 {
-  while (num_secs > 0) {
-    wchan_lock(lbolt);
-    wchan_sleep(lbolt);
-    num_secs--;
-  }
+	if (num_secs > 0x7fffffff / TICKS_PER_SECOND) {
+		num_secs = 0x7fffffff / TICKS_PER_SECOND;
+	}
+	if (num_secs > 0) {
+		clocknap(num_secs * TICKS_PER_SECOND);
+	}
 }
 
 /*
@@ -149,9 +336,41 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
-  while (num_ticks > 0) {
-    wchan_lock(minibolt);
-    wchan_sleep(minibolt);
-    num_ticks--;
-  }
+	struct nap n;
+
+	if (num_ticks <= 0) {
+		return;
+	}
+
+	timeout_init(&n.n_timeout, clocknap_wakeup, &n);
+	n.n_thread = curthread;
+	n.n_done = false;
+	n.n_sleeping = false;
+	timeout_add(&n.n_timeout, num_ticks);
+
+	wchan_lock(napchan);
+	if (n.n_done) {
+		wchan_unlock(napchan);
+	}
+	else {
+		n.n_sleeping = true;
+		wchan_sleep(napchan);
+	}
+}
+
+/*
+ * Suspend execution for at least the given time, rounded up to a
+ * whole number of timer ticks.
+ */
+void
+clocknanosleep(time_t secs, uint32_t nsecs)
+{
+	uint64_t usecs, ticks;
+
+	usecs = (uint64_t)secs * 1000000 + DIVROUNDUP(nsecs, 1000);
+	ticks = DIVROUNDUP(usecs, LT_GRANULARITY);
+	if (ticks > 0x7fffffff) {
+		ticks = 0x7fffffff;
+	}
+	clocknap((int)ticks);
 }
@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel log. See klog.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <wchan.h>
+#include <klog.h>
+
+#define KLOG_MAXCPUS	32	/* Most cpus System/161 supports */
+#define KLOG_SIZE	4096	/* Bytes of ring per cpu; a power of 2 */
+
+/*
+ * Each record in a ring is a header followed by kh_len bytes of
+ * text, not NUL-terminated, wrapping around the end of the ring.
+ */
+struct klog_hdr {
+	uint32_t kh_seq;		/* Roughly the order of writing */
+	uint32_t kh_len;		/* Bytes of text */
+};
+
+/*
+ * One cpu's ring. The positions run freely and are taken modulo
+ * KLOG_SIZE; kc_first <= kc_drained <= kc_head. Only the owning cpu
+ * moves kc_head and kc_first, and it never writes over anything
+ * before kc_drained, which only the current printer (under
+ * klog_takelock) moves.
+ */
+struct klog_cpu {
+	volatile unsigned kc_first;	/* Oldest record still in the ring */
+	volatile unsigned kc_drained;	/* Oldest record not yet printed */
+	volatile unsigned kc_head;	/* Where the next record goes */
+	unsigned kc_dropped;		/* Records lost to a full ring */
+	char kc_buf[KLOG_SIZE];
+};
+
+static struct klog_cpu *klog_cpus[KLOG_MAXCPUS];
+static volatile spinlock_data_t klog_seq = SPINLOCK_DATA_INITIALIZER;
+
+/* Serializes taking records off the rings. */
+static struct spinlock klog_takelock = SPINLOCK_INITIALIZER;
+
+static volatile bool klog_running;	/* The klog thread is printing */
+static volatile bool klog_panicking;	/* Don't wait for anything */
+static volatile bool klog_idle;		/* The klog thread is on klog_wchan */
+static volatile bool klog_kick;		/* Wake it at the next hardclock */
+static volatile bool klog_spacewanted;	/* Someone's on klog_spacewchan */
+static struct wchan *klog_wchan;
+static struct wchan *klog_spacewchan;
+static struct semaphore *klog_exited;
+
+void
+klog_cpu_init(struct cpu *c)
+{
+	struct klog_cpu *kc;
+
+	if (c->c_number >= KLOG_MAXCPUS) {
+		/* This cpu's kprintfs print directly. */
+		return;
+	}
+
+	kc = kmalloc(sizeof(*kc));
+	if (kc == NULL) {
+		panic("klog_cpu_init: Out of memory\n");
+	}
+	kc->kc_first = 0;
+	kc->kc_drained = 0;
+	kc->kc_head = 0;
+	kc->kc_dropped = 0;
+	klog_cpus[c->c_number] = kc;
+}
+
+/*
+ * Copy bytes into and out of a ring at POS, wrapping around.
+ */
+static
+void
+klog_copyin(struct klog_cpu *kc, unsigned pos, const void *data, size_t len)
+{
+	const char *p = data;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		kc->kc_buf[(pos + i) % KLOG_SIZE] = p[i];
+	}
+}
+
+static
+void
+klog_copyout(const struct klog_cpu *kc, unsigned pos, void *data, size_t len)
+{
+	char *p = data;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		p[i] = kc->kc_buf[(pos + i) % KLOG_SIZE];
+	}
+}
+
+/*
+ * Append a record to KC, forgetting the oldest printed records to
+ * make room. Returns false if it would have to overwrite records that
+ * haven't been printed yet. Must be called on KC's cpu with
+ * interrupts off.
+ */
+static
+bool
+klog_append(struct klog_cpu *kc, const char *text, size_t len)
+{
+	struct klog_hdr kh;
+	unsigned head = kc->kc_head;
+	unsigned reclen = sizeof(kh) + len;
+
+	if (head - kc->kc_drained + reclen > KLOG_SIZE) {
+		return false;
+	}
+	while (head - kc->kc_first + reclen > KLOG_SIZE) {
+		klog_copyout(kc, kc->kc_first, &kh, sizeof(kh));
+		kc->kc_first += sizeof(kh) + kh.kh_len;
+	}
+
+	kh.kh_seq = spinlock_data_fetchadd(&klog_seq, 1);
+	kh.kh_len = len;
+	klog_copyin(kc, head, &kh, sizeof(kh));
+	klog_copyin(kc, head + sizeof(kh), text, len);
+	kc->kc_head = head + reclen;
+	return true;
+}
+
+/*
+ * Is anything waiting to be printed?
+ */
+static
+bool
+klog_pending(void)
+{
+	struct klog_cpu *kc;
+	unsigned i;
+
+	for (i=0; i<KLOG_MAXCPUS; i++) {
+		kc = klog_cpus[i];
+		if (kc != NULL && kc->kc_drained != kc->kc_head) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Take the unprinted record with the lowest sequence number among
+ * the rings' next records, into BUF. A record whose number was taken
+ * but that isn't published yet doesn't count, so it may come out
+ * after a higher one from another cpu. Returns its length, or -1 if
+ * there's nothing to print.
+ */
+static
+int
+klog_take(char *buf)
+{
+	struct klog_cpu *kc, *best = NULL;
+	struct klog_hdr kh;
+	uint32_t bestseq = 0, bestlen = 0;
+	unsigned i;
+
+	if (!klog_panicking) {
+		spinlock_acquire(&klog_takelock);
+	}
+	for (i=0; i<KLOG_MAXCPUS; i++) {
+		kc = klog_cpus[i];
+		if (kc == NULL || kc->kc_drained == kc->kc_head) {
+			continue;
+		}
+		klog_copyout(kc, kc->kc_drained, &kh, sizeof(kh));
+		if (best == NULL || (int32_t)(kh.kh_seq - bestseq) < 0) {
+			best = kc;
+			bestseq = kh.kh_seq;
+			bestlen = kh.kh_len;
+		}
+	}
+	if (best != NULL) {
+		klog_copyout(best, best->kc_drained + sizeof(kh), buf, bestlen);
+		best->kc_drained += sizeof(kh) + bestlen;
+	}
+	if (!klog_panicking) {
+		spinlock_release(&klog_takelock);
+	}
+	return best == NULL ? -1 : (int)bestlen;
+}
+
+static
+void
+klog_print(const char *buf, int len)
+{
+	int i;
+
+	for (i=0; i<len; i++) {
+		putch(buf[i]);
+	}
+}
+
+/*
+ * Wake the klog thread if it's asleep. If we can't safely wake it
+ * from here (we might hold the run queue lock, for all we know) leave
+ * it to the next hardclock.
+ */
+static
+void
+klog_wake(bool direct)
+{
+	if (!klog_idle) {
+		return;
+	}
+	if (direct) {
+		klog_idle = false;
+		wchan_wakeone(klog_wchan);
+	}
+	else {
+		klog_kick = true;
+	}
+}
+
+void
+klog_tick(void)
+{
+	if (klog_kick) {
+		klog_kick = false;
+		klog_wake(true);
+	}
+}
+
+/*
+ * The klog thread: print records as they come in, and let in anyone
+ * waiting for room in a ring.
+ */
+static
+void
+klog_thread(void *junk1, unsigned long junk2)
+{
+	char buf[KLOG_RECMAX];
+	int len;
+
+	(void)junk1;
+	(void)junk2;
+
+	while (klog_running) {
+		len = klog_take(buf);
+		if (klog_spacewanted) {
+			/* there's room now */
+			klog_spacewanted = false;
+			wchan_wakeall(klog_spacewchan);
+		}
+		if (len >= 0) {
+			klog_print(buf, len);
+			continue;
+		}
+
+		/* as in P: check again once we can't miss a wakeup */
+		wchan_lock(klog_wchan);
+		klog_idle = true;
+		if (klog_pending() || klog_spacewanted || !klog_running) {
+			klog_idle = false;
+			wchan_unlock(klog_wchan);
+			continue;
+		}
+		wchan_sleep(klog_wchan);
+	}
+
+	V(klog_exited);
+}
+
+void
+klog_bootstrap(void)
+{
+	int result;
+
+	klog_wchan = wchan_create("klog");
+	klog_spacewchan = wchan_create("klog space");
+	klog_exited = sem_create("klog exited", 0);
+	if (klog_wchan == NULL || klog_spacewchan == NULL ||
+	    klog_exited == NULL) {
+		panic("klog_bootstrap: Out of memory\n");
+	}
+
+	klog_running = true;
+	result = thread_fork("klog", NULL, klog_thread, NULL, 0);
+	if (result) {
+		/* Keep printing synchronously. */
+		klog_running = false;
+		kprintf("klog: thread_fork: %s\n", strerror(result));
+	}
+}
+
+bool
+klog_ready(void)
+{
+	return CURCPU_EXISTS() && curcpu->c_number < KLOG_MAXCPUS &&
+		klog_cpus[curcpu->c_number] != NULL;
+}
+
+bool
+klog_async(void)
+{
+	return klog_running;
+}
+
+void
+klog_put(const char *text, size_t len)
+{
+	bool cansleep;
+	int spl;
+
+	KASSERT(len <= KLOG_RECMAX);
+	if (len == 0) {
+		return;
+	}
+
+	cansleep = !curthread->t_in_interrupt &&
+		curthread->t_iplhigh_count == 0;
+
+	spl = splhigh();
+	while (!klog_append(klog_cpus[curcpu->c_number], text, len)) {
+		splx(spl);
+		if (!klog_running) {
+			/* We're the printer; make room ourselves. */
+			klog_flush();
+		}
+		else if (!cansleep) {
+			spl = splhigh();
+			klog_cpus[curcpu->c_number]->kc_dropped++;
+			break;
+		}
+		else {
+			wchan_lock(klog_spacewchan);
+			klog_spacewanted = true;
+			klog_wake(true);
+			wchan_sleep(klog_spacewchan);
+		}
+		/* we might be on another cpu now */
+		spl = splhigh();
+	}
+	splx(spl);
+
+	if (klog_running) {
+		klog_wake(cansleep);
+	}
+}
+
+void
+klog_flush(void)
+{
+	char buf[KLOG_RECMAX];
+	int len;
+
+	while ((len = klog_take(buf)) >= 0) {
+		klog_print(buf, len);
+	}
+}
+
+void
+klog_sync(void)
+{
+	if (!klog_running) {
+		return;
+	}
+	klog_running = false;
+	wchan_wakeone(klog_wchan);
+	P(klog_exited);
+
+	/* whatever it didn't get to */
+	klog_flush();
+}
+
+void
+klog_panic(void)
+{
+	klog_panicking = true;
+	klog_running = false;
+}
+
+/*
+ * Print the whole log, oldest first, straight to the console. The
+ * owning cpus may be overwriting the oldest records as we go; if
+ * kc_first has passed a record once we've copied it, it may be torn,
+ * so skip it.
+ */
+void
+klog_dump(void)
+{
+	unsigned pos[KLOG_MAXCPUS], end[KLOG_MAXCPUS];
+	char buf[KLOG_RECMAX];
+	struct klog_cpu *kc;
+	struct klog_hdr kh;
+	uint32_t bestseq = 0, bestlen = 0;
+	unsigned i, best, dropped = 0;
+
+	for (i=0; i<KLOG_MAXCPUS; i++) {
+		kc = klog_cpus[i];
+		if (kc != NULL) {
+			end[i] = kc->kc_head;
+			pos[i] = kc->kc_first;
+			dropped += kc->kc_dropped;
+		}
+	}
+
+	for (;;) {
+		best = KLOG_MAXCPUS;
+		for (i=0; i<KLOG_MAXCPUS; i++) {
+			kc = klog_cpus[i];
+			if (kc == NULL) {
+				continue;
+			}
+			if ((int)(pos[i] - kc->kc_first) < 0) {
+				pos[i] = kc->kc_first;
+			}
+			if ((int)(end[i] - pos[i]) <= 0) {
+				continue;
+			}
+			klog_copyout(kc, pos[i], &kh, sizeof(kh));
+			if (best == KLOG_MAXCPUS ||
+			    (int32_t)(kh.kh_seq - bestseq) < 0) {
+				best = i;
+				bestseq = kh.kh_seq;
+				bestlen = kh.kh_len;
+			}
+		}
+		if (best == KLOG_MAXCPUS) {
+			break;
+		}
+
+		kc = klog_cpus[best];
+		if (bestlen <= KLOG_RECMAX) {
+			klog_copyout(kc, pos[best] + sizeof(kh), buf, bestlen);
+		}
+		if ((int)(pos[best] - kc->kc_first) < 0) {
+			/* overwritten under us; pick up at kc_first */
+			pos[best] = kc->kc_first;
+			continue;
+		}
+		KASSERT(bestlen <= KLOG_RECMAX);
+		klog_print(buf, bestlen);
+		pos[best] += sizeof(kh) + bestlen;
+	}
+
+	if (dropped > 0) {
+		kprintf("klog: %u records dropped\n", dropped);
+	}
+}
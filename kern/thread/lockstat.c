@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Lock contention profiler. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <current.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_MAXCPUS	32	/* Most cpus System/161 supports */
+#define LOCKSTAT_NRECS		128	/* (lock, call site) records per cpu */
+#define LOCKSTAT_NAMELEN	16	/* Bytes of lock name kept */
+#define LOCKSTAT_NTOP		16	/* Lines in each part of the report */
+
+/*
+ * Statistics for one lock acquired from one call site. lr_lock is
+ * NULL if the slot is free. The name is copied since the lock may be
+ * destroyed before the report is printed.
+ */
+struct lockstat_rec {
+	const void *lr_lock;
+	const void *lr_site;
+	char lr_name[LOCKSTAT_NAMELEN];	/* Empty for spinlocks */
+	unsigned lr_acquires;
+	unsigned lr_contended;
+	uint64_t lr_wait;
+	uint64_t lr_maxwait;
+	uint64_t lr_hold;
+	uint64_t lr_maxhold;
+};
+
+/*
+ * One cpu's table: an open-addressed hash of records. Only its own
+ * cpu writes it. Resetting bumps lockstat_gen; each cpu notices and
+ * clears its own table the next time it records something, so no
+ * cpu ever writes another's table.
+ */
+struct lockstat_cpu {
+	unsigned lc_gen;		/* Value of lockstat_gen last cleared at */
+	unsigned lc_dropped;		/* Events lost because the table was full */
+	struct lockstat_rec lc_recs[LOCKSTAT_NRECS];
+};
+
+static struct lockstat_cpu *lockstat_cpus[LOCKSTAT_MAXCPUS];
+static volatile unsigned lockstat_gen;
+
+static
+void
+lockstat_clear(struct lockstat_cpu *lc)
+{
+	unsigned i;
+
+	lc->lc_gen = lockstat_gen;
+	lc->lc_dropped = 0;
+	for (i=0; i<LOCKSTAT_NRECS; i++) {
+		lc->lc_recs[i].lr_lock = NULL;
+	}
+}
+
+void
+lockstat_cpu_init(struct cpu *c)
+{
+	struct lockstat_cpu *lc;
+
+	if (c->c_number >= LOCKSTAT_MAXCPUS) {
+		/* Not recorded. */
+		return;
+	}
+
+	lc = kmalloc(sizeof(*lc));
+	if (lc == NULL) {
+		panic("lockstat_cpu_init: Out of memory\n");
+	}
+	lockstat_clear(lc);
+	lockstat_cpus[c->c_number] = lc;
+}
+
+/*
+ * Find (or make) the current cpu's record for LOCK and SITE. Returns
+ * NULL if this cpu isn't recording (yet) or its table is full.
+ */
+static
+struct lockstat_rec *
+lockstat_lookup(const void *lock, const char *name, const void *site)
+{
+	struct lockstat_cpu *lc;
+	struct lockstat_rec *r;
+	unsigned h, i, j;
+
+	if (!CURCPU_EXISTS() || curcpu->c_number >= LOCKSTAT_MAXCPUS) {
+		return NULL;
+	}
+	lc = lockstat_cpus[curcpu->c_number];
+	if (lc == NULL) {
+		return NULL;
+	}
+	if (lc->lc_gen != lockstat_gen) {
+		lockstat_clear(lc);
+	}
+
+	h = ((uintptr_t)lock >> 2) * 31 + ((uintptr_t)site >> 2);
+	for (i=0; i<LOCKSTAT_NRECS; i++) {
+		r = &lc->lc_recs[(h + i) % LOCKSTAT_NRECS];
+		if (r->lr_lock == lock && r->lr_site == site) {
+			return r;
+		}
+		if (r->lr_lock == NULL) {
+			r->lr_lock = lock;
+			r->lr_site = site;
+			for (j=0; name != NULL && name[j] != 0 &&
+				     j < LOCKSTAT_NAMELEN - 1; j++) {
+				r->lr_name[j] = name[j];
+			}
+			r->lr_name[j] = 0;
+			r->lr_acquires = r->lr_contended = 0;
+			r->lr_wait = r->lr_maxwait = 0;
+			r->lr_hold = r->lr_maxhold = 0;
+			return r;
+		}
+	}
+
+	lc->lc_dropped++;
+	return NULL;
+}
+
+void
+lockstat_acquired(const void *lock, const char *name, const void *site,
+		  bool contended, uint64_t waitns)
+{
+	struct lockstat_rec *r;
+
+	r = lockstat_lookup(lock, name, site);
+	if (r == NULL) {
+		return;
+	}
+	r->lr_acquires++;
+	if (contended) {
+		r->lr_contended++;
+		r->lr_wait += waitns;
+		if (waitns > r->lr_maxwait) {
+			r->lr_maxwait = waitns;
+		}
+	}
+}
+
+void
+lockstat_released(const void *lock, const char *name, const void *site,
+		  uint64_t holdns)
+{
+	struct lockstat_rec *r;
+
+	r = lockstat_lookup(lock, name, site);
+	if (r == NULL) {
+		return;
+	}
+	r->lr_hold += holdns;
+	if (holdns > r->lr_maxhold) {
+		r->lr_maxhold = holdns;
+	}
+}
+
+/*
+ * Add R into the array ALL (of *NUM entries), combining it with any
+ * entry for the same lock, and for the same call site too if BYSITE.
+ */
+static
+void
+lockstat_merge(struct lockstat_rec *all, unsigned *num,
+	       const struct lockstat_rec *r, bool bysite)
+{
+	struct lockstat_rec *a;
+	unsigned i;
+
+	for (i=0; i<*num; i++) {
+		a = &all[i];
+		if (a->lr_lock == r->lr_lock &&
+		    (!bysite || a->lr_site == r->lr_site)) {
+			a->lr_acquires += r->lr_acquires;
+			a->lr_contended += r->lr_contended;
+			a->lr_wait += r->lr_wait;
+			a->lr_hold += r->lr_hold;
+			if (r->lr_maxwait > a->lr_maxwait) {
+				a->lr_maxwait = r->lr_maxwait;
+			}
+			if (r->lr_maxhold > a->lr_maxhold) {
+				a->lr_maxhold = r->lr_maxhold;
+			}
+			return;
+		}
+	}
+	all[(*num)++] = *r;
+	if (!bysite) {
+		all[*num - 1].lr_site = NULL;
+	}
+}
+
+/*
+ * Move the LOCKSTAT_NTOP entries with the most total wait time (then
+ * the most contended acquires) to the front of ALL, in order.
+ */
+static
+unsigned
+lockstat_top(struct lockstat_rec *all, unsigned num)
+{
+	struct lockstat_rec tmp;
+	unsigned i, j, best;
+
+	for (i=0; i<num && i<LOCKSTAT_NTOP; i++) {
+		best = i;
+		for (j=i+1; j<num; j++) {
+			if (all[j].lr_wait > all[best].lr_wait ||
+			    (all[j].lr_wait == all[best].lr_wait &&
+			     all[j].lr_contended > all[best].lr_contended)) {
+				best = j;
+			}
+		}
+		tmp = all[i];
+		all[i] = all[best];
+		all[best] = tmp;
+	}
+	return i;
+}
+
+static
+const char *
+lockstat_name(const struct lockstat_rec *r)
+{
+	return r->lr_name[0] != 0 ? r->lr_name : "(spinlock)";
+}
+
+/*
+ * Print the report. The other cpus keep recording while we read
+ * their tables, so the numbers may be a little inconsistent; that's
+ * fine for this purpose.
+ */
+void
+lockstat_report(void)
+{
+	struct lockstat_rec *sites, *locks;
+	struct lockstat_cpu *lc;
+	unsigned nsites, nlocks, ncpus, dropped, i, j, n;
+
+	ncpus = 0;
+	for (i=0; i<LOCKSTAT_MAXCPUS; i++) {
+		if (lockstat_cpus[i] != NULL) {
+			ncpus++;
+		}
+	}
+	sites = kmalloc(ncpus * LOCKSTAT_NRECS * sizeof(*sites));
+	locks = kmalloc(ncpus * LOCKSTAT_NRECS * sizeof(*locks));
+	if (sites == NULL || locks == NULL) {
+		kfree(sites);
+		kfree(locks);
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+
+	nsites = nlocks = dropped = 0;
+	for (i=0; i<LOCKSTAT_MAXCPUS; i++) {
+		lc = lockstat_cpus[i];
+		if (lc == NULL || lc->lc_gen != lockstat_gen) {
+			continue;
+		}
+		dropped += lc->lc_dropped;
+		for (j=0; j<LOCKSTAT_NRECS; j++) {
+			if (lc->lc_recs[j].lr_lock == NULL) {
+				continue;
+			}
+			lockstat_merge(sites, &nsites, &lc->lc_recs[j], true);
+			lockstat_merge(locks, &nlocks, &lc->lc_recs[j], false);
+		}
+	}
+
+	kprintf("Most contended locks (times in us):\n");
+	kprintf("%-10s %-16s %8s %8s %10s %8s %10s %8s\n", "LOCK", "NAME",
+		"ACQ", "CONT", "WAIT", "MAXWAIT", "HOLD", "MAXHOLD");
+	n = lockstat_top(locks, nlocks);
+	for (i=0; i<n; i++) {
+		kprintf("%-10p %-16s %8u %8u %10llu %8llu %10llu %8llu\n",
+			locks[i].lr_lock, lockstat_name(&locks[i]),
+			locks[i].lr_acquires, locks[i].lr_contended,
+			locks[i].lr_wait / 1000, locks[i].lr_maxwait / 1000,
+			locks[i].lr_hold / 1000, locks[i].lr_maxhold / 1000);
+	}
+
+	kprintf("\nMost contended call sites:\n");
+	kprintf("%-10s %-10s %-16s %8s %8s %10s\n", "SITE", "LOCK", "NAME",
+		"ACQ", "CONT", "WAIT");
+	n = lockstat_top(sites, nsites);
+	for (i=0; i<n && sites[i].lr_contended > 0; i++) {
+		kprintf("%-10p %-10p %-16s %8u %8u %10llu\n",
+			sites[i].lr_site, sites[i].lr_lock,
+			lockstat_name(&sites[i]), sites[i].lr_acquires,
+			sites[i].lr_contended, sites[i].lr_wait / 1000);
+	}
+
+	if (dropped > 0) {
+		kprintf("\n%u events not recorded (tables full)\n", dropped);
+	}
+
+	kfree(sites);
+	kfree(locks);
+}
+
+void
+lockstat_reset(void)
+{
+	lockstat_gen++;
+}
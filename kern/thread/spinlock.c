@@ -36,6 +36,8 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <current.h>	/* for curcpu */
+#include <clock.h>
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -48,8 +50,13 @@
 void
 spinlock_init(struct spinlock *lk)
 {
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_serving, 0);
 	lk->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lk->lk_site = NULL;
+	lk->lk_stamp = 0;
+#endif
 }
 
 /*
@@ -59,7 +66,8 @@ void
 spinlock_cleanup(struct spinlock *lk)
 {
 	KASSERT(lk->lk_holder == NULL);
-	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_serving));
 }
 
 /*
@@ -67,12 +75,17 @@ spinlock_cleanup(struct spinlock *lk)
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
  * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * atomic operation to take a ticket and wait for our turn.
  */
 void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket;
+	unsigned spins;
+#if OPT_LOCKSTAT
+	uint64_t start = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -87,27 +100,37 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
-			continue;
-		}
-		break;
+	/*
+	 * Fetch-and-add is a machine-level atomic operation, so
+	 * every CPU gets a different ticket. Then we only read
+	 * while waiting; the holder moves lk_serving along when it
+	 * releases. (Tickets wrap around, which is fine since we only
+	 * compare for equality.)
+	 */
+	ticket = spinlock_data_fetchadd(&lk->lk_next, 1);
+	spins = 0;
+#if OPT_LOCKSTAT
+	if (spinlock_data_get(&lk->lk_serving) != ticket) {
+		start = gettime_ns();
+	}
+#endif
+	while (spinlock_data_get(&lk->lk_serving) != ticket) {
+		spins++;
+	}
+
+	if (mycpu != NULL && spins > 0) {
+		mycpu->c_spinlock_waits++;
+		mycpu->c_spinlock_spins += spins;
 	}
 
 	lk->lk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	lk->lk_site = __builtin_return_address(0);
+	lk->lk_stamp = gettime_ns();
+	lockstat_acquired(lk, NULL, lk->lk_site, spins > 0,
+			  lk->lk_stamp - start);
+#endif
 }
 
 /*
@@ -121,8 +144,14 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_released(lk, NULL, lk->lk_site, gettime_ns() - lk->lk_stamp);
+#endif
+
 	lk->lk_holder = NULL;
-	spinlock_data_set(&lk->lk_lock, 0);
+	/* Only the holder writes lk_serving, so this needn't be atomic. */
+	spinlock_data_set(&lk->lk_serving,
+			  spinlock_data_get(&lk->lk_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -37,8 +37,11 @@
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
+#include <cpu.h>
 #include <current.h>
 #include <synch.h>
+#include <clock.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -173,6 +176,12 @@ lock_create(const char *name){
         
         lock->owner = NULL;
         lock->held = false;
+        lock->lk_nsleepers = 0;
+        lock->lk_handoff = false;
+#if OPT_LOCKSTAT
+        lock->lk_site = NULL;
+        lock->lk_stamp = 0;
+#endif
 
         return lock;
 }
@@ -189,21 +198,98 @@ lock_destroy(struct lock *lock){
         kfree(lock);
 }
 
+/*
+ * Locks are adaptive: a thread that finds the lock held spins as long
+ * as the owner is actually running on another cpu, on the theory that
+ * it'll be done shortly and that's cheaper than two context switches.
+ * If the owner isn't running (or we've spun for LOCK_SPIN_MAX rounds)
+ * we go to sleep, and lock_release hands the lock directly to the
+ * thread it wakes so nobody can barge in ahead of it.
+ */
+#define LOCK_SPIN_MAX 5000
+#define LOCK_SPIN_CHECK 50	/* spins between looks at the owner */
+
+/*
+ * Is OWNER still holding LOCK and running on another cpu? The caller
+ * holds the lock's spinlock, so OWNER can't release the lock, and
+ * thus can't exit and be freed, while we look at it. The owner's
+ * state and cpu change under us anyway, so they're read through
+ * volatile. Note that an idle cpu still has its last thread as
+ * c_curthread, hence the t_state check.
+ */
+static
+bool
+lock_owner_running(struct lock *lock, struct thread *owner)
+{
+        struct cpu *c;
+
+        KASSERT(spinlock_do_i_hold(&lock->spin));
+        if (lock->owner != owner) {
+                return false;
+        }
+        c = *(struct cpu *volatile *)&owner->t_cpu;
+        return c != curcpu &&
+                *(volatile threadstate_t *)&owner->t_state == S_RUN &&
+                *(struct thread *volatile *)&c->c_curthread == owner;
+}
+
 void
 lock_acquire(struct lock *lock){
-        KASSERT(!lock_do_i_hold(lock));
+        struct thread *owner;
+        unsigned spins, i;
+#if OPT_LOCKSTAT
+        bool contended;
+        uint64_t start = 0;
+#endif
+
         KASSERT(lock != NULL);
+        KASSERT(!lock_do_i_hold(lock));
         spinlock_acquire(&lock->spin);
+#if OPT_LOCKSTAT
+        contended = lock->held;
+        if (contended) {
+                start = gettime_ns();
+        }
+#endif
 
+        spins = 0;
         while(lock->held){
+            owner = lock->owner;
+            if (owner != NULL && spins < LOCK_SPIN_MAX &&
+                lock_owner_running(lock, owner)) {
+                /*
+                 * Spin a while watching only the lock, which can't
+                 * go away; then recheck the owner under the spinlock.
+                 */
+                spinlock_release(&lock->spin);
+                for (i = 0; i < LOCK_SPIN_CHECK &&
+                       *(struct thread *volatile *)&lock->owner == owner;
+                     i++) {
+                    spins++;
+                }
+                spinlock_acquire(&lock->spin);
+                continue;
+            }
+
+            /* Sleep; lock_release passes the lock to us directly. */
+            lock->lk_nsleepers++;
             wchan_lock(lock->lock_wchan);
             spinlock_release(&lock->spin);
             wchan_sleep(lock->lock_wchan);
             spinlock_acquire(&lock->spin);
+            KASSERT(lock->held && lock->lk_handoff);
+            lock->lk_handoff = false;
+            break;
         }
 
             lock->held = true;
             lock->owner = curthread;
+#if OPT_LOCKSTAT
+            lock->lk_site = __builtin_return_address(0);
+            lock->lk_stamp = gettime_ns();
+            lockstat_acquired(lock, lock->lk_name, lock->lk_site,
+                              contended, lock->lk_stamp - start);
+#endif
         spinlock_release(&lock->spin);
 }
 
@@ -211,9 +297,20 @@ void
 lock_release(struct lock *lock){
         KASSERT(lock_do_i_hold(lock));
         spinlock_acquire(&lock->spin);
-            lock->held = false;
+#if OPT_LOCKSTAT
+            lockstat_released(lock, lock->lk_name, lock->lk_site,
+                              gettime_ns() - lock->lk_stamp);
+#endif
             lock->owner = NULL;
-            wchan_wakeone(lock->lock_wchan);
+            if (lock->lk_nsleepers > 0) {
+                /* Leave it held and hand it to the thread we wake. */
+                lock->lk_nsleepers--;
+                lock->lk_handoff = true;
+                wchan_wakeone(lock->lock_wchan);
+            }
+            else {
+                lock->held = false;
+            }
         spinlock_release(&lock->spin);
 
 }
@@ -289,3 +386,264 @@ cv_broadcast(struct cv *cv, struct lock *lock)
     KASSERT(lock_do_i_hold(lock));
     wchan_wakeall(cv->cv_wchan);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rw;
+
+        rw = kmalloc(sizeof(struct rwlock));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rwlock_name = kstrdup(name);
+        if (rw->rwlock_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_readchan = wchan_create(rw->rwlock_name);
+        if (rw->rw_readchan == NULL) {
+                kfree(rw->rwlock_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_writechan = wchan_create(rw->rwlock_name);
+        if (rw->rw_writechan == NULL) {
+                wchan_destroy(rw->rw_readchan);
+                kfree(rw->rwlock_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        spinlock_init(&rw->rw_spin);
+        rw->rw_readers = 0;
+        rw->rw_waitreaders = 0;
+        rw->rw_waitwriters = 0;
+        rw->rw_writer = NULL;
+        rw->rw_upgrader = NULL;
+
+        return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_readers == 0);
+        KASSERT(rw->rw_writer == NULL);
+        KASSERT(rw->rw_waitreaders == 0 && rw->rw_waitwriters == 0);
+
+        spinlock_cleanup(&rw->rw_spin);
+        wchan_destroy(rw->rw_readchan);
+        wchan_destroy(rw->rw_writechan);
+
+        kfree(rw->rwlock_name);
+        kfree(rw);
+}
+
+/*
+ * Can a new reader get in? Not if there's a writer, or anyone waiting
+ * to write (writer preference). Call with rw_spin held.
+ */
+static
+bool
+rwlock_readable(struct rwlock *rw)
+{
+        return rw->rw_writer == NULL && rw->rw_waitwriters == 0 &&
+                rw->rw_upgrader == NULL;
+}
+
+/*
+ * Sleep on WC, dropping rw_spin while asleep. Call with rw_spin held.
+ */
+static
+void
+rwlock_sleep(struct rwlock *rw, struct wchan *wc)
+{
+        wchan_lock(wc);
+        spinlock_release(&rw->rw_spin);
+        wchan_sleep(wc);
+        spinlock_acquire(&rw->rw_spin);
+}
+
+/*
+ * The lock has become free (no readers or writer): let in a waiting
+ * writer if there is one, otherwise all the waiting readers. Call
+ * with rw_spin held.
+ */
+static
+void
+rwlock_wakeup(struct rwlock *rw)
+{
+        if (rw->rw_waitwriters > 0) {
+                wchan_wakeone(rw->rw_writechan);
+        }
+        else if (rw->rw_waitreaders > 0) {
+                wchan_wakeall(rw->rw_readchan);
+        }
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+        KASSERT(!rwlock_do_i_hold_write(rw));
+
+        spinlock_acquire(&rw->rw_spin);
+        while (!rwlock_readable(rw)) {
+                rw->rw_waitreaders++;
+                rwlock_sleep(rw, rw->rw_readchan);
+                rw->rw_waitreaders--;
+        }
+        rw->rw_readers++;
+        spinlock_release(&rw->rw_spin);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_spin);
+        KASSERT(rw->rw_readers > 0);
+        rw->rw_readers--;
+        if (rw->rw_upgrader != NULL && rw->rw_readers == 1) {
+                /*
+                 * Only the upgrader is left; let it go ahead. It took
+                 * the wchan lock before dropping rw_spin, so once we
+                 * have that lock it's on the sleep list.
+                 */
+                wchan_lock(rw->rw_writechan);
+                wchan_wakethread(rw->rw_writechan, rw->rw_upgrader);
+                wchan_unlock(rw->rw_writechan);
+        }
+        else if (rw->rw_readers == 0) {
+                rwlock_wakeup(rw);
+        }
+        spinlock_release(&rw->rw_spin);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+        KASSERT(!rwlock_do_i_hold_write(rw));
+
+        spinlock_acquire(&rw->rw_spin);
+        while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+                rw->rw_waitwriters++;
+                rwlock_sleep(rw, rw->rw_writechan);
+                rw->rw_waitwriters--;
+        }
+        rw->rw_writer = curthread;
+        spinlock_release(&rw->rw_spin);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_spin);
+        KASSERT(rw->rw_writer == curthread);
+        rw->rw_writer = NULL;
+        rwlock_wakeup(rw);
+        spinlock_release(&rw->rw_spin);
+}
+
+bool
+rwlock_tryacquire_read(struct rwlock *rw)
+{
+        bool ret;
+
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_spin);
+        ret = rwlock_readable(rw);
+        if (ret) {
+                rw->rw_readers++;
+        }
+        spinlock_release(&rw->rw_spin);
+
+        return ret;
+}
+
+bool
+rwlock_tryacquire_write(struct rwlock *rw)
+{
+        bool ret;
+
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_spin);
+        ret = rw->rw_writer == NULL && rw->rw_readers == 0;
+        if (ret) {
+                rw->rw_writer = curthread;
+        }
+        spinlock_release(&rw->rw_spin);
+
+        return ret;
+}
+
+bool
+rwlock_upgrade(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&rw->rw_spin);
+        KASSERT(rw->rw_readers > 0);
+        if (rw->rw_upgrader != NULL) {
+                /* Two upgraders would wait for each other forever. */
+                spinlock_release(&rw->rw_spin);
+                return false;
+        }
+
+        /*
+         * Setting rw_upgrader keeps new readers out; the last other
+         * reader to leave wakes us directly. Writers can't have got
+         * in while we hold a read hold.
+         */
+        rw->rw_upgrader = curthread;
+        while (rw->rw_readers > 1) {
+                rwlock_sleep(rw, rw->rw_writechan);
+        }
+        KASSERT(rw->rw_writer == NULL);
+        rw->rw_upgrader = NULL;
+        rw->rw_readers = 0;
+        rw->rw_writer = curthread;
+        spinlock_release(&rw->rw_spin);
+
+        return true;
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_spin);
+        KASSERT(rw->rw_writer == curthread);
+        rw->rw_writer = NULL;
+        rw->rw_readers = 1;
+        /* Other readers can join us unless a writer is waiting. */
+        if (rw->rw_waitwriters == 0 && rw->rw_waitreaders > 0) {
+                wchan_wakeall(rw->rw_readchan);
+        }
+        spinlock_release(&rw->rw_spin);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+        return rw->rw_writer == curthread;
+}
@@ -49,7 +49,11 @@
 #include <synch.h>
 #include <addrspace.h>
 #include <mainbus.h>
+#include <clock.h>
 #include <vnode.h>
+#include <lockstat.h>
+#include <klog.h>
+#include <syscallstat.h>
 
 #include "opt-synchprobs.h"
 
@@ -72,6 +76,17 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/*
+ * Cpu placement tunables; see thread_wakeup_cpu() and
+ * thread_consider_migration().
+ */
+uint64_t thread_migration_cost = 1000000;	/* 1 ms */
+bool thread_wake_affine = true;
+
+/* Every thread in the system, for thread_printstats(). */
+static struct threadarray allthreads;
+static struct spinlock allthreads_lock = SPINLOCK_INITIALIZER;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -120,6 +135,7 @@ struct thread *
 thread_create(const char *name)
 {
 	struct thread *thread;
+	int result;
 
 	DEBUGASSERT(name != NULL);
 
@@ -149,8 +165,31 @@ thread_create(const char *name)
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Scheduler accounting fields */
+	thread->t_runtime = 0;
+	thread->t_waittime = 0;
+	thread->t_stamp = gettime_ns();
+	thread->t_nvcsw = 0;
+	thread->t_nivcsw = 0;
+	thread->t_woken = false;
+
+	/* Cpu placement fields */
+	thread->t_lastran = thread->t_stamp;
+	thread->t_migrations = 0;
+
 	/* If you add to struct thread, be sure to initialize here */
 
+	spinlock_acquire(&allthreads_lock);
+	result = threadarray_add(&allthreads, thread, NULL);
+	spinlock_release(&allthreads_lock);
+	if (result) {
+		threadlistnode_cleanup(&thread->t_listnode);
+		thread_machdep_cleanup(&thread->t_machdep);
+		kfree(thread->t_name);
+		kfree(thread);
+		return NULL;
+	}
+
 	return thread;
 }
 
@@ -167,6 +206,7 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -180,10 +220,18 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_switches = 0;
+	c->c_spinlock_waits = 0;
+	c->c_spinlock_spins = 0;
+	for (i=0; i<CPU_WAKELAT_BUCKETS; i++) {
+		c->c_wakelat[i] = 0;
+	}
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	c->c_wake_migrations = 0;
+	c->c_lb_migrations = 0;
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -194,6 +242,14 @@ cpu_create(unsigned hardware_number)
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_cpu_init(c);
+#endif
+	klog_cpu_init(c);
+#if OPT_SYSCALLSTAT
+	syscallstat_cpu_init(c);
+#endif
+
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
 	if (c->c_curthread == NULL) {
@@ -239,9 +295,21 @@ static
 void
 thread_destroy(struct thread *thread)
 {
+	unsigned i, num;
+
 	KASSERT(thread != curthread);
 	KASSERT(thread->t_state != S_RUN);
 
+	spinlock_acquire(&allthreads_lock);
+	num = threadarray_num(&allthreads);
+	for (i=0; i<num; i++) {
+		if (threadarray_get(&allthreads, i) == thread) {
+			threadarray_remove(&allthreads, i);
+			break;
+		}
+	}
+	spinlock_release(&allthreads_lock);
+
 	/*
 	 * If you add things to struct thread, be sure to clean them up
 	 * either here or in thread_exit(). (And not both...)
@@ -350,6 +418,7 @@ thread_bootstrap(void)
 	struct thread *bootthread;
 
 	cpuarray_init(&allcpus);
+	threadarray_init(&allthreads);
 
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
@@ -426,21 +495,92 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Choose a cpu for a thread that is being woken up.
+ *
+ * The thread's previous cpu is preferred if it's idle, since it can
+ * run the thread right away with whatever cache state is left. If the
+ * waker's cpu is idle (we're in an interrupt handler that woke it
+ * from the idle loop) go there instead. Otherwise both cpus are busy:
+ * a thread that ran within thread_migration_cost is cache-hot and
+ * only moves if its old cpu's run queue is clearly longer; a cold
+ * thread goes to the waker's cpu unless that queue is longer. The
+ * latter is the case that matters for producer/consumer pairs, where
+ * the waker is usually about to block and leave its cpu free.
+ *
+ * The queue lengths are read without locking; this is a heuristic and
+ * a stale value just means a slightly worse choice.
+ */
+static
+struct cpu *
+thread_wakeup_cpu(struct thread *target, uint64_t now)
+{
+	struct cpu *prev, *waker;
+
+	prev = target->t_cpu;
+	waker = curcpu->c_self;
+
+	if (!thread_wake_affine || prev == waker || prev->c_isidle) {
+		return prev;
+	}
+	if (waker->c_isidle) {
+		return waker;
+	}
+	if (now - target->t_lastran < thread_migration_cost) {
+		if (waker->c_runqueue.tl_count + 1 <
+		    prev->c_runqueue.tl_count) {
+			return waker;
+		}
+		return prev;
+	}
+	if (waker->c_runqueue.tl_count <= prev->c_runqueue.tl_count) {
+		return waker;
+	}
+	return prev;
+}
+
 /*
  * Make a thread runnable.
  *
  * targetcpu might be curcpu; it might not be, too. 
+ *
+ * If the thread is being woken up (and we don't already hold a run
+ * queue lock) it may be moved to a different cpu; see
+ * thread_wakeup_cpu().
  */
 static
 void
 thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 	struct cpu *targetcpu;
+	uint64_t now;
 	bool isidle;
 
-	/* Lock the run queue of the target thread's cpu. */
+	now = gettime_ns();
 	targetcpu = target->t_cpu;
 
+	if (!already_have_lock && target->t_state == S_SLEEP) {
+		targetcpu = thread_wakeup_cpu(target, now);
+		if (targetcpu != target->t_cpu) {
+			/*
+			 * A thread that has just gone to sleep remains
+			 * curthread on its old cpu until that cpu has
+			 * finished switching away from it (or for as
+			 * long as the cpu idles on its stack). The old
+			 * cpu holds its run queue lock until then, so
+			 * check under that lock. Once it isn't curthread
+			 * it can't become so again behind our back,
+			 * because nobody else can reach it now.
+			 */
+			spinlock_acquire(&target->t_cpu->c_runqueue_lock);
+			if (target->t_cpu->c_curthread == target) {
+				targetcpu = target->t_cpu;
+			}
+			spinlock_release(&target->t_cpu->c_runqueue_lock);
+		}
+	}
+
+	/* Lock the run queue of the chosen cpu. */
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
@@ -449,6 +589,16 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	if (targetcpu != target->t_cpu) {
+		target->t_cpu = targetcpu;
+		target->t_migrations++;
+		targetcpu->c_wake_migrations++;
+	}
+
+	/* Start the runnable-wait clock; note if this is a wakeup. */
+	target->t_woken = (target->t_state == S_SLEEP);
+	target->t_stamp = now;
+
 	isidle = targetcpu->c_isidle;
 	threadlist_addtail(&targetcpu->c_runqueue, target);
 	if (isidle) {
@@ -534,6 +684,29 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Record a wakeup-to-run latency of NSECS nanoseconds in the current
+ * cpu's histogram. Called with the run queue locked.
+ */
+static
+void
+thread_wakelat_record(uint64_t nsecs)
+{
+	uint32_t usecs;
+	unsigned bucket;
+
+	if (nsecs >= (uint64_t)1000 << (CPU_WAKELAT_BUCKETS - 1)) {
+		bucket = CPU_WAKELAT_BUCKETS - 1;
+	}
+	else {
+		usecs = (uint32_t)nsecs / 1000;
+		for (bucket = 0; usecs > 1; bucket++) {
+			usecs >>= 1;
+		}
+	}
+	curcpu->c_wakelat[bucket]++;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -548,6 +721,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc)
 {
 	struct thread *cur, *next;
+	uint64_t now;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -580,6 +754,21 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		return;
 	}
 
+	/*
+	 * Charge the current thread for the time it just ran. Going
+	 * to sleep is a voluntary switch; so is an explicit yield,
+	 * but being preempted from the timer interrupt is not.
+	 */
+	now = gettime_ns();
+	cur->t_runtime += now - cur->t_stamp;
+	cur->t_lastran = now;
+	if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_nivcsw++;
+	}
+	else if (newstate != S_ZOMBIE) {
+		cur->t_nvcsw++;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -641,6 +830,20 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/*
+	 * Charge the next thread for the time it spent waiting on the
+	 * run queue, and if it got there by being woken up, record
+	 * how long that took in this cpu's latency histogram.
+	 */
+	now = gettime_ns();
+	next->t_waittime += now - next->t_stamp;
+	if (next->t_woken) {
+		thread_wakelat_record(now - next->t_stamp);
+		next->t_woken = false;
+	}
+	next->t_stamp = now;
+	curcpu->c_switches++;
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -848,9 +1051,11 @@ schedule(void)
  * and the performance loss due to underutilization of some CPUs is
  * something that needs to be tuned and probably is workload-specific.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * System/161 does not (yet) model such cache effects, but real
+ * machines do, so threads that last ran less than
+ * thread_migration_cost ago are treated as cache-hot and left where
+ * they are; only cold threads are moved. Setting the cost to 0 gets
+ * back the old, very aggressive behavior.
  */
 void
 thread_consider_migration(void)
@@ -858,8 +1063,9 @@ thread_consider_migration(void)
 	unsigned my_count, total_count, one_share, to_send;
 	unsigned i, numcpus;
 	struct cpu *c;
-	struct threadlist victims;
+	struct threadlist victims, keep;
 	struct thread *t;
+	uint64_t now;
 
 	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
@@ -880,12 +1086,46 @@ thread_consider_migration(void)
 
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
+	threadlist_init(&keep);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
+	now = gettime_ns();
+
+	/*
+	 * Pick victims from the tail of the run queue, skipping
+	 * cache-hot threads, and put the ones we skip back in their
+	 * original order.
+	 *
+	 * Ordinarily, curthread will not appear on the run queue.
+	 * However, it can under the following circumstances:
+	 *   - it went to sleep;
+	 *   - the processor became idle, so it remained curthread;
+	 *   - it was reawakened, so it was put on the run queue;
+	 *   - and the processor hasn't fully unidled yet, so all
+	 *     these things are still true.
+	 *
+	 * If the timer interrupt happens at (almost) exactly the
+	 * proper moment, we can come here while things are in this
+	 * state and see curthread. However, *migrating* curthread can
+	 * cause bad things to happen (Exercise: Why? And what?) so
+	 * always keep it.
+	 */
+	my_count = curcpu->c_runqueue.tl_count;
+	for (i=0; i<my_count && victims.tl_count < to_send; i++) {
 		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+		if (t == curthread ||
+		    now - t->t_lastran < thread_migration_cost) {
+			threadlist_addhead(&keep, t);
+		}
+		else {
+			threadlist_addhead(&victims, t);
+		}
+	}
+	while ((t = threadlist_remhead(&keep)) != NULL) {
+		threadlist_addtail(&curcpu->c_runqueue, t);
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
+	threadlist_cleanup(&keep);
+	to_send = victims.tl_count;
 
 	for (i=0; i < numcpus && to_send > 0; i++) {
 		c = cpuarray_get(&allcpus, i);
@@ -895,35 +1135,9 @@ thread_consider_migration(void)
 		spinlock_acquire(&c->c_runqueue_lock);
 		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
 			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
 			t->t_cpu = c;
+			t->t_migrations++;
+			c->c_lb_migrations++;
 			threadlist_addtail(&c->c_runqueue, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
@@ -957,6 +1171,132 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+/*
+ * Print the cpu placement settings and how many threads have been
+ * moved onto each cpu, by wakeup placement and by load balancing.
+ */
+void
+thread_printmigration(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	kprintf("migration cost: %llu us, wake affine: %s\n",
+		(unsigned long long)(thread_migration_cost / 1000),
+		thread_wake_affine ? "on" : "off");
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("cpu%u: %u woken here, %u balanced here\n",
+			c->c_number, c->c_wake_migrations,
+			c->c_lb_migrations);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Scheduler statistics.
+ */
+
+/* Snapshot of one thread's accounting, taken for printing. */
+struct threadstat {
+	char ts_name[24];
+	threadstate_t ts_state;
+	unsigned ts_cpu;
+	uint64_t ts_runtime;
+	uint64_t ts_waittime;
+	unsigned ts_nvcsw;
+	unsigned ts_nivcsw;
+	unsigned ts_migrations;
+};
+
+static const char *const threadstate_names[] = {
+	"run", "ready", "sleep", "zombie",
+};
+
+/*
+ * Print a ps-like listing of all threads with their run time, time
+ * spent waiting to run, and voluntary/involuntary switch counts,
+ * followed by each cpu's wakeup-to-run latency histogram.
+ *
+ * kprintf can sleep, so we can't print while holding the spinlock;
+ * copy everything out first. The numbers are only approximate anyway
+ * because the threads keep running while we look.
+ */
+void
+thread_printstats(void)
+{
+	struct threadstat *stats;
+	struct thread *t;
+	struct cpu *c;
+	unsigned i, j, num, max;
+
+	spinlock_acquire(&allthreads_lock);
+	max = threadarray_num(&allthreads) + 8;
+	spinlock_release(&allthreads_lock);
+
+	stats = kmalloc(max * sizeof(*stats));
+	if (stats == NULL) {
+		kprintf("thread_printstats: Out of memory\n");
+		return;
+	}
+
+	spinlock_acquire(&allthreads_lock);
+	num = threadarray_num(&allthreads);
+	if (num > max) {
+		num = max;
+	}
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&allthreads, i);
+		snprintf(stats[i].ts_name, sizeof(stats[i].ts_name), "%s",
+			 t->t_name);
+		stats[i].ts_state = t->t_state;
+		stats[i].ts_cpu = t->t_cpu != NULL ? t->t_cpu->c_number : 0;
+		stats[i].ts_runtime = t->t_runtime;
+		stats[i].ts_waittime = t->t_waittime;
+		stats[i].ts_nvcsw = t->t_nvcsw;
+		stats[i].ts_nivcsw = t->t_nivcsw;
+		stats[i].ts_migrations = t->t_migrations;
+	}
+	spinlock_release(&allthreads_lock);
+
+	kprintf("%-24s %-6s %3s %12s %12s %8s %8s %6s\n", "THREAD",
+		"STATE", "CPU", "RUN(us)", "WAIT(us)", "VCSW", "IVCSW",
+		"MIGR");
+	for (i=0; i<num; i++) {
+		kprintf("%-24s %-6s %3u %12llu %12llu %8u %8u %6u\n",
+			stats[i].ts_name,
+			threadstate_names[stats[i].ts_state],
+			stats[i].ts_cpu,
+			(unsigned long long)(stats[i].ts_runtime / 1000),
+			(unsigned long long)(stats[i].ts_waittime / 1000),
+			stats[i].ts_nvcsw, stats[i].ts_nivcsw,
+			stats[i].ts_migrations);
+	}
+	kfree(stats);
+
+	kprintf("\nWakeup-to-run latency (us):\n");
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("cpu%u: %u switches, %u spinlock waits "
+			"(%llu spins)\n", c->c_number, c->c_switches,
+			c->c_spinlock_waits, c->c_spinlock_spins);
+		for (j=0; j<CPU_WAKELAT_BUCKETS; j++) {
+			if (c->c_wakelat[j] == 0) {
+				continue;
+			}
+			if (j == CPU_WAKELAT_BUCKETS - 1) {
+				kprintf("    >= %-8u %u\n", 1U << j,
+					c->c_wakelat[j]);
+			}
+			else {
+				kprintf("    <  %-8u %u\n", 2U << j,
+					c->c_wakelat[j]);
+			}
+		}
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1090,6 +1430,21 @@ wchan_wakeall(struct wchan *wc)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up one particular thread sleeping on a wait channel. The
+ * channel must be locked.
+ */
+void
+wchan_wakethread(struct wchan *wc, struct thread *t)
+{
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+	/* (t_state may still be S_RUN if T is mid-switch on another cpu) */
+	KASSERT(t->t_wchan_name == wc->wc_name);
+
+	threadlist_remove(&wc->wc_threads, t);
+	thread_make_runnable(t, false);
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -36,6 +36,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <uio.h>
@@ -229,6 +230,23 @@ dev_tryseek(struct vnode *v, off_t pos)
 	return 0;
 }
 
+/*
+ * Called for poll(). Pass through if the device can block; otherwise
+ * it's always ready.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct pollentry *pe, int *revents)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_poll == NULL) {
+		*revents = events & (POLLIN | POLLOUT);
+		return 0;
+	}
+	return d->d_poll(d, events, pe, revents);
+}
+
 /*
  * For fsync() - meaningless, do nothing.
  */
@@ -426,6 +444,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	dev_stat,
 	dev_gettype,
 	dev_tryseek,
+	dev_poll,
 	null_fsync,
 	dev_mmap,
 	dev_truncate,
@@ -0,0 +1,589 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Anonymous pipes. See pipe.h.
+ *
+ * A pipe is a one-page ring buffer and two vnodes, one for each end,
+ * that share it. The vnodes belong to no file system; they live in
+ * the pipe, which goes away when both have been reclaimed.
+ *
+ * When a reader finds the pipe empty, it leaves its uio in pi_rdwait
+ * before going to sleep, and the next writer copies straight from its
+ * own buffer into the reader's instead of through the ring. The
+ * reader's buffer is in another address space, so this needs the VM
+ * system to find it for us (as_kvaddr); when it can't, the data goes
+ * through the ring as usual.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/poll.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <addrspace.h>
+#include <vnode.h>
+#include <limits.h>
+#include <poll.h>
+#include <pipe.h>
+
+#define PIPE_SIZE PAGE_SIZE
+
+struct pipe {
+	struct vnode pi_rvn;		/* read end */
+	struct vnode pi_wvn;		/* write end */
+	struct lock *pi_lock;		/* protects everything below */
+	struct cv *pi_readcv;		/* readers wait for data here */
+	struct cv *pi_writecv;		/* writers wait for room here */
+	char *pi_buf;			/* PIPE_SIZE bytes */
+	unsigned pi_head;		/* next byte to read */
+	unsigned pi_count;		/* bytes in the ring */
+	bool pi_rclosed;		/* read end is gone */
+	bool pi_wclosed;		/* write end is gone */
+	struct uio *pi_rdwait;		/* sleeping reader's uio, or NULL */
+	struct pollq pi_pollq;		/* pollers on either end */
+};
+
+static const struct vnode_ops pipe_vnode_ops;
+
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	pollq_cleanup(&p->pi_pollq);
+	kfree(p->pi_buf);
+	cv_destroy(p->pi_writecv);
+	cv_destroy(p->pi_readcv);
+	lock_destroy(p->pi_lock);
+	kfree(p);
+}
+
+int
+pipe_create(struct vnode **readend, struct vnode **writeend)
+{
+	struct pipe *p;
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->pi_lock = lock_create("pipe");
+	p->pi_readcv = cv_create("pipe read");
+	p->pi_writecv = cv_create("pipe write");
+	p->pi_buf = kmalloc(PIPE_SIZE);
+	if (p->pi_lock == NULL || p->pi_readcv == NULL ||
+	    p->pi_writecv == NULL || p->pi_buf == NULL) {
+		if (p->pi_buf != NULL) {
+			kfree(p->pi_buf);
+		}
+		if (p->pi_writecv != NULL) {
+			cv_destroy(p->pi_writecv);
+		}
+		if (p->pi_readcv != NULL) {
+			cv_destroy(p->pi_readcv);
+		}
+		if (p->pi_lock != NULL) {
+			lock_destroy(p->pi_lock);
+		}
+		kfree(p);
+		return ENOMEM;
+	}
+	p->pi_head = 0;
+	p->pi_count = 0;
+	p->pi_rclosed = false;
+	p->pi_wclosed = false;
+	p->pi_rdwait = NULL;
+	pollq_init(&p->pi_pollq);
+
+	VOP_INIT(&p->pi_rvn, &pipe_vnode_ops, NULL, p);
+	VOP_INIT(&p->pi_wvn, &pipe_vnode_ops, NULL, p);
+	/* as if by vfs_open, so vfs_close does the right thing */
+	VOP_INCOPEN(&p->pi_rvn);
+	VOP_INCOPEN(&p->pi_wvn);
+
+	*readend = &p->pi_rvn;
+	*writeend = &p->pi_wvn;
+	return 0;
+}
+
+/*
+ * Called when the last reference to either end goes away. Wake up
+ * anyone waiting on the other end, so they can see it's gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+	bool dead;
+
+	lock_acquire(p->pi_lock);
+	if (v == &p->pi_rvn) {
+		KASSERT(p->pi_rdwait == NULL);
+		p->pi_rclosed = true;
+		cv_broadcast(p->pi_writecv, p->pi_lock);
+	}
+	else {
+		p->pi_wclosed = true;
+		cv_broadcast(p->pi_readcv, p->pi_lock);
+	}
+	pollq_wakeup(&p->pi_pollq);
+	dead = p->pi_rclosed && p->pi_wclosed;
+	lock_release(p->pi_lock);
+
+	VOP_CLEANUP(v);
+	if (dead) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+/*
+ * Copy from the writer's UIO straight into the buffer of the reader
+ * waiting in pi_rdwait, as much as both have room for, then wake the
+ * reader up. Stops early, leaving the rest for the ring, if the
+ * reader's buffer isn't somewhere we can get at.
+ */
+static
+int
+pipe_direct(struct pipe *p, struct uio *uio)
+{
+	struct uio *ruio = p->pi_rdwait;
+	struct iovec *iov;
+	size_t len;
+	void *kva;
+	int result = 0;
+
+	KASSERT(p->pi_count == 0);
+
+	while (ruio->uio_resid > 0 && uio->uio_resid > 0) {
+		iov = ruio->uio_iov;
+		if (iov->iov_len == 0) {
+			ruio->uio_iov++;
+			ruio->uio_iovcnt--;
+			continue;
+		}
+		len = iov->iov_len;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		kva = as_kvaddr(ruio->uio_space, (vaddr_t)iov->iov_ubase, &len);
+		if (kva == NULL) {
+			break;
+		}
+		result = uiomove(kva, len, uio);
+		if (result) {
+			break;
+		}
+		iov->iov_ubase += len;
+		iov->iov_len -= len;
+		ruio->uio_resid -= len;
+		ruio->uio_offset += len;
+	}
+
+	p->pi_rdwait = NULL;
+	cv_broadcast(p->pi_readcv, p->pi_lock);
+	return result;
+}
+
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	size_t resid = uio->uio_resid;
+	size_t n;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+	if (v != &p->pi_rvn) {
+		return EBADF;
+	}
+	if (resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(p->pi_lock);
+	/* wait for something, unless a writer already filled us in */
+	while (p->pi_count == 0 && !p->pi_wclosed && uio->uio_resid == resid) {
+		if (p->pi_rdwait == NULL && uio->uio_segflg == UIO_USERSPACE) {
+			p->pi_rdwait = uio;
+		}
+		cv_wait(p->pi_readcv, p->pi_lock);
+	}
+	if (p->pi_rdwait == uio) {
+		p->pi_rdwait = NULL;
+	}
+
+	/* then take what's in the ring, in at most two pieces */
+	while (p->pi_count > 0 && uio->uio_resid > 0) {
+		n = PIPE_SIZE - p->pi_head;
+		if (n > p->pi_count) {
+			n = p->pi_count;
+		}
+		if (n > uio->uio_resid) {
+			n = uio->uio_resid;
+		}
+		result = uiomove(p->pi_buf + p->pi_head, n, uio);
+		if (result) {
+			break;
+		}
+		p->pi_head = (p->pi_head + n) % PIPE_SIZE;
+		p->pi_count -= n;
+		cv_broadcast(p->pi_writecv, p->pi_lock);
+		pollq_wakeup(&p->pi_pollq);
+	}
+	lock_release(p->pi_lock);
+	return result;
+}
+
+/*
+ * Writes of PIPE_BUF bytes or less wait until the whole thing fits,
+ * and then go in without letting go of the lock, so they're never
+ * split up. Larger writes put in whatever fits as they go. If the
+ * reader goes away partway through, what already went in counts as
+ * a short write; EPIPE is only for a write that got nothing in.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	size_t resid = uio->uio_resid;
+	bool atomic = resid <= PIPE_BUF;
+	unsigned tail;
+	size_t n, room;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+	if (v != &p->pi_wvn) {
+		return EBADF;
+	}
+
+	lock_acquire(p->pi_lock);
+	while (uio->uio_resid > 0) {
+		if (p->pi_rclosed) {
+			result = uio->uio_resid < resid ? 0 : EPIPE;
+			break;
+		}
+		if (p->pi_rdwait != NULL) {
+			/* a reader is waiting on an empty pipe */
+			result = pipe_direct(p, uio);
+			if (result) {
+				break;
+			}
+			continue;
+		}
+
+		room = PIPE_SIZE - p->pi_count;
+		if (room == 0 || (atomic && room < uio->uio_resid)) {
+			cv_wait(p->pi_writecv, p->pi_lock);
+			continue;
+		}
+
+		tail = (p->pi_head + p->pi_count) % PIPE_SIZE;
+		n = PIPE_SIZE - tail;
+		if (n > room) {
+			n = room;
+		}
+		if (n > uio->uio_resid) {
+			n = uio->uio_resid;
+		}
+		result = uiomove(p->pi_buf + tail, n, uio);
+		if (result) {
+			break;
+		}
+		p->pi_count += n;
+		cv_broadcast(p->pi_readcv, p->pi_lock);
+		pollq_wakeup(&p->pi_pollq);
+	}
+	lock_release(p->pi_lock);
+	return result;
+}
+
+/*
+ * The read end is readable when there's data, or at end of file; the
+ * write end is writeable when PIPE_BUF bytes would go in at once.
+ * Data copied straight to a sleeping reader never passes through the
+ * ring, so it doesn't make the pipe readable for anyone else.
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, struct pollentry *pe, int *revents)
+{
+	struct pipe *p = v->vn_data;
+	int ready = 0;
+
+	lock_acquire(p->pi_lock);
+	pollq_add(&p->pi_pollq, pe);
+	if (v == &p->pi_rvn) {
+		if (p->pi_count > 0 || p->pi_wclosed) {
+			ready |= events & POLLIN;
+		}
+		if (p->pi_wclosed) {
+			ready |= POLLHUP;
+		}
+	}
+	else {
+		if (p->pi_rclosed) {
+			ready |= POLLERR;
+		}
+		else if (PIPE_SIZE - p->pi_count >= PIPE_BUF) {
+			ready |= events & POLLOUT;
+		}
+	}
+	lock_release(p->pi_lock);
+
+	*revents = ready;
+	return 0;
+}
+
+static
+int
+pipe_open(struct vnode *v, int flags)
+{
+	/* pipes aren't in the namespace, so this can't happen */
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+static
+int
+pipe_close(struct vnode *v)
+{
+	/* nothing until reclaim */
+	(void)v;
+	return 0;
+}
+
+/*
+ * stat shows how much is waiting to be read.
+ */
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *p = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_BUF;
+	lock_acquire(p->pi_lock);
+	statbuf->st_size = p->pi_count;
+	lock_release(p->pi_lock);
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_tryseek(struct vnode *v, off_t pos)
+{
+	(void)v;
+	(void)pos;
+	return ESPIPE;
+}
+
+/*
+ * Operations that are meaningless on pipes.
+ */
+
+static
+int
+pipe_null_io(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return EINVAL;
+}
+
+static
+int
+pipe_mmap(struct vnode *v)
+{
+	(void)v;
+	return EUNIMP;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+static
+int
+pipe_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
+	   struct vnode **result)
+{
+	(void)v;
+	(void)name;
+	(void)excl;
+	(void)mode;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_symlink(struct vnode *v, const char *contents, const char *name)
+{
+	(void)v;
+	(void)contents;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_mkdir(struct vnode *v, const char *name, mode_t mode)
+{
+	(void)v;
+	(void)name;
+	(void)mode;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_link(struct vnode *v, const char *name, struct vnode *file)
+{
+	(void)v;
+	(void)name;
+	(void)file;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_nameop(struct vnode *v, const char *name)
+{
+	(void)v;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_rename(struct vnode *v, const char *n1, struct vnode *v2, const char *n2)
+{
+	(void)v;
+	(void)n1;
+	(void)v2;
+	(void)n2;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookup(struct vnode *v, char *pathname, struct vnode **result)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookparent(struct vnode *v, char *pathname, struct vnode **result,
+		char *namebuf, size_t buflen)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	(void)namebuf;
+	(void)buflen;
+	return ENOTDIR;
+}
+
+static const struct vnode_ops pipe_vnode_ops = {
+	VOP_MAGIC,
+
+	pipe_open,
+	pipe_close,
+	pipe_reclaim,
+	pipe_read,
+	pipe_null_io,  /* readlink */
+	pipe_null_io,  /* getdirentry */
+	pipe_write,
+	pipe_ioctl,
+	pipe_stat,
+	pipe_gettype,
+	pipe_tryseek,
+	pipe_poll,
+	pipe_fsync,
+	pipe_mmap,
+	pipe_truncate,
+	pipe_null_io,  /* namefile */
+	pipe_creat,
+	pipe_symlink,
+	pipe_mkdir,
+	pipe_link,
+	pipe_nameop,   /* remove */
+	pipe_nameop,   /* rmdir */
+	pipe_rename,
+	pipe_lookup,
+	pipe_lookparent,
+};
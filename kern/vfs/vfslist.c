@@ -43,6 +43,7 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include <execcache.h>
 
 /*
  * Structure for a single named device.
@@ -87,9 +88,18 @@ DEFARRAY(knowndev, /*no inline*/);
 
 static struct knowndevarray *knowndevs;
 
-/* The big lock for all FS ops. Remove for filesystem assignment. */
-static struct lock *vfs_biglock;
-static unsigned vfs_biglock_depth;
+/*
+ * Lock for the knowndevs table and for the kd_fs of each entry: that
+ * is, for adding devices, mounting, unmounting, and finding a
+ * filesystem by name. It is held across FSOP calls made on behalf of
+ * those (mount, sync, unmount, getroot) so a filesystem can't be
+ * unmounted out from under them. Filesystems must not call back into
+ * this file while it's held; it is not recursive.
+ *
+ * File operations proper don't touch it; they're locked inside each
+ * filesystem.
+ */
+static struct lock *vfs_listlock;
 
 
 /*
@@ -103,48 +113,14 @@ vfs_bootstrap(void)
 		panic("vfs: Could not create knowndevs array\n");
 	}
 
-	vfs_biglock = lock_create("vfs_biglock");
-	if (vfs_biglock==NULL) {
-		panic("vfs: Could not create vfs big lock\n");
+	vfs_listlock = lock_create("vfs_listlock");
+	if (vfs_listlock==NULL) {
+		panic("vfs: Could not create vfs list lock\n");
 	}
-	vfs_biglock_depth = 0;
 
 	devnull_create();
 }
 
-/*
- * Operations on vfs_biglock. We make it recursive to avoid having to
- * think about where we do and don't already hold it. This is an
- * undesirable hack that's frequently necessary when a lock covers too
- * much material. Your solution scheme for FS and VFS locking should
- * not require recursive locks.
- */
-void
-vfs_biglock_acquire(void)
-{
-	if (!lock_do_i_hold(vfs_biglock)) {
-		lock_acquire(vfs_biglock);
-	}
-	vfs_biglock_depth++;
-}
-
-void
-vfs_biglock_release(void)
-{
-	KASSERT(lock_do_i_hold(vfs_biglock));
-	KASSERT(vfs_biglock_depth > 0);
-	vfs_biglock_depth--;
-	if (vfs_biglock_depth == 0) {
-		lock_release(vfs_biglock);
-	}
-}
-
-bool
-vfs_biglock_do_i_hold(void)
-{
-	return lock_do_i_hold(vfs_biglock);
-}
-
 /*
  * Global sync function - call FSOP_SYNC on all devices.
  */
@@ -154,7 +130,7 @@ vfs_sync(void)
 	struct knowndev *dev;
 	unsigned i, num;
 
-	vfs_biglock_acquire();
+	lock_acquire(vfs_listlock);
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -164,7 +140,7 @@ vfs_sync(void)
 		}
 	}
 
-	vfs_biglock_release();
+	lock_release(vfs_listlock);
 
 	return 0;
 }
@@ -173,13 +149,14 @@ vfs_sync(void)
  * Given a device name (lhd0, emu0, somevolname, null, etc.), hand
  * back an appropriate vnode.
  */
+static
 int
-vfs_getroot(const char *devname, struct vnode **result)
+findroot(const char *devname, struct vnode **result)
 {
 	struct knowndev *kd;
 	unsigned i, num;
 
-	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(lock_do_i_hold(vfs_listlock));
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -250,6 +227,17 @@ vfs_getroot(const char *devname, struct vnode **result)
 	return ENODEV;
 }
 
+int
+vfs_getroot(const char *devname, struct vnode **result)
+{
+	int ret;
+
+	lock_acquire(vfs_listlock);
+	ret = findroot(devname, result);
+	lock_release(vfs_listlock);
+	return ret;
+}
+
 /*
  * Given a filesystem, hand back the name of the device it's mounted on.
  */
@@ -257,11 +245,12 @@ const char *
 vfs_getdevname(struct fs *fs)
 {
 	struct knowndev *kd;
+	const char *name = NULL;
 	unsigned i, num;
 
 	KASSERT(fs != NULL);
 
-	KASSERT(vfs_biglock_do_i_hold());
+	lock_acquire(vfs_listlock);
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -274,11 +263,13 @@ vfs_getdevname(struct fs *fs)
 			 * the fs cannot go away, and the device can't
 			 * go away until the fs goes away.
 			 */
-			return kd->kd_name;
+			name = kd->kd_name;
+			break;
 		}
 	}
 
-	return NULL;
+	lock_release(vfs_listlock);
+	return name;
 }
 
 /*
@@ -338,7 +329,7 @@ badnames(const char *n1, const char *n2, const char *n3)
 	unsigned i, num;
 	struct knowndev *kd;
 
-	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(lock_do_i_hold(vfs_listlock));
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -378,7 +369,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 	unsigned index;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(vfs_listlock);
 
 	name = kstrdup(dname);
 	if (name==NULL) {
@@ -412,7 +403,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 	}
 
 	if (badnames(name, rawname, volname)) {
-		vfs_biglock_release();
+		lock_release(vfs_listlock);
 		return EEXIST;
 	}
 
@@ -423,7 +414,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		dev->d_devnumber = index+1;
 	}
 
-	vfs_biglock_release();
+	lock_release(vfs_listlock);
 	return result;
 
  nomem:
@@ -441,7 +432,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		kfree(kd);
 	}
 	
-	vfs_biglock_release();
+	lock_release(vfs_listlock);
 	return ENOMEM;
 }
 
@@ -480,7 +471,7 @@ findmount(const char *devname, struct knowndev **result)
 	unsigned i, num;
 	bool found = false;
 
-	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(lock_do_i_hold(vfs_listlock));
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; !found && i<num; i++) {
@@ -514,16 +505,16 @@ vfs_mount(const char *devname, void *data,
 	struct fs *fs;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(vfs_listlock);
 
 	result = findmount(devname, &kd);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(vfs_listlock);
 		return result;
 	}
 
 	if (kd->kd_fs != NULL) {
-		vfs_biglock_release();
+		lock_release(vfs_listlock);
 		return EBUSY;
 	}
 	KASSERT(kd->kd_rawname != NULL);
@@ -531,7 +522,7 @@ vfs_mount(const char *devname, void *data,
 
 	result = mountfunc(data, kd->kd_device, &fs);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(vfs_listlock);
 		return result;
 	}
 
@@ -543,7 +534,7 @@ vfs_mount(const char *devname, void *data,
 	kprintf("vfs: Mounted %s: on %s\n",
 		volname ? volname : kd->kd_name, kd->kd_name);
 
-	vfs_biglock_release();
+	lock_release(vfs_listlock);
 	return 0;
 }
 
@@ -557,7 +548,7 @@ vfs_unmount(const char *devname)
 	struct knowndev *kd;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(vfs_listlock);
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -571,6 +562,9 @@ vfs_unmount(const char *devname)
 	KASSERT(kd->kd_rawname != NULL);
 	KASSERT(kd->kd_device != NULL);
 
+	/* Cached exec images hold vnodes, which would keep it busy. */
+	execcache_flushfs(kd->kd_fs);
+
 	result = FSOP_SYNC(kd->kd_fs);
 	if (result) {
 		goto fail;
@@ -589,7 +583,7 @@ vfs_unmount(const char *devname)
 	KASSERT(result==0);
 
  fail:
-	vfs_biglock_release();
+	lock_release(vfs_listlock);
 	return result;
 }
 
@@ -603,7 +597,7 @@ vfs_unmountall(void)
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(vfs_listlock);
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -619,6 +613,8 @@ vfs_unmountall(void)
 
 		kprintf("vfs: Unmounting %s:\n", dev->kd_name);
 
+		execcache_flushfs(dev->kd_fs);
+
 		result = FSOP_SYNC(dev->kd_fs);
 		if (result) {
 			kprintf("vfs: Warning: sync failed for %s: %s, trying "
@@ -650,7 +646,7 @@ vfs_unmountall(void)
 		dev->kd_fs = NULL;
 	}
 
-	vfs_biglock_release();
+	lock_release(vfs_listlock);
 
 	return 0;
 }
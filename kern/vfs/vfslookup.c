@@ -35,11 +35,18 @@
 #include <kern/errno.h>
 #include <limits.h>
 #include <lib.h>
-#include <synch.h>
+#include <spinlock.h>
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
 
+/*
+ * bootfs_vnode is read on every absolute path lookup, so it gets its
+ * own spinlock rather than anything that would serialize lookups.
+ * Hold it only long enough to read or swap the pointer and take a
+ * reference.
+ */
+static struct spinlock bootfs_lock = SPINLOCK_INITIALIZER;
 static struct vnode *bootfs_vnode = NULL;
 
 /*
@@ -51,8 +58,10 @@ change_bootfs(struct vnode *newvn)
 {
 	struct vnode *oldvn;
 
+	spinlock_acquire(&bootfs_lock);
 	oldvn = bootfs_vnode;
 	bootfs_vnode = newvn;
+	spinlock_release(&bootfs_lock);
 
 	if (oldvn != NULL) {
 		VOP_DECREF(oldvn);
@@ -75,14 +84,11 @@ vfs_setbootfs(const char *fsname)
 	int result;
 	struct vnode *newguy;
 
-	vfs_biglock_acquire();
-
 	snprintf(tmp, sizeof(tmp)-1, "%s", fsname);
 	s = strchr(tmp, ':');
 	if (s) {
 		/* If there's a colon, it must be at the end */
 		if (strlen(s)>0) {
-			vfs_biglock_release();
 			return EINVAL;
 		}
 	}
@@ -92,19 +98,16 @@ vfs_setbootfs(const char *fsname)
 
 	result = vfs_chdir(tmp);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	result = vfs_getcurdir(&newguy);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	change_bootfs(newguy);
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -114,9 +117,7 @@ vfs_setbootfs(const char *fsname)
 void
 vfs_clearbootfs(void)
 {
-	vfs_biglock_acquire();
 	change_bootfs(NULL);
-	vfs_biglock_release();
 }
 
 
@@ -133,8 +134,6 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	struct vnode *vn;
 	int result;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/*
 	 * Locate the first colon or slash.
 	 */
@@ -188,11 +187,16 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	KASSERT(colon==0 || slash==0);
 
 	if (path[0]=='/') {
-		if (bootfs_vnode==NULL) {
+		spinlock_acquire(&bootfs_lock);
+		vn = bootfs_vnode;
+		if (vn != NULL) {
+			VOP_INCREF(vn);
+		}
+		spinlock_release(&bootfs_lock);
+		if (vn == NULL) {
 			return ENOENT;
 		}
-		VOP_INCREF(bootfs_vnode);
-		*startvn = bootfs_vnode;
+		*startvn = vn;
 	}
 	else {
 		KASSERT(path[0]==':');
@@ -235,11 +239,8 @@ vfs_lookparent(char *path, struct vnode **retval,
 	struct vnode *startvn;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = getdevice(path, &path, &startvn);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -257,7 +258,6 @@ vfs_lookparent(char *path, struct vnode **retval,
 
 	VOP_DECREF(startvn);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -267,23 +267,18 @@ vfs_lookup(char *path, struct vnode **retval)
 	struct vnode *startvn;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = getdevice(path, &path, &startvn);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	if (strlen(path)==0) {
 		*retval = startvn;
-		vfs_biglock_release();
 		return 0;
 	}
 
 	result = VOP_LOOKUP(startvn, path, retval);
 
 	VOP_DECREF(startvn);
-	vfs_biglock_release();
 	return result;
 }
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Readiness notification for poll() and select(). See poll.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <current.h>
+#include <wchan.h>
+#include <poll.h>
+
+/*
+ * Every sleeping poller sits here; each is woken individually with
+ * wchan_wakethread, as in clocknap. The pollwait flags are protected
+ * by pollchan's lock.
+ */
+static struct wchan *pollchan;
+
+void
+poll_bootstrap(void)
+{
+	pollchan = wchan_create("poll");
+	if (pollchan == NULL) {
+		panic("Couldn't create pollchan\n");
+	}
+}
+
+void
+pollq_init(struct pollq *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_head = NULL;
+}
+
+void
+pollq_cleanup(struct pollq *pq)
+{
+	KASSERT(pq->pq_head == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+void
+pollq_add(struct pollq *pq, struct pollentry *pe)
+{
+	if (pe == NULL || pe->pe_q != NULL) {
+		return;
+	}
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_q = pq;
+	pe->pe_next = pq->pq_head;
+	pe->pe_pprev = &pq->pq_head;
+	if (pq->pq_head != NULL) {
+		pq->pq_head->pe_pprev = &pe->pe_next;
+	}
+	pq->pq_head = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+/*
+ * Wake PW's thread. Clearing pw_sleeping here, not when it wakes,
+ * keeps a second waker from trying to wake it off pollchan after
+ * it's already left.
+ */
+static
+void
+pollwait_wake(struct pollwait *pw)
+{
+	wchan_lock(pollchan);
+	pw->pw_woken = true;
+	if (pw->pw_sleeping) {
+		pw->pw_sleeping = false;
+		wchan_wakethread(pollchan, pw->pw_thread);
+	}
+	wchan_unlock(pollchan);
+}
+
+void
+pollq_wakeup(struct pollq *pq)
+{
+	struct pollentry *pe;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_head; pe != NULL; pe = pe->pe_next) {
+		pollwait_wake(pe->pe_wait);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+void
+pollwait_init(struct pollwait *pw)
+{
+	pw->pw_thread = curthread;
+	pw->pw_woken = false;
+	pw->pw_sleeping = false;
+	pw->pw_expired = false;
+}
+
+void
+pollwait_clear(struct pollwait *pw)
+{
+	wchan_lock(pollchan);
+	pw->pw_woken = false;
+	wchan_unlock(pollchan);
+}
+
+/*
+ * Timeout callback for pollwait_sleep.
+ */
+static
+void
+pollwait_timeout(void *data)
+{
+	struct pollwait *pw = data;
+
+	wchan_lock(pollchan);
+	pw->pw_expired = true;
+	pw->pw_woken = true;
+	if (pw->pw_sleeping) {
+		pw->pw_sleeping = false;
+		wchan_wakethread(pollchan, pw->pw_thread);
+	}
+	wchan_unlock(pollchan);
+}
+
+bool
+pollwait_sleep(struct pollwait *pw, int ticks)
+{
+	struct timeout to;
+	bool expired;
+
+	KASSERT(pw->pw_thread == curthread);
+	if (ticks == 0) {
+		return false;
+	}
+
+	pw->pw_expired = false;
+	if (ticks > 0) {
+		timeout_init(&to, pollwait_timeout, pw);
+		timeout_add(&to, ticks);
+	}
+
+	wchan_lock(pollchan);
+	if (pw->pw_woken) {
+		wchan_unlock(pollchan);
+	}
+	else {
+		pw->pw_sleeping = true;
+		wchan_sleep(pollchan);
+	}
+
+	if (ticks > 0 && !timeout_cancel(&to)) {
+		/*
+		 * The timeout has gone off, or is about to; it uses PW
+		 * (and TO, on our stack), so wait for it to finish.
+		 */
+		wchan_lock(pollchan);
+		while (!pw->pw_expired) {
+			pw->pw_sleeping = true;
+			wchan_sleep(pollchan);
+			wchan_lock(pollchan);
+		}
+		wchan_unlock(pollchan);
+	}
+
+	wchan_lock(pollchan);
+	expired = pw->pw_expired;
+	wchan_unlock(pollchan);
+	return !expired;
+}
+
+void
+pollentry_init(struct pollentry *pe, struct pollwait *pw)
+{
+	pe->pe_wait = pw;
+	pe->pe_q = NULL;
+	pe->pe_next = NULL;
+	pe->pe_pprev = NULL;
+}
+
+void
+pollentry_remove(struct pollentry *pe)
+{
+	struct pollq *pq = pe->pe_q;
+
+	if (pq == NULL) {
+		return;
+	}
+	spinlock_acquire(&pq->pq_lock);
+	*pe->pe_pprev = pe->pe_next;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_pprev = pe->pe_pprev;
+	}
+	spinlock_release(&pq->pq_lock);
+	pe->pe_q = NULL;
+}
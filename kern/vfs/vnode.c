@@ -33,7 +33,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
-#include <synch.h>
+#include <spinlock.h>
 #include <vfs.h>
 #include <vnode.h>
 
@@ -48,9 +48,11 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	KASSERT(vn!=NULL);
 	KASSERT(ops!=NULL);
 
+	spinlock_init(&vn->vn_countlock);
 	vn->vn_ops = ops;
 	vn->vn_refcount = 1;
 	vn->vn_opencount = 0;
+	vn->vn_writegen = 0;
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
 	return 0;
@@ -71,6 +73,7 @@ vnode_cleanup(struct vnode *vn)
 	vn->vn_opencount = 0;
 	vn->vn_fs = NULL;
 	vn->vn_data = NULL;
+	spinlock_cleanup(&vn->vn_countlock);
 }
 
 
@@ -83,32 +86,37 @@ vnode_incref(struct vnode *vn)
 {
 	KASSERT(vn != NULL);
 
-	vfs_biglock_acquire();
-
+	spinlock_acquire(&vn->vn_countlock);
 	vn->vn_refcount++;
-
-	vfs_biglock_release();
+	spinlock_release(&vn->vn_countlock);
 }
 
 /*
  * Decrement refcount.
  * Called by VOP_DECREF.
- * Calls VOP_RECLAIM if the refcount hits zero.
+ * Calls VOP_RECLAIM if the refcount hits zero; see vnode.h for what
+ * the filesystem has to do about references that appear meanwhile.
  */
 void
 vnode_decref(struct vnode *vn)
 {
+	bool destroy;
 	int result;
 
 	KASSERT(vn != NULL);
 
-	vfs_biglock_acquire();
-
+	spinlock_acquire(&vn->vn_countlock);
 	KASSERT(vn->vn_refcount>0);
 	if (vn->vn_refcount>1) {
 		vn->vn_refcount--;
+		destroy = false;
 	}
 	else {
+		destroy = true;
+	}
+	spinlock_release(&vn->vn_countlock);
+
+	if (destroy) {
 		result = VOP_RECLAIM(vn);
 		if (result != 0 && result != EBUSY) {
 			// XXX: lame.
@@ -116,8 +124,6 @@ vnode_decref(struct vnode *vn)
 				strerror(result));
 		}
 	}
-
-	vfs_biglock_release();
 }
 
 /*
@@ -129,29 +135,34 @@ vnode_incopen(struct vnode *vn)
 {
 	KASSERT(vn != NULL);
 
-	vfs_biglock_acquire();
+	spinlock_acquire(&vn->vn_countlock);
 	vn->vn_opencount++;
-	vfs_biglock_release();
+	spinlock_release(&vn->vn_countlock);
 }
 
 /*
  * Decrement the open count.
  * Called by VOP_DECOPEN.
+ *
+ * VOP_CLOSE is called after dropping the countlock, so a new open
+ * can come in before it runs. That's harmless for everything we have:
+ * SFS close is just an fsync and device close routines don't tear
+ * anything down.
  */
 void
 vnode_decopen(struct vnode *vn)
 {
 	int result;
+	int count;
 
 	KASSERT(vn != NULL);
 
-	vfs_biglock_acquire();
-
+	spinlock_acquire(&vn->vn_countlock);
 	KASSERT(vn->vn_opencount>0);
-	vn->vn_opencount--;
+	count = --vn->vn_opencount;
+	spinlock_release(&vn->vn_countlock);
 
-	if (vn->vn_opencount > 0) {
-		vfs_biglock_release();
+	if (count > 0) {
 		return;
 	}
 
@@ -162,19 +173,43 @@ vnode_decopen(struct vnode *vn)
 		// doesn't get reached...
 		kprintf("vfs: Warning: VOP_CLOSE: %s\n", strerror(result));
 	}
+}
+
+/*
+ * Note a change to the file's contents.
+ */
+void
+vnode_written(struct vnode *vn)
+{
+	spinlock_acquire(&vn->vn_countlock);
+	vn->vn_writegen++;
+	spinlock_release(&vn->vn_countlock);
+}
 
-	vfs_biglock_release();
+/*
+ * Get the contents generation.
+ */
+unsigned
+vnode_writegen(struct vnode *vn)
+{
+	unsigned ret;
+
+	spinlock_acquire(&vn->vn_countlock);
+	ret = vn->vn_writegen;
+	spinlock_release(&vn->vn_countlock);
+	return ret;
 }
 
 /*
  * Check for various things being valid.
  * Called before all VOP_* calls.
+ *
+ * The counts are read without the countlock; this is only a sanity
+ * check, and the values it looks for are wrong whenever they're seen.
  */
 void
 vnode_check(struct vnode *v, const char *opstr)
 {
-	vfs_biglock_acquire();
-
 	if (v == NULL) {
 		panic("vnode_check: vop_%s: null vnode\n", opstr);
 	}
@@ -222,6 +257,4 @@ vnode_check(struct vnode *v, const char *opstr)
 		kprintf("vnode_check: vop_%s: warning: large opencount %d\n", 
 			opstr, v->vn_opencount);
 	}
-
-	vfs_biglock_release();
 }
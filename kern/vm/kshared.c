@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Read-only kernel data for user programs. See kshared.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <vm.h>
+#include <kshared.h>
+
+/* keep the compiler from moving loads or stores across this */
+#define COMPILER_BARRIER() __asm volatile("" ::: "memory")
+
+paddr_t kshared_timepaddr;
+static volatile struct kshared_time *kshared_time;
+
+void
+kshared_bootstrap(void)
+{
+	vaddr_t va;
+
+	va = alloc_kpages(1);
+	if (va == 0) {
+		panic("kshared_bootstrap: Out of memory\n");
+	}
+	bzero((void *)va, PAGE_SIZE);
+	kshared_time = (struct kshared_time *)va;
+	kshared_update();
+	kshared_timepaddr = KVADDR_TO_PADDR(va);
+}
+
+/*
+ * Only timerclock calls this, on one cpu, so there is only ever one
+ * writer. The processors see each other's stores in program order,
+ * so we only have to stop the compiler reordering them.
+ */
+void
+kshared_update(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (kshared_time == NULL) {
+		return;
+	}
+	gettime(&secs, &nsecs);
+
+	kshared_time->kt_seq++;
+	COMPILER_BARRIER();
+	kshared_time->kt_sec = secs;
+	kshared_time->kt_nsec = nsecs;
+	COMPILER_BARRIER();
+	kshared_time->kt_seq++;
+}
@@ -36,6 +36,12 @@
  */
 
 
+/*
+ * How much to ask copy_file_range for at once. Any amount will do;
+ * the kernel moves it a block at a time.
+ */
+#define COPYSIZE 65536
+
 /* Copy one file to another. */
 static
 void
@@ -43,8 +49,7 @@ copy(const char *from, const char *to)
 {
 	int fromfd;
 	int tofd;
-	char buf[1024];
-	int len, wr, wrtot;
+	int len;
 
 	/*
 	 * Open the files, and give up if they won't open
@@ -59,30 +64,16 @@ copy(const char *from, const char *to)
 	}
 
 	/*
+	 * Have the kernel move the data, so it never comes up here.
 	 * As long as we get more than zero bytes, we haven't hit EOF.
-	 * Zero means EOF. Less than zero means an error occurred.
-	 * We may read less than we asked for, though, in various cases
-	 * for various reasons.
+	 * Zero means EOF. Less than zero means an error occurred, on
+	 * one side or the other.
 	 */
-	while ((len = read(fromfd, buf, sizeof(buf)))>0) {
-		/*
-		 * Likewise, we may actually write less than we attempted
-		 * to. So loop until we're done.
-		 */
-		wrtot = 0;
-		while (wrtot < len) {
-			wr = write(tofd, buf+wrtot, len-wrtot);
-			if (wr<0) {
-				err(1, "%s", to);
-			}
-			wrtot += wr;
-		}
+	while ((len = copy_file_range(fromfd, tofd, COPYSIZE))>0) {
+		/* nothing */
 	}
-	/*
-	 * If we got a read error, print it and exit.
-	 */
 	if (len<0) {
-		err(1, "%s", from);
+		err(1, "%s to %s", from, to);
 	}
 
 	if (close(fromfd) < 0) {
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYS_SUBMIT_H_
+#define _SYS_SUBMIT_H_
+
+/*
+ * Batched system calls; see <kern/submit.h> for the ring itself.
+ *
+ * submit       - the system call: run up to COUNT queued requests.
+ *
+ * And some helpers for using a ring:
+ *
+ * submit_init  - set up an empty ring.
+ * submit_queue - queue a request; returns -1 if the queue is full.
+ * submit_flush - run everything queued; returns how many were run,
+ *                or -1 on error.
+ * submit_reap  - take the next completion into *CQE; returns 0 if
+ *                there isn't one.
+ */
+
+#include <sys/types.h>
+#include <kern/submit.h>
+
+int submit(struct submit_ring *ring, unsigned count);
+
+void submit_init(struct submit_ring *ring);
+int submit_queue(struct submit_ring *ring, int op, int fd, void *buf,
+		 size_t len, off_t offset, unsigned long long data);
+int submit_flush(struct submit_ring *ring);
+int submit_reap(struct submit_ring *ring, struct submit_cqe *cqe);
+
+#endif /* _SYS_SUBMIT_H_ */
@@ -42,8 +42,10 @@
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
+#include <kern/resource.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
+#include <kern/sysstat.h>
 
 
 /*
@@ -56,6 +58,8 @@
  *     fstat:    sys/stat.h
  *     lstat:    sys/stat.h
  *     mkdir:    sys/stat.h
+ *     readv:    sys/uio.h
+ *     writev:   sys/uio.h
  *
  * If this were standard Unix, more prototypes would go in other
  * header files as well, as follows:
@@ -127,6 +131,8 @@ int waitpid(pid_t pid, int *returncode, int flags);
 int open(const char *filename, int flags, ...);
 int read(int filehandle, void *buf, size_t size);
 int write(int filehandle, const void *buf, size_t size);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
 int close(int filehandle);
 int reboot(int code);
 int sync(void);
@@ -134,7 +140,7 @@ int sync(void);
 int rmdir(const char *dirname);
 
 /* Recommended. */
-int getpid(void);
+int getpid(void);			/* reads <kern/kshared.h> */
 int ioctl(int filehandle, int code, void *buf);
 off_t lseek(int filehandle, off_t pos, int code);
 int fsync(int filehandle);
@@ -154,6 +160,13 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+int __getpid(void);
+int getrusage(int who, struct rusage *usage);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+pid_t vfork(void);
+int spawn(const char *prog, char *const *args);
+int sysstat(struct sysstat *buf, unsigned count, int flags);
+ssize_t copy_file_range(int infd, int outfd, size_t len);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -162,6 +175,8 @@ int __getcwd(char *buf, size_t buflen);
  */
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
-time_t time(time_t *seconds);			/* calls __time */
+time_t time(time_t *seconds);			/* reads <kern/kshared.h> */
+time_t nanotime(time_t *seconds, unsigned long *nanoseconds);
+						/* reads <kern/kshared.h> */
 
 #endif /* _UNISTD_H_ */
@@ -28,15 +28,46 @@
  */
 
 #include <unistd.h>
+#include <kern/kshared.h>
+
+/*
+ * nanotime: like __time, seconds and nanoseconds since the epoch, but
+ * read off the page the kernel keeps the time in (see
+ * <kern/kshared.h>) instead of trapping. The kernel rewrites that page
+ * once a timer tick, so the result is only good to a tick (10ms);
+ * time things that take a good deal longer than that.
+ */
+
+time_t
+nanotime(time_t *seconds, unsigned long *nanoseconds)
+{
+	volatile const struct kshared_time *kt =
+		(volatile const struct kshared_time *)KSHARED_TIMEVADDR;
+	unsigned seq;
+	time_t secs;
+	unsigned long nsecs;
+
+	do {
+		seq = kt->kt_seq;
+		secs = kt->kt_sec;
+		nsecs = kt->kt_nsec;
+	} while ((seq & 1) || seq != kt->kt_seq);
+
+	if (seconds != NULL) {
+		*seconds = secs;
+	}
+	if (nanoseconds != NULL) {
+		*nanoseconds = nsecs;
+	}
+	return secs;
+}
 
 /*
  * POSIX C function: retrieve time in seconds since the epoch.
- * Uses the OS/161 system call __time, which does the same thing
- * but also returns nanoseconds.
  */
 
 time_t
 time(time_t *t)
 {
-	return __time(t, NULL);
+	return nanotime(t, NULL);
 }
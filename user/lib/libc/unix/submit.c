@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/submit.h>
+
+/*
+ * Helpers for batched system calls. See <sys/submit.h>.
+ */
+
+void
+submit_init(struct submit_ring *ring)
+{
+	ring->sr_sqhead = ring->sr_sqtail = 0;
+	ring->sr_cqhead = ring->sr_cqtail = 0;
+}
+
+int
+submit_queue(struct submit_ring *ring, int op, int fd, void *buf,
+	     size_t len, off_t offset, unsigned long long data)
+{
+	struct submit_sqe *sqe;
+
+	if (ring->sr_sqtail - ring->sr_sqhead == SUBMIT_ENTRIES) {
+		return -1;
+	}
+	sqe = &ring->sr_sq[ring->sr_sqtail % SUBMIT_ENTRIES];
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_buf = (__u32)buf;
+	sqe->sqe_len = len;
+	sqe->sqe_offset = offset;
+	sqe->sqe_data = data;
+	ring->sr_sqtail++;
+	return 0;
+}
+
+int
+submit_flush(struct submit_ring *ring)
+{
+	return submit(ring, ring->sr_sqtail - ring->sr_sqhead);
+}
+
+int
+submit_reap(struct submit_ring *ring, struct submit_cqe *cqe)
+{
+	if (ring->sr_cqhead == ring->sr_cqtail) {
+		return 0;
+	}
+	*cqe = ring->sr_cq[ring->sr_cqhead % SUBMIT_ENTRIES];
+	ring->sr_cqhead++;
+	return 1;
+}
@@ -776,35 +776,38 @@ mergebins(void)
 	}
 }
 
+/*
+ * Copy our merged bin into place in the output, inside the kernel.
+ */
 static
 void
 assemble(void)
 {
 	off_t mypos;
-	int i, fd;
-	const char *args[3];
+	int i, infd, outfd;
+	const char *name;
+	ssize_t len;
 
 	mypos = 0;
 	for (i=0; i<me; i++) {
 		mypos += getsize(mergedname(i));
 	}
 
-	fd = doopen(PATH_SORTED, O_WRONLY, 0);
-	dolseek(PATH_SORTED, fd, mypos, SEEK_SET);
+	name = mergedname(me);
+	infd = doopen(name, O_RDONLY, 0);
+	outfd = doopen(PATH_SORTED, O_WRONLY, 0);
+	dolseek(PATH_SORTED, outfd, mypos, SEEK_SET);
 
-	if (dup2(fd, STDOUT_FILENO) < 0) {
-		complain("dup2");
+	while ((len = copy_file_range(infd, outfd, 65536)) > 0) {
+		/* nothing */
+	}
+	if (len < 0) {
+		complain("%s: copy_file_range", name);
 		exit(1);
 	}
 
-	doclose(PATH_SORTED, fd);
-
-	args[0] = "cat";
-	args[1] = mergedname(me);
-	args[2] = NULL;
-	execv("/bin/cat", (char **) args);
-	complain("/bin/cat: exec");
-	exit(1);
+	doclose(PATH_SORTED, outfd);
+	doclose(name, infd);
 }
 
 static
@@ -0,0 +1,81 @@
+/*
+ * Title   : copyrange
+ *
+ * Tests copy_file_range.
+ * Assumes that files named COPYSRC and COPYDST do not exist in the
+ * current directory
+ *
+ * Writes a file bigger than a page, copies it in two uneven pieces,
+ * checks the copy and both offsets, then checks the copy stops at end
+ * of file and that bad descriptors and modes are refused.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "../lib/testutils.h"
+
+#define SIZE 10000
+
+static char buf[SIZE], buf2[SIZE];
+
+int
+main()
+{
+  int src, dst;
+  int rc = 0;      /* return code */
+  int i;
+
+  /* Useful for debugging, if failures occur turn verbose on by uncommenting */
+  // TEST_VERBOSE_ON();
+
+  for (i = 0; i < SIZE; i++) {
+    buf[i] = 'a' + i % 26;
+  }
+
+  src = open("COPYSRC", O_RDWR | O_CREAT | O_TRUNC);
+  TEST_POSITIVE(src, "Unable to open COPYSRC");
+  dst = open("COPYDST", O_RDWR | O_CREAT | O_TRUNC);
+  TEST_POSITIVE(dst, "Unable to open COPYDST");
+
+  rc = write(src, buf, SIZE);
+  TEST_EQUAL(rc, SIZE, "write wrote wrong amount");
+  rc = lseek(src, 0, SEEK_SET);
+  TEST_EQUAL(rc, 0, "lseek to start failed");
+
+  rc = copy_file_range(src, dst, 3000);
+  TEST_EQUAL(rc, 3000, "first copy copied wrong amount");
+  rc = copy_file_range(src, dst, SIZE);
+  TEST_EQUAL(rc, SIZE - 3000, "second copy copied wrong amount");
+  rc = copy_file_range(src, dst, SIZE);
+  TEST_EQUAL(rc, 0, "copy at end of file didn't return 0");
+
+  rc = lseek(src, 0, SEEK_CUR);
+  TEST_EQUAL(rc, SIZE, "copy left source offset wrong");
+  rc = lseek(dst, 0, SEEK_CUR);
+  TEST_EQUAL(rc, SIZE, "copy left destination offset wrong");
+
+  rc = lseek(dst, 0, SEEK_SET);
+  TEST_EQUAL(rc, 0, "lseek to start failed");
+  rc = read(dst, buf2, SIZE);
+  TEST_EQUAL(rc, SIZE, "read of copy read wrong amount");
+  TEST_EQUAL(memcmp(buf, buf2, SIZE), 0, "copy has wrong contents");
+
+  rc = copy_file_range(src, 100, 1);
+  TEST_NEGATIVE(rc, "copy to bad descriptor didn't fail");
+  rc = copy_file_range(src, src, 1);
+  TEST_NEGATIVE(rc, "copy of a file onto itself didn't fail");
+  rc = copy_file_range(STDOUT_FILENO, dst, 1);
+  TEST_NEGATIVE(rc, "copy from write-only console didn't fail");
+
+  rc = close(src);
+  TEST_EQUAL(rc, SUCCESS, "close failed");
+  rc = close(dst);
+  TEST_EQUAL(rc, SUCCESS, "close failed");
+
+  TEST_STATS();
+
+  exit(0);
+}
@@ -0,0 +1,160 @@
+/*
+ * kshared - check the kernel's shared page against the system calls.
+ *
+ *  getpid(), time() and nanotime() read the page the kernel maps into
+ *  every process (see <kern/kshared.h>); __getpid and __time trap. The
+ *  two should agree: exactly for the pid, and to within a timer tick
+ *  or so for the time, since the page is only rewritten once a tick.
+ *
+ *  Checks this in the parent, in a fork child (its own page), and in a
+ *  vfork child (which shares the parent's page, so the kernel has to
+ *  show the child's pid and then put the parent's back).
+ *
+ *  Prints "kshared: passed" and exits 0 if everything matches.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+#include <sys/wait.h>
+
+/* how far behind __time the page may be: a tick (10ms), with slack */
+#define SLACK_NSECS 50000000
+
+#define NTIMES 1000
+
+/* nanoseconds from (S1,N1) to (S2,N2) */
+static
+long long
+nsecs_between(time_t s1, unsigned long n1, time_t s2, unsigned long n2)
+{
+	return (s2 - s1) * 1000000000LL + (long long)n2 - (long long)n1;
+}
+
+/*
+ * Check the pid and time on the page against the traps. Returns the
+ * number of problems found, after printing each one with WHO.
+ */
+static
+int
+check(const char *who)
+{
+	time_t s1, s2, sp, t;
+	unsigned long n1, n2, np, nlast;
+	time_t slast;
+	int bad = 0;
+	int i;
+
+	if (getpid() != __getpid()) {
+		printf("%s: getpid says %d, __getpid says %d\n",
+		       who, getpid(), __getpid());
+		bad++;
+	}
+
+	/* the page must fall between two trapping reads, less a tick */
+	__time(&s1, &n1);
+	nanotime(&sp, &np);
+	t = time(NULL);
+	__time(&s2, &n2);
+	if (np >= 1000000000) {
+		printf("%s: nanotime gave %lu nanoseconds\n", who, np);
+		bad++;
+	}
+	if (nsecs_between(s1, n1, sp, np) < -SLACK_NSECS ||
+	    nsecs_between(sp, np, s2, n2) < 0) {
+		printf("%s: nanotime %lld.%09lu is not between "
+		       "__time %lld.%09lu and %lld.%09lu\n", who,
+		       (long long)sp, np, (long long)s1, n1,
+		       (long long)s2, n2);
+		bad++;
+	}
+	if (t < s1 - 1 || t > s2) {
+		printf("%s: time says %lld, __time says %lld to %lld\n",
+		       who, (long long)t, (long long)s1, (long long)s2);
+		bad++;
+	}
+
+	/* and never go backwards */
+	nanotime(&slast, &nlast);
+	for (i = 0; i < NTIMES; i++) {
+		nanotime(&sp, &np);
+		if (nsecs_between(slast, nlast, sp, np) < 0) {
+			printf("%s: nanotime went back from %lld.%09lu "
+			       "to %lld.%09lu\n", who, (long long)slast,
+			       nlast, (long long)sp, np);
+			bad++;
+			break;
+		}
+		slast = sp;
+		nlast = np;
+	}
+	return bad;
+}
+
+/* wait for PID and return how many problems it reported */
+static
+int
+reap(pid_t pid, const char *who)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid %s", who);
+	}
+	if (!WIFEXITED(status)) {
+		printf("%s: did not exit normally\n", who);
+		return 1;
+	}
+	return WEXITSTATUS(status);
+}
+
+int
+main(void)
+{
+	pid_t mypid, pid;
+	int bad;
+
+	mypid = __getpid();
+	bad = check("parent");
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		bad = check("fork child");
+		if (getpid() == mypid) {
+			printf("fork child: getpid still says the parent\n");
+			bad++;
+		}
+		_exit(bad);
+	}
+	bad += reap(pid, "fork child");
+
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		/* on the parent's stack: don't touch its variables */
+		_exit(check("vfork child") + (getpid() == mypid));
+	}
+	if (getpid() != mypid || __getpid() != mypid) {
+		printf("parent after vfork: getpid %d, __getpid %d, "
+		       "should be %d\n", getpid(), __getpid(), mypid);
+		bad++;
+	}
+	if (getpid() == pid) {
+		printf("parent after vfork: getpid says the child\n");
+		bad++;
+	}
+	bad += reap(pid, "vfork child");
+	bad += check("parent again");
+
+	if (bad) {
+		printf("kshared: %d problems\n", bad);
+		return 1;
+	}
+	printf("kshared: passed\n");
+	return 0;
+}
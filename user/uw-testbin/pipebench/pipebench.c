@@ -0,0 +1,170 @@
+/*
+ * pipebench - time pipes.
+ *
+ *  usage: pipebench [round-trips [kilobytes]]
+ *
+ *  First bounces one byte back and forth between this process and a
+ *  child over two pipes ROUND-TRIPS times (default 10000), which costs
+ *  two context switches a trip; then streams KILOBYTES (default 1024)
+ *  through one pipe to a child in 4k writes. Prints the time per
+ *  round trip and the throughput.
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define CHUNK 4096
+
+static char buf[CHUNK];
+
+static time_t secs1;
+static unsigned long nsecs1;
+
+static
+void
+start(void)
+{
+	nanotime(&secs1, &nsecs1);
+}
+
+/* microseconds since start() */
+static
+unsigned long
+stop(void)
+{
+	time_t secs2;
+	unsigned long nsecs2;
+
+	nanotime(&secs2, &nsecs2);
+	return (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+}
+
+static
+void
+reap(pid_t pid)
+{
+	int rval;
+
+	if (waitpid(pid, &rval, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(rval) || WEXITSTATUS(rval) != 0) {
+		errx(1, "child failed");
+	}
+}
+
+static
+void
+pingpong(int trips)
+{
+	int to[2], from[2];
+	pid_t pid;
+	unsigned long usecs;
+	int i;
+	char c = 'x';
+
+	if (pipe(to) < 0 || pipe(from) < 0) {
+		err(1, "pipe");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(to[1]);
+		close(from[0]);
+		for (i = 0; i < trips; i++) {
+			if (read(to[0], &c, 1) != 1 ||
+			    write(from[1], &c, 1) != 1) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+	close(to[0]);
+	close(from[1]);
+
+	start();
+	for (i = 0; i < trips; i++) {
+		if (write(to[1], &c, 1) != 1) {
+			err(1, "write");
+		}
+		if (read(from[0], &c, 1) != 1) {
+			err(1, "read");
+		}
+	}
+	usecs = stop();
+
+	close(to[1]);
+	close(from[0]);
+	reap(pid);
+	printf("ping-pong    %d round trips in %lu us (%lu us each)\n",
+	       trips, usecs, usecs / trips);
+}
+
+static
+void
+stream(int kbytes)
+{
+	int fds[2];
+	pid_t pid;
+	unsigned long usecs, total, want;
+	int r;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	want = (unsigned long)kbytes * 1024;
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		total = 0;
+		while ((r = read(fds[0], buf, sizeof(buf))) > 0) {
+			total += r;
+		}
+		_exit(r < 0 || total != want);
+	}
+	close(fds[0]);
+
+	start();
+	for (total = 0; total < want; total += r) {
+		r = write(fds[1], buf, sizeof(buf));
+		if (r <= 0) {
+			err(1, "write");
+		}
+	}
+	close(fds[1]);
+	reap(pid);
+	usecs = stop();
+
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("stream       %d KB in %lu us (%lu KB/s)\n", kbytes, usecs,
+	       (unsigned long)((unsigned long long)kbytes * 1000000 / usecs));
+}
+
+int
+main(int argc, char *argv[])
+{
+	int trips = 10000;
+	int kbytes = 1024;
+
+	if (argc > 1) {
+		trips = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		kbytes = atoi(argv[2]);
+	}
+	if (trips <= 0 || kbytes <= 0 || argc > 3) {
+		errx(1, "usage: pipebench [round-trips [kilobytes]]");
+	}
+
+	pingpong(trips);
+	stream(kbytes);
+	return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * Title   : polltest
+ *
+ * Tests poll and select on pipes.
+ *
+ * Checks that an empty pipe isn't readable and a fresh one is
+ * writeable, that a write makes it readable, that a timeout expires,
+ * that a child writing later wakes a poller blocked on two pipes, and
+ * that closing the write end reads as a hangup. Then does some of the
+ * same with select.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/select.h>
+#include "../lib/testutils.h"
+
+int
+main()
+{
+  int p1[2], p2[2];
+  int rc = 0;      /* return code */
+  struct pollfd pfd[2];
+  fd_set rset, wset;
+  struct timeval tv;
+  time_t secs1, secs2;
+  unsigned long nsecs1, nsecs2;
+  pid_t pid;
+  char ch = 'x';
+
+  /* Useful for debugging, if failures occur turn verbose on by uncommenting */
+  // TEST_VERBOSE_ON();
+
+  rc = pipe(p1);
+  TEST_EQUAL(rc, SUCCESS, "pipe failed");
+  rc = pipe(p2);
+  TEST_EQUAL(rc, SUCCESS, "pipe failed");
+
+  /* empty: not readable, but writeable */
+  pfd[0].fd = p1[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = p1[1];
+  pfd[1].events = POLLOUT;
+  rc = poll(pfd, 2, 0);
+  TEST_EQUAL(rc, 1, "poll on a fresh pipe");
+  TEST_EQUAL(pfd[0].revents, 0, "empty pipe is readable");
+  TEST_EQUAL(pfd[1].revents, POLLOUT, "fresh pipe isn't writeable");
+
+  /* one byte in: readable */
+  rc = write(p1[1], &ch, 1);
+  TEST_EQUAL(rc, 1, "write to pipe failed");
+  rc = poll(pfd, 1, 0);
+  TEST_EQUAL(rc, 1, "poll after write");
+  TEST_EQUAL(pfd[0].revents, POLLIN, "pipe isn't readable after write");
+  rc = read(p1[0], &ch, 1);
+  TEST_EQUAL(rc, 1, "read from pipe failed");
+
+  /* nothing coming: time out after about 100ms */
+  __time(&secs1, &nsecs1);
+  rc = poll(pfd, 1, 100);
+  __time(&secs2, &nsecs2);
+  TEST_EQUAL(rc, 0, "poll didn't time out");
+  rc = (secs2 - secs1) * 1000 + nsecs2 / 1000000 - nsecs1 / 1000000;
+  TEST_POSITIVE(rc >= 90, "poll timed out too soon");
+
+  /* a descriptor that isn't open */
+  pfd[1].fd = 100;
+  pfd[1].events = POLLIN;
+  rc = poll(pfd, 2, 0);
+  TEST_EQUAL(rc, 1, "poll on a closed descriptor");
+  TEST_EQUAL(pfd[1].revents, POLLNVAL, "closed descriptor isn't POLLNVAL");
+
+  /* a child writes to the second pipe later; we block on both */
+  pid = fork();
+  if (pid == 0) {
+    struct timespec ts = { 0, 50000000 };
+    nanosleep(&ts, NULL);
+    write(p2[1], &ch, 1);
+    _exit(0);
+  }
+  TEST_POSITIVE(pid, "fork failed");
+  pfd[0].fd = p1[0];
+  pfd[1].fd = p2[0];
+  pfd[1].events = POLLIN;
+  rc = poll(pfd, 2, -1);
+  TEST_EQUAL(rc, 1, "poll for the child's write");
+  TEST_EQUAL(pfd[0].revents, 0, "wrong pipe became readable");
+  TEST_EQUAL(pfd[1].revents, POLLIN, "child's pipe isn't readable");
+  rc = read(p2[0], &ch, 1);
+  TEST_EQUAL(rc, 1, "read of child's byte failed");
+  waitpid(pid, &rc, 0);
+
+  /* select sees the same things */
+  FD_ZERO(&rset);
+  FD_ZERO(&wset);
+  FD_SET(p2[0], &rset);
+  FD_SET(p2[1], &wset);
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  rc = select(p2[1] + 1, &rset, &wset, NULL, &tv);
+  TEST_EQUAL(rc, 1, "select on an empty pipe");
+  TEST_EQUAL(FD_ISSET(p2[0], &rset), 0, "select: empty pipe is readable");
+  TEST_EQUAL(FD_ISSET(p2[1], &wset), 1, "select: pipe isn't writeable");
+
+  /* closing the write end is a hangup, and end of file */
+  close(p2[1]);
+  pfd[0].fd = p2[0];
+  pfd[0].events = POLLIN;
+  rc = poll(pfd, 1, -1);
+  TEST_EQUAL(rc, 1, "poll after close");
+  TEST_EQUAL(pfd[0].revents, POLLIN | POLLHUP, "no hangup after close");
+  rc = read(p2[0], &ch, 1);
+  TEST_EQUAL(rc, 0, "no end of file after close");
+
+  FD_ZERO(&rset);
+  FD_SET(p2[0], &rset);
+  rc = select(p2[0] + 1, &rset, NULL, NULL, NULL);
+  TEST_EQUAL(rc, 1, "select after close");
+
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[0]);
+
+  TEST_STATS();
+
+  exit(0);
+}
@@ -0,0 +1,104 @@
+/*
+ * spawnbench - time the ways of starting a new program.
+ *
+ *  usage: spawnbench [iterations]
+ *
+ *  Starts a trivial program (this one, run with the argument "exit",
+ *  which makes it exit at once) repeatedly, first with fork+execv,
+ *  then with vfork+execv, then with spawn, waiting for each child
+ *  before starting the next, and prints the average time per child.
+ *
+ *  fork copies the whole address space only for execv to throw it
+ *  away; vfork and spawn should both be noticeably cheaper.
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#define PROGRAM "/uw-testbin/spawnbench"
+
+static char *childargs[] = { (char *)PROGRAM, (char *)"exit", NULL };
+
+static
+pid_t
+start_fork(void)
+{
+  pid_t pid = fork();
+  if (pid == 0) {
+    execv(PROGRAM, childargs);
+    _exit(1);
+  }
+  return pid;
+}
+
+static
+pid_t
+start_vfork(void)
+{
+  pid_t pid = vfork();
+  if (pid == 0) {
+    execv(PROGRAM, childargs);
+    _exit(1);
+  }
+  return pid;
+}
+
+static
+pid_t
+start_spawn(void)
+{
+  return spawn(PROGRAM, childargs);
+}
+
+static
+void
+dobench(const char *name, pid_t (*start)(void), int iterations)
+{
+  pid_t pid;
+  int i, rval;
+  time_t secs1, secs2;
+  unsigned long nsecs1, nsecs2;
+  unsigned long usecs;
+
+  nanotime(&secs1, &nsecs1);
+  for (i = 0; i < iterations; i++) {
+    pid = start();
+    if (pid < 0) {
+      err(1, "%s %d", name, i);
+    }
+    if (waitpid(pid, &rval, 0) < 0) {
+      err(1, "waitpid %d", i);
+    }
+    if (!WIFEXITED(rval) || WEXITSTATUS(rval) != 0) {
+      errx(1, "%s: child %d failed", name, i);
+    }
+  }
+  nanotime(&secs2, &nsecs2);
+
+  usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+  printf("%-12s %d children in %lu us (%lu us each)\n",
+         name, iterations, usecs, usecs / iterations);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int iterations = 100;
+
+  if (argc > 1 && !strcmp(argv[1], "exit")) {
+    return 0;
+  }
+  if (argc > 1) {
+    iterations = atoi(argv[1]);
+    if (iterations <= 0) {
+      errx(1, "usage: spawnbench [iterations]");
+    }
+  }
+
+  dobench("fork+execv", start_fork, iterations);
+  dobench("vfork+execv", start_vfork, iterations);
+  dobench("spawn", start_spawn, iterations);
+  return 0;
+}
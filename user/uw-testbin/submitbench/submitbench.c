@@ -0,0 +1,134 @@
+/*
+ * submitbench - compare one trap per system call with batched calls.
+ *
+ *  usage: submitbench [count]
+ *
+ *  Times COUNT trivial calls made one trap each (__getpid) against COUNT
+ *  no-op requests batched through submit(), then COUNT small writes
+ *  and reads of a scratch file done with write/read against the same
+ *  done through submit(), and prints the average cost of each.
+ *
+ *  Creates (and leaves behind) a file named SUBMITFILE in the current
+ *  directory.
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include <sys/submit.h>
+
+#define RECSIZE 16
+
+static struct submit_ring ring;
+static char rec[RECSIZE];
+
+static time_t secs1;
+static unsigned long nsecs1;
+
+static
+void
+start(void)
+{
+  nanotime(&secs1, &nsecs1);
+}
+
+static
+void
+stop(const char *what, int count)
+{
+  time_t secs2;
+  unsigned long nsecs2, usecs;
+
+  nanotime(&secs2, &nsecs2);
+  usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+  printf("%-24s %6d ops in %8lu us (%lu ns each)\n",
+         what, count, usecs, usecs * 1000 / count);
+}
+
+/*
+ * Queue COUNT requests of type OP on FD (as fast as the ring takes
+ * them), and check every completion.
+ */
+static
+void
+batch(int op, int fd, int count)
+{
+  struct submit_cqe cqe;
+  int queued = 0, reaped = 0;
+
+  while (reaped < count) {
+    while (queued < count &&
+           submit_queue(&ring, op, fd, rec, RECSIZE, -1, queued) == 0) {
+      queued++;
+    }
+    if (submit_flush(&ring) < 0) {
+      err(1, "submit");
+    }
+    while (submit_reap(&ring, &cqe)) {
+      if (cqe.cqe_res != (op == SUBMIT_NOP ? 0 : RECSIZE)) {
+        errx(1, "request %d: result %d", (int)cqe.cqe_data, cqe.cqe_res);
+      }
+      reaped++;
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int count = 10000;
+  int fd, i;
+
+  if (argc > 1) {
+    count = atoi(argv[1]);
+    if (count <= 0) {
+      errx(1, "usage: submitbench [count]");
+    }
+  }
+  memset(rec, 'x', RECSIZE);
+  submit_init(&ring);
+
+  start();
+  for (i = 0; i < count; i++) {
+    __getpid();
+  }
+  stop("__getpid (one trap each)", count);
+
+  start();
+  batch(SUBMIT_NOP, -1, count);
+  stop("submit nop", count);
+
+  fd = open("SUBMITFILE", O_RDWR | O_CREAT | O_TRUNC);
+  if (fd < 0) {
+    err(1, "SUBMITFILE");
+  }
+
+  start();
+  for (i = 0; i < count; i++) {
+    if (write(fd, rec, RECSIZE) != RECSIZE) {
+      err(1, "write");
+    }
+  }
+  stop("write", count);
+
+  start();
+  batch(SUBMIT_WRITE, fd, count);
+  stop("submit write", count);
+
+  lseek(fd, 0, SEEK_SET);
+  start();
+  for (i = 0; i < count; i++) {
+    if (read(fd, rec, RECSIZE) != RECSIZE) {
+      err(1, "read");
+    }
+  }
+  stop("read", count);
+
+  start();
+  batch(SUBMIT_READ, fd, count);
+  stop("submit read", count);
+
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * sysstat - profile the system calls a program makes.
+ *
+ *  usage: sysstat program [args...]
+ *
+ *  Resets the kernel's system call statistics, runs the program,
+ *  waits for it, and prints what was recorded meanwhile: for each
+ *  call, how many times it was made, how many failed, and the average
+ *  and longest time it took. The numbers cover every process in the
+ *  system, not just the program (and its children).
+ *
+ *  Needs a kernel built with "options syscallstat".
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include <kern/syscall.h>
+
+#define NCALLS 128
+
+static struct sysstat stats[NCALLS];
+
+static
+const char *
+callname(int callno)
+{
+  switch (callno) {
+  case SYS_fork: return "fork";
+  case SYS_vfork: return "vfork";
+  case SYS_execv: return "execv";
+  case SYS_waitpid: return "waitpid";
+  case SYS_getpid: return "getpid";
+  case SYS_open: return "open";
+  case SYS_close: return "close";
+  case SYS_read: return "read";
+  case SYS_write: return "write";
+  case SYS_copy_file_range: return "copy_file_range";
+  case SYS_lseek: return "lseek";
+  case SYS_select: return "select";
+  case SYS_poll: return "poll";
+  case SYS_dup2: return "dup2";
+  case SYS_pipe: return "pipe";
+  case SYS_spawn: return "spawn";
+  case SYS_sysstat: return "sysstat";
+  default: return "";
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  pid_t pid;
+  int i, n, status;
+
+  if (argc < 2) {
+    errx(1, "usage: sysstat program [args...]");
+  }
+
+  /* throw away whatever was there */
+  if (sysstat(stats, 0, SYSSTAT_RESET) < 0) {
+    err(1, "sysstat");
+  }
+
+  pid = spawn(argv[1], argv + 1);
+  if (pid < 0) {
+    err(1, "%s", argv[1]);
+  }
+  if (waitpid(pid, &status, 0) < 0) {
+    err(1, "waitpid");
+  }
+
+  n = sysstat(stats, NCALLS, 0);
+  if (n < 0) {
+    err(1, "sysstat");
+  }
+
+  printf("%-4s %-15s %8s %8s %10s %10s\n",
+         "NUM", "NAME", "CALLS", "ERRORS", "AVG(ns)", "MAX(ns)");
+  for (i = 0; i < n; i++) {
+    if (stats[i].ss_calls == 0) {
+      continue;
+    }
+    printf("%-4d %-15s %8lu %8lu %10lu %10lu\n", i, callname(i),
+           (unsigned long)stats[i].ss_calls,
+           (unsigned long)stats[i].ss_errors,
+           (unsigned long)(stats[i].ss_totalns / stats[i].ss_calls),
+           (unsigned long)stats[i].ss_maxns);
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Title   : vecio
+ *
+ * Tests writev, readv, pread and pwrite.
+ * Assumes that a file named VECFILE does not exist in current directory
+ *
+ * Writes two records with one writev, reads them back with one readv,
+ * then checks that pread and pwrite use the position they're given
+ * and leave the file offset alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "../lib/testutils.h"
+
+int
+main()
+{
+  int fd;
+  int rc = 0;      /* return code */
+  int key = 42, key2 = 0;
+  char val[8] = "abcdefg", val2[8];
+  int intbuf = 0;
+  struct iovec iov[2];
+
+  /* Useful for debugging, if failures occur turn verbose on by uncommenting */
+  // TEST_VERBOSE_ON();
+
+  fd = open("VECFILE", O_RDWR | O_CREAT | O_TRUNC);
+  TEST_POSITIVE(fd, "Unable to open VECFILE");
+
+  /* one record: key then value */
+  iov[0].iov_base = &key;
+  iov[0].iov_len = sizeof(key);
+  iov[1].iov_base = val;
+  iov[1].iov_len = sizeof(val);
+  rc = writev(fd, iov, 2);
+  TEST_EQUAL(rc, sizeof(key) + sizeof(val), "writev wrote wrong amount");
+
+  rc = lseek(fd, 0, SEEK_CUR);
+  TEST_EQUAL(rc, sizeof(key) + sizeof(val), "writev didn't move offset");
+
+  rc = lseek(fd, 0, SEEK_SET);
+  TEST_EQUAL(rc, 0, "lseek to start failed");
+
+  iov[0].iov_base = &key2;
+  iov[1].iov_base = val2;
+  rc = readv(fd, iov, 2);
+  TEST_EQUAL(rc, sizeof(key) + sizeof(val), "readv read wrong amount");
+  TEST_EQUAL(key2, key, "readv got wrong key");
+  TEST_EQUAL(memcmp(val, val2, sizeof(val)), 0, "readv got wrong value");
+
+  rc = readv(fd, iov, 0);
+  TEST_NEGATIVE(rc, "readv of no iovecs didn't fail");
+
+  /* overwrite the key in place; the offset stays at the end */
+  key = 7;
+  rc = pwrite(fd, &key, sizeof(key), 0);
+  TEST_EQUAL(rc, sizeof(key), "pwrite wrote wrong amount");
+
+  rc = pread(fd, &intbuf, sizeof(intbuf), 0);
+  TEST_EQUAL(rc, sizeof(intbuf), "pread read wrong amount");
+  TEST_EQUAL(intbuf, key, "pread got wrong key");
+
+  rc = lseek(fd, 0, SEEK_CUR);
+  TEST_EQUAL(rc, sizeof(key) + sizeof(val), "pread/pwrite moved offset");
+
+  rc = pread(fd, &intbuf, sizeof(intbuf), -1);
+  TEST_NEGATIVE(rc, "pread at negative offset didn't fail");
+
+  rc = pread(STDIN_FILENO, &intbuf, sizeof(intbuf), 0);
+  TEST_NEGATIVE(rc, "pread on console didn't fail");
+
+  rc = close(fd);
+  TEST_EQUAL(rc, SUCCESS, "close failed");
+
+  TEST_STATS();
+
+  exit(0);
+}
@@ -13,6 +13,10 @@
  *
  *  Example of correct output:  PAPBPCabc
  *
+ *  widefork N instead times exit and waitpid throughput: the parent
+ *  forks N children, each of which forks and waits for a grandchild,
+ *  so up to N processes are blocked in waitpid at once.
+ *
  */
 #include <unistd.h>
 #include <stdlib.h>
@@ -21,6 +25,7 @@
 
 int dofork(int);
 void dowait(int,int);
+void dobench(int);
 
 int
 dofork(int childnum) 
@@ -59,12 +64,69 @@ dowait(int childpid, int childnum)
   }
 }
 
+void
+dobench(int nchildren)
+{
+  pid_t *pids;
+  pid_t pid;
+  int i, rval;
+  time_t secs1, secs2;
+  unsigned long nsecs1, nsecs2;
+  unsigned long usecs;
+
+  if (nchildren <= 0) {
+    errx(1,"usage: widefork [nchildren]");
+  }
+  pids = malloc(nchildren * sizeof(pid_t));
+  if (pids == NULL) {
+    errx(1,"malloc");
+  }
+
+  nanotime(&secs1, &nsecs1);
+  for (i = 0; i < nchildren; i++) {
+    pids[i] = fork();
+    if (pids[i] < 0) {
+      errx(1,"fork %d",i);
+    }
+    else if (pids[i] == 0) {
+      /* child: fork a grandchild and wait for it */
+      pid = fork();
+      if (pid < 0) {
+        _exit(1);
+      }
+      else if (pid == 0) {
+        _exit(0);
+      }
+      if (waitpid(pid,&rval,0) < 0) {
+        _exit(1);
+      }
+      _exit(0);
+    }
+  }
+  for (i = 0; i < nchildren; i++) {
+    if (waitpid(pids[i],&rval,0) < 0) {
+      warnx("waitpid %d",i);
+    }
+    else if (!WIFEXITED(rval) || WEXITSTATUS(rval) != 0) {
+      warnx("child %d failed",i);
+    }
+  }
+  nanotime(&secs2, &nsecs2);
+
+  usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+  printf("%d exits and waits in %lu us (%lu us each)\n",
+         2 * nchildren, usecs, usecs / (2 * nchildren));
+  free(pids);
+}
+
 int
 main(int argc, char *argv[])
 {
-  (void)argc;
-  (void)argv;
   pid_t pid1,pid2,pid3;
+  if (argc > 1) {
+    dobench(atoi(argv[1]));
+    return(0);
+  }
   putchar('P');
   putchar('\n');
   pid1 = dofork(1);